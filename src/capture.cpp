@@ -0,0 +1,214 @@
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include "capture.hpp"
+
+#define SLACK_SEC 5.0               /* Ring length past the dumped length */
+#define WAV_FORMAT_FLOAT 3
+
+static void put_u16(uint8_t *dst, uint16_t x);
+static void put_u32(uint8_t *dst, uint32_t x);
+
+CaptureRing::CaptureRing()
+{
+	m_ring = std::make_shared<std::vector<float>>();
+	m_length = 0;
+	m_seconds = 0;
+	m_samplerate = 0;
+	m_written = 0;
+	m_generation = 0;
+	m_dumps = m_failures = 0;
+	m_running = true;
+	m_thread = std::thread(&CaptureRing::workerLoop, this);
+}
+
+CaptureRing::~CaptureRing()
+{
+	{
+		std::lock_guard<std::mutex> lck(m_mtx);
+		m_running = false;
+	}
+	m_cv.notify_one();
+	m_thread.join();
+}
+
+void
+CaptureRing::configure(double seconds, int samplerate)
+{
+	auto ring = std::make_shared<std::vector<float>>();
+
+	seconds = std::max(0.0, seconds);
+	const size_t length = (size_t)(seconds * samplerate);
+
+	/* Allocate before taking the lock, so that dumps only ever wait for the
+	 * pointer swap. A dump in progress keeps the old buffer alive */
+	if (length) ring->assign(length + (size_t)(SLACK_SEC * samplerate), 0.0f);
+
+	std::lock_guard<std::mutex> lck(m_ringMtx);
+	m_ring.swap(ring);
+	m_seconds = seconds;
+	m_samplerate = samplerate;
+	m_length = length;
+	m_written = 0;
+	m_generation++;
+}
+
+void
+CaptureRing::setSamplerate(int samplerate)
+{
+	if (samplerate != m_samplerate) configure(m_seconds, samplerate);
+}
+
+void
+CaptureRing::write(const float *src, int count)
+{
+	std::vector<float>& ring = *m_ring;
+	const size_t size = ring.size();
+	uint64_t pos = m_written.load(std::memory_order_relaxed);
+	size_t offset, len;
+
+	if (!size) return;
+
+	/* Only the tail of a buffer longer than the ring would survive */
+	if ((size_t)count > size) {
+		pos += count - size;
+		src += count - size;
+		count = size;
+	}
+
+	while (count > 0) {
+		offset = pos % size;
+		len = std::min<size_t>(count, size - offset);
+		memcpy(ring.data() + offset, src, len * sizeof(*src));
+		src += len;
+		count -= len;
+		pos += len;
+	}
+	m_written.store(pos, std::memory_order_release);
+}
+
+bool
+CaptureRing::requestDump(const std::string& fname)
+{
+	{
+		std::lock_guard<std::mutex> lck(m_mtx);
+		if (!m_pending.empty()) return false;
+		m_pending = fname;
+	}
+	m_cv.notify_one();
+	return true;
+}
+
+std::string
+CaptureRing::lastDump()
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	return m_last;
+}
+
+/* Private methods {{{ */
+void
+CaptureRing::workerLoop()
+{
+	std::unique_lock<std::mutex> lck(m_mtx);
+	std::string fname;
+
+	while (m_running) {
+		m_cv.wait(lck, [this]{ return !m_running || !m_pending.empty(); });
+		if (!m_running) break;
+
+		fname = m_pending;
+		lck.unlock();
+		const bool ok = dump(fname);
+		lck.lock();
+
+		if (ok) {
+			m_dumps++;
+			m_last = fname;
+		} else {
+			m_failures++;
+		}
+		m_pending.clear();
+	}
+}
+
+/**
+ * Write the ring to a WAV file, oldest sample first. The samples are written
+ * from the ring itself while the DSP thread keeps appending to it, so the
+ * file is only kept if the writer stayed clear of them throughout, and the
+ * ring wasn't replaced in the meantime.
+ */
+bool
+CaptureRing::dump(const std::string& fname)
+{
+	std::shared_ptr<std::vector<float>> ring;
+	uint64_t start, end, pos;
+	uint32_t dataLen;
+	unsigned generation;
+	int samplerate;
+	size_t size, offset, len;
+	uint8_t hdr[44];
+	bool ok;
+	FILE *fd;
+
+	{
+		std::lock_guard<std::mutex> lck(m_ringMtx);
+		ring = m_ring;
+		generation = m_generation;
+		samplerate = m_samplerate;
+		end = m_written.load(std::memory_order_acquire);
+		start = end - std::min<uint64_t>(end, m_length);
+	}
+	size = ring->size();
+	dataLen = (end - start) * sizeof(float);
+
+	if (!size || end == start) return false;
+	if (!(fd = fopen(fname.c_str(), "wb"))) return false;
+
+	memcpy(hdr, "RIFF", 4);
+	put_u32(hdr + 4, 36 + dataLen);
+	memcpy(hdr + 8, "WAVEfmt ", 8);
+	put_u32(hdr + 16, 16);
+	put_u16(hdr + 20, WAV_FORMAT_FLOAT);
+	put_u16(hdr + 22, 1);
+	put_u32(hdr + 24, samplerate);
+	put_u32(hdr + 28, samplerate * sizeof(float));
+	put_u16(hdr + 32, sizeof(float));
+	put_u16(hdr + 34, 8 * sizeof(float));
+	memcpy(hdr + 36, "data", 4);
+	put_u32(hdr + 40, dataLen);
+	ok = fwrite(hdr, sizeof(hdr), 1, fd) == 1;
+
+	for (pos = start; ok && pos < end; pos += len) {
+		offset = pos % size;
+		len = std::min<uint64_t>(end - pos, size - offset);
+		ok = fwrite(ring->data() + offset, len * sizeof(float), 1, fd) == 1;
+	}
+	ok = fclose(fd) == 0 && ok;
+
+	/* The writer may be halfway through a buffer past what it published:
+	 * only trust the copy if it stayed well within the slack */
+	if (ok) {
+		std::lock_guard<std::mutex> lck(m_ringMtx);
+		ok = generation == m_generation && m_written.load(std::memory_order_acquire) - end <= (size - m_length) / 2;
+	}
+	if (!ok) remove(fname.c_str());
+	return ok;
+}
+/* }}} */
+
+/* Static functions {{{ */
+static void
+put_u16(uint8_t *dst, uint16_t x)
+{
+	dst[0] = x & 0xFF;
+	dst[1] = x >> 8;
+}
+
+static void
+put_u32(uint8_t *dst, uint32_t x)
+{
+	put_u16(dst, x & 0xFFFF);
+	put_u16(dst + 2, x >> 16);
+}
+/* }}} */
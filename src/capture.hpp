@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Pre-trigger capture of the decoder input: always holds the last few seconds
+ * of demodulated signal, so that they can be saved to disk when something
+ * goes wrong, and replayed offline (radiosonde_replay, radiosonde_batch).
+ *
+ * The DSP thread appends to a ring with plain copies followed by a release
+ * store of the sample count, and never waits. Dumps run on a worker thread,
+ * which writes float32 WAV files straight from the ring's memory, then checks
+ * that the writer didn't come around to the samples it was copying: the ring
+ * has some slack past the requested length, so only dumps that take longer
+ * than that fail. Resizing the ring swaps in a new buffer, and doesn't wait
+ * for a dump in progress either: the dump keeps the old buffer alive, and
+ * fails.
+ */
+class CaptureRing {
+public:
+	CaptureRing();
+	~CaptureRing();
+
+	/**
+	 * Resize the ring, dropping its contents. Never waits for a dump. Must
+	 * not be called while write() may be running.
+	 *
+	 * @param seconds length of signal kept, 0 to free the ring
+	 * @param samplerate sample rate of the signal, in Hz
+	 */
+	void configure(double seconds, int samplerate);
+
+	/**
+	 * Same as configure() with the current length, but only if the sample
+	 * rate actually changes
+	 */
+	void setSamplerate(int samplerate);
+
+	/**
+	 * Append samples to the ring, overwriting the oldest ones. Called by the
+	 * DSP thread only.
+	 */
+	void write(const float *src, int count);
+
+	/**
+	 * Queue a dump of the ring as it is now. Never waits.
+	 *
+	 * @param fname path of the WAV file to write
+	 * @return false if another dump is still pending
+	 */
+	bool requestDump(const std::string& fname);
+
+	double seconds() const { return m_seconds; }
+	int samplerate() const { return m_samplerate; }
+
+	/* Outcome of the dumps so far, for display */
+	unsigned dumps() const { return m_dumps; }
+	unsigned failures() const { return m_failures; }
+	std::string lastDump();
+
+private:
+	void workerLoop();
+	bool dump(const std::string& fname);
+
+	std::shared_ptr<std::vector<float>> m_ring;     /* Never NULL, shared with a dump in progress */
+	size_t m_length;                    /* Samples dumped, at most */
+	double m_seconds;
+	int m_samplerate;
+	std::atomic<uint64_t> m_written;    /* Samples ever written */
+	unsigned m_generation;              /* Incremented whenever the ring is replaced */
+	std::mutex m_ringMtx;               /* Guards the above against dumps, briefly. Never held by write() */
+
+	std::mutex m_mtx;
+	std::condition_variable m_cv;
+	std::string m_pending, m_last;      /* Guarded by m_mtx */
+	std::atomic<unsigned> m_dumps, m_failures;
+	bool m_running;
+	std::thread m_thread;
+};
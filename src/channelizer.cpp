@@ -0,0 +1,243 @@
+#include <algorithm>
+#include <math.h>
+#include "channelizer.hpp"
+
+#define SCAN_INTERVAL 0.25          /* Seconds of spectrum averaged before each scan */
+
+Channelizer::~Channelizer()
+{
+	if (!_block_init) return;
+	stop();
+	unregisterInput(m_in);
+	_block_init = false;
+}
+
+void
+Channelizer::init(dsp::stream<dsp::complex_t> *in)
+{
+	m_in = in;
+	registerInput(m_in);
+	_block_init = true;
+}
+
+void
+Channelizer::setInput(dsp::stream<dsp::complex_t> *in)
+{
+	assert(_block_init);
+	std::lock_guard<std::recursive_mutex> lck(ctrlMtx);
+	tempStop();
+	unregisterInput(m_in);
+	m_in = in;
+	registerInput(m_in);
+	tempStart();
+}
+
+void
+Channelizer::configure(double samplerate, int decimation, double bandwidth, double outSamplerate)
+{
+	m_lanes.clear();
+	m_bank.init(samplerate, decimation, bandwidth);
+	m_samplerate = samplerate;
+	m_laneSamplerate = m_bank.outputSamplerate();
+	m_bandwidth = bandwidth;
+	m_outSamplerate = outSamplerate;
+	m_scanning = false;
+	m_bank.setPowerAveraging(false);
+	m_clock = 0;
+}
+
+void
+Channelizer::addLane(double offset, radiosonde::DecoderBase *decoder)
+{
+	std::unique_ptr<Lane> lane(new Lane);
+
+	lane->channel = m_bank.addChannel(offset);
+	lane->decoder = decoder;
+	lane->demod.init(NULL, m_laneSamplerate, m_bandwidth / 2.0f, m_outSamplerate);
+	lane->demod.setSquelch(m_squelchEnabled, m_squelchThreshold);
+	lane->offset = offset;
+	lane->lastSeen = 0;
+	if (m_scanning) {
+		lane->active = false;
+		m_bank.setChannelEnabled(lane->channel, false);
+	}
+	m_lanes.push_back(std::move(lane));
+}
+
+void
+Channelizer::setScan(bool enabled, double span, float threshold, double timeout)
+{
+	m_scanning = enabled;
+	m_scanner.configure(m_bank.binWidth(), m_bank.fftSize(), m_bandwidth, span);
+	m_scanner.setThreshold(threshold);
+	m_scanBlocks = std::max(1, (int)(SCAN_INTERVAL * m_samplerate / m_bank.blockLength()));
+	m_laneTimeout = (int64_t)(timeout * m_samplerate);
+	m_bank.setPowerAveraging(enabled);
+}
+
+void
+Channelizer::setSquelch(bool enabled, float threshold)
+{
+	std::lock_guard<std::recursive_mutex> lck(ctrlMtx);
+	tempStop();
+	m_squelchEnabled = enabled;
+	m_squelchThreshold = threshold;
+	for (auto& lane : m_lanes) lane->demod.setSquelch(enabled, threshold);
+	tempStart();
+}
+
+int
+Channelizer::openLanes() const
+{
+	int count = 0;
+
+	for (auto& lane : m_lanes) {
+		if (!lane->demod.squelchEnabled() || lane->demod.squelch().open()) count++;
+	}
+	return count;
+}
+
+void
+Channelizer::clearLanes()
+{
+	m_lanes.clear();
+	m_bank.clearChannels();
+}
+
+int
+Channelizer::run()
+{
+	const int64_t start = m_metrics ? PipelineMetrics::nowNs() : 0;
+	int count;
+
+	if ((count = m_in->read()) < 0) return -1;
+	if (m_metrics) m_metrics->addRead(0, PipelineMetrics::nowNs() - start);
+
+	process(m_in->readBuf, count);
+	m_in->flush();
+
+	return 0;
+}
+
+void
+Channelizer::process(const dsp::complex_t *in, int count)
+{
+	m_capture = PipelineMetrics::nowNs() / 1000;
+	if ((int)m_input.size() < count) m_input.resize(count);
+	for (int i=0; i<count; i++) {
+		m_input[i] = std::complex<float>(in[i].re, in[i].im);
+	}
+
+	/* Shared FFT + per-channel extraction, then demod/decode in parallel */
+	m_count = m_bank.process(m_input.data(), count);
+	m_clock += count;
+	if (m_scanning && m_bank.powerBlocks() >= m_scanBlocks) scan();
+	if (m_count > 0) m_pool.parallelFor(m_lanes.size(), processLane, this);
+}
+
+void
+Channelizer::doStart()
+{
+	m_pool.start(std::max(0, std::min((int)std::thread::hardware_concurrency(), (int)m_lanes.size()) - 1));
+	dsp::block::doStart();
+}
+
+void
+Channelizer::doStop()
+{
+	dsp::block::doStop();
+	m_pool.stop();
+}
+
+/* Private methods {{{ */
+void
+Channelizer::processLane(int idx, void *ctx)
+{
+	Channelizer *_this = (Channelizer*)ctx;
+	Lane *lane = _this->m_lanes[idx].get();
+	const std::complex<float> *out = _this->m_bank.output(lane->channel);
+	const int count = _this->m_count;
+	int64_t demodTime;
+	int demodulated;
+
+	if (!lane->active) return;
+	if ((int)lane->iq.size() < count) {
+		lane->iq.resize(count);
+		lane->samples.resize(lane->demod.maxOutput(count));
+	}
+
+	for (int i=0; i<count; i++) {
+		lane->iq[i].re = out[i].real();
+		lane->iq[i].im = out[i].imag();
+	}
+
+	/* Nothing comes out while the lane is squelched: skip the decoder too */
+	demodulated = lane->demod.process(count, lane->iq.data(), lane->samples.data());
+	if (!demodulated) return;
+	if (_this->m_metrics) _this->m_metrics->addRead(demodulated, 0);
+
+	/* Demodulated samples go straight to the decoder, with no queue between */
+	demodTime = PipelineMetrics::nowNs() / 1000;
+	lane->decoder->setStamp(_this->m_capture, demodTime, demodTime);
+	lane->decoder->process(lane->samples.data(), demodulated);
+}
+
+/**
+ * Match the carriers in the latest spectrum to the lanes: lanes whose carrier
+ * is still there stay, new carriers get an idle lane if there is one left, and
+ * lanes whose carrier has been gone for too long go back to the pool
+ */
+void
+Channelizer::scan()
+{
+	m_bank.takePower(&m_power);
+	m_scanner.detect(m_power, &m_carriers);
+
+	for (double carrier : m_carriers) {
+		Lane *idle = NULL;
+		bool tracked = false;
+
+		for (auto& lane : m_lanes) {
+			if (!lane->active) {
+				if (!idle) idle = lane.get();
+			} else if (fabs(lane->offset - carrier) < m_bandwidth / 2) {
+				lane->lastSeen = m_clock;
+				tracked = true;
+				break;
+			}
+		}
+		if (!tracked && idle) assignLane(idle, carrier);
+	}
+
+	for (auto& lane : m_lanes) {
+		if (lane->active && m_clock - lane->lastSeen > m_laneTimeout) retireLane(lane.get());
+	}
+}
+
+void
+Channelizer::assignLane(Lane *lane, double offset)
+{
+	m_bank.retuneChannel(lane->channel, offset);
+	m_bank.setChannelEnabled(lane->channel, true);
+	lane->demod.reset();
+
+	/* Start over from the type search, with no data from the previous sonde.
+	 * Get fresh contexts now rather than halfway through the lane's samples */
+	lane->decoder->release();
+	lane->decoder->clearData();
+	lane->decoder->prepare();
+
+	lane->offset = offset;
+	lane->lastSeen = m_clock;
+	lane->assignment++;
+	lane->active = true;
+}
+
+void
+Channelizer::retireLane(Lane *lane)
+{
+	lane->active = false;
+	m_bank.setChannelEnabled(lane->channel, false);
+	lane->decoder->release();
+}
+/* }}} */
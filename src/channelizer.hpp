@@ -0,0 +1,145 @@
+#pragma once
+
+#include <atomic>
+#include <complex>
+#include <dsp/block.h>
+#include <memory>
+#include <vector>
+#include "decode/decoder.hpp"
+#include "filterbank.hpp"
+#include "fmresampler.hpp"
+#include "scanner.hpp"
+#include "threadpool.hpp"
+
+/**
+ * Extracts several narrowband channels from a single wideband IQ stream, and
+ * runs each of them through its own FM discriminator/resampler and decoder.
+ * Channels are spread across a thread pool once extracted.
+ *
+ * In scan mode, the lanes are a pool instead: they start idle, and are tuned
+ * to the carriers found in the power spectrum of the input (see
+ * CarrierScanner) as they appear, then go back to the pool once their carrier
+ * has been gone for a while. Idle lanes cost nothing.
+ */
+class Channelizer : public dsp::block {
+public:
+	Channelizer() {};
+	~Channelizer();
+
+	void init(dsp::stream<dsp::complex_t> *in);
+	void setInput(dsp::stream<dsp::complex_t> *in);
+
+	/**
+	 * Configure the channelizer. Removes all lanes, must be called while the
+	 * block is stopped.
+	 *
+	 * @param samplerate sample rate of the wideband input
+	 * @param decimation decimation factor from the wideband input to each
+	 *        lane, must be a power of two
+	 * @param bandwidth bandwidth of each channel
+	 * @param outSamplerate sample rate the decoders expect. If equal to the
+	 *        lane rate, no resampling takes place.
+	 */
+	void configure(double samplerate, int decimation, double bandwidth, double outSamplerate);
+
+	/**
+	 * Add a lane. Must be called while the block is stopped.
+	 *
+	 * @param offset center frequency of the channel, relative to the center of
+	 *        the wideband input, in Hz
+	 * @param decoder decoder to feed. It must have been initialized with the
+	 *        output sample rate, and must not be running.
+	 */
+	void addLane(double offset, radiosonde::DecoderBase *decoder);
+	void clearLanes();
+
+	/**
+	 * Enable or disable scan mode. Must be called while the block is stopped,
+	 * after configure() and before adding lanes, which then start idle and
+	 * are tuned automatically (their offset is ignored).
+	 *
+	 * @param enabled false to use the lanes as added
+	 * @param span carriers are searched for within this distance of the
+	 *        center of the input, in Hz
+	 * @param threshold level above the noise floor a carrier must reach, dB
+	 * @param timeout time a lane stays tuned after its carrier was last seen,
+	 *        in seconds
+	 */
+	void setScan(bool enabled, double span, float threshold, double timeout);
+
+	/* Lane state, safe to read from any thread */
+	bool laneActive(int idx) const { return m_lanes[idx]->active; }
+	double laneOffset(int idx) const { return m_lanes[idx]->offset; }
+	unsigned laneAssignment(int idx) const { return m_lanes[idx]->assignment; }   /* Changes every time it is retuned */
+
+	/**
+	 * Enable or disable the carrier squelch of every lane, current and future.
+	 * See FMResampler::setSquelch().
+	 */
+	void setSquelch(bool enabled, float threshold);
+
+	/**
+	 * @return number of lanes whose squelch is open (or disabled)
+	 */
+	int openLanes() const;
+	int laneCount() const { return m_lanes.size(); }
+
+	/**
+	 * Report read wait times and per-lane sample counts to the given metrics
+	 */
+	void setMetrics(PipelineMetrics *metrics) { m_metrics = metrics; }
+
+	/**
+	 * Process a buffer of wideband samples, e.g. from a recording, on the
+	 * calling thread. Must not be used while the block is running.
+	 *
+	 * @param in IQ samples
+	 * @param count number of samples in in
+	 */
+	void process(const dsp::complex_t *in, int count);
+
+	int run() override;
+
+protected:
+	void doStart() override;
+	void doStop() override;
+
+private:
+	struct Lane {
+		FMResampler demod;
+		std::vector<dsp::complex_t> iq;
+		std::vector<float> samples;
+		radiosonde::DecoderBase *decoder;
+		int channel;
+
+		std::atomic<bool> active{true};
+		std::atomic<double> offset{0};
+		std::atomic<unsigned> assignment{0};
+		int64_t lastSeen;           /* Input sample count when the carrier was last detected */
+	};
+
+	static void processLane(int idx, void *ctx);
+	void scan();
+	void assignLane(Lane *lane, double offset);
+	void retireLane(Lane *lane);
+
+	dsp::stream<dsp::complex_t> *m_in;
+	FilterBank m_bank;
+	double m_samplerate, m_laneSamplerate, m_bandwidth, m_outSamplerate;
+	std::vector<std::unique_ptr<Lane>> m_lanes;
+	std::vector<std::complex<float>> m_input;
+	ThreadPool m_pool;
+	PipelineMetrics *m_metrics = NULL;
+	int m_count;
+	int64_t m_capture;                  /* When the current input buffer came in (microseconds, monotonic) */
+	bool m_squelchEnabled = false;
+	float m_squelchThreshold = 0;
+
+	bool m_scanning = false;
+	CarrierScanner m_scanner;
+	int m_scanBlocks;                   /* Blocks of spectrum averaged by each scan */
+	int64_t m_laneTimeout;              /* Input samples */
+	int64_t m_clock;                    /* Input samples processed */
+	std::vector<float> m_power;
+	std::vector<double> m_carriers;
+};
@@ -0,0 +1,106 @@
+#include <algorithm>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "datatable.hpp"
+
+#define LEN(x) (sizeof(x)/sizeof(*x))
+
+void
+DataTable::format(const SondeFullData& data, const LandingPredictor::Prediction& landing, const char *landingSerial)
+{
+	struct tm tm;
+	Row *row;
+
+	if (data.rxMonotonic) {
+		m_derived.update(&data);
+	} else {
+		m_derived.reset();
+	}
+
+	m_count = 0;
+	addRow("Serial no.", 0, "%s", data.serial);
+	addRow("Frame no.", 0, "%d", data.seq);
+#ifdef _WIN32
+	gmtime_s(&tm, &data.time);
+#else
+	gmtime_r(&data.time, &tm);
+#endif
+	addRow("Onboard time", 0, NULL);
+	if (!strftime(m_rows[m_count-1].value, sizeof(m_rows[0].value), "%a %b %d %Y %H:%M:%S", &tm)) {
+		m_rows[m_count-1].value[0] = '\0';
+	}
+	if (data.captureMonotonic) {
+		addRow("Latency", 0, "%.1fms", (data.rxMonotonic - data.captureMonotonic) * 1e-3);
+	} else {
+		addRow("Latency", 0, "-");
+	}
+	addRow(" ", 0, NULL);
+	addRow("Latitude", 0, "%8.5f%c", fabs(data.lat), (data.lat >= 0 ? 'N' : 'S'));
+	addRow("Longitude", 0, "%8.5f%c", fabs(data.lon), (data.lon >= 0 ? 'E' : 'W'));
+	addRow("Altitude", 0, "%.1fm", data.alt);
+	addRow("Speed", 0, "%.1fm/s", data.spd);
+	addRow("Heading", 0, "%.0f°", data.hdg);
+	addRow("Climb", 0, "%.1fm/s", data.climb);
+	addRow(" ", 0, NULL);
+	addRow("Temperature", ROW_PTU, "%.1f°C", data.temp);
+	addRow("Humidity", ROW_PTU, "%.1f%%", data.rh);
+	addRow("Dew point", ROW_PTU, "%.1f°C", m_derived.dewPoint());
+	row = addRow("Pressure", ROW_PTU, "%.1fhPa", m_derived.pressure());
+	if (m_derived.pressureEstimated()) row->tooltip = "Not measured, estimated from the altitude.";
+	addRow(" ", 0, NULL);
+	addRow("Geopot. height", 0, "%.1fm", m_derived.geopotential());
+	if (std::isnan(m_derived.windSpeed())) {
+		addRow("Wind", 0, "-");
+	} else {
+		addRow("Wind", 0, "%.1fm/s from %.0f°", m_derived.windSpeed(), m_derived.windDirection());
+	}
+	if (std::isnan(m_derived.lapseRate())) {
+		addRow("Lapse rate", 0, "-");
+	} else {
+		addRow("Lapse rate", 0, "%.1f°C/km", m_derived.lapseRate());
+	}
+	addRow("Aux. data", 0, "%s", data.auxData);
+
+	/* Landing prediction, only once it refers to the sonde being displayed */
+	addRow(" ", 0, NULL);
+	if (landing.valid && !strncmp(landingSerial, data.serial, SONDE_SERIAL_LEN)) {
+		addRow("Landing", 0, "%8.5f%c %8.5f%c", fabsf(landing.lat), (landing.lat >= 0 ? 'N' : 'S'),
+		           fabsf(landing.lon), (landing.lon >= 0 ? 'E' : 'W'));
+		if (landing.phase == LandingPredictor::PHASE_LANDED) {
+			addRow("Landing time", 0, "landed");
+		} else {
+			/* The prediction can lag behind the frames being displayed */
+			const long eta = std::max<long>(0, landing.time - data.time);
+			addRow("Landing time", 0, "in %ld:%02ld", eta / 60, eta % 60);
+		}
+		row = addRow("Burst", 0, "%.0fm", landing.burstAlt);
+		if (landing.phase == LandingPredictor::PHASE_ASCENT) row->tooltip = "Assumed, until the burst is detected.";
+	} else {
+		addRow("Landing", 0, "-");
+	}
+}
+
+/* Private methods {{{ */
+DataTable::Row*
+DataTable::addRow(const char *label, int flags, const char *fmt, ...)
+{
+	Row *row;
+	va_list ap;
+
+	/* Rows past the end overwrite the last one */
+	row = &m_rows[std::min(m_count++, (int)LEN(m_rows) - 1)];
+	m_count = std::min(m_count, (int)LEN(m_rows));
+	row->label = label;
+	row->flags = flags;
+	row->tooltip = NULL;
+	row->value[0] = '\0';
+
+	if (!fmt) return row;
+	va_start(ap, fmt);
+	vsnprintf(row->value, sizeof(row->value), fmt, ap);
+	va_end(ap);
+	return row;
+}
+/* }}} */
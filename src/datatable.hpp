@@ -0,0 +1,43 @@
+#pragma once
+
+#include "decode/common.hpp"
+#include "derived.hpp"
+#include "predictor.hpp"
+
+/**
+ * Sonde data table shown in the menu, formatted to text once per frame (or
+ * landing prediction), so that redraws only have to copy it to the screen.
+ * Derived quantities are only computed here, for what is displayed.
+ */
+class DataTable {
+public:
+	enum {
+		ROW_PTU = 1 << 0,           /* Greyed out until calibrated */
+	};
+	struct Row {
+		const char *label;
+		char value[64];             /* Empty if not available */
+		int flags;
+		const char *tooltip;        /* NULL if none */
+	};
+
+	/**
+	 * Format the table for a new frame
+	 *
+	 * @param data frame to display
+	 * @param landing latest landing prediction
+	 * @param landingSerial serial number the prediction refers to. It is
+	 *        only shown if it matches the frame's.
+	 */
+	void format(const SondeFullData& data, const LandingPredictor::Prediction& landing, const char *landingSerial);
+
+	int count() const { return m_count; }
+	const Row& row(int idx) const { return m_rows[idx]; }
+
+private:
+	Row *addRow(const char *label, int flags, const char *fmt, ...);
+
+	DerivedMeteo m_derived;
+	Row m_rows[32];
+	int m_count = 0;
+};
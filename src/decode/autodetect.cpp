@@ -0,0 +1,262 @@
+#include <algorithm>
+#include "autodetect.hpp"
+
+#define LOCK_TIMEOUT_SEC 30
+#define LOCK_FIELDS (DATA_SERIAL | DATA_POS)
+
+namespace radiosonde {
+
+AutoDecoder::~AutoDecoder()
+{
+	if (!_block_init) return;
+	stop();
+	unregisterInput(m_in);
+	_block_init = false;
+}
+
+void
+AutoDecoder::init(dsp::stream<float> *in, int samplerate, DecoderBase **decoders, int count, int threads)
+{
+	m_in = in;
+	m_decoders.assign(decoders, decoders + count);
+	m_fields.assign(count, 0);
+	m_samplerate = samplerate;
+	m_lockTimeout = (long)samplerate * LOCK_TIMEOUT_SEC;
+
+	/* The submitting thread also runs lanes, so it doesn't count */
+	if (threads < 0) threads = std::min((int)std::thread::hardware_concurrency(), count) - 1;
+	m_poolSize = std::max(0, threads);
+
+	/* Decoders are only taken over (muted) once processing starts, so that
+	 * they can still be used on their own until then */
+	m_threaded = m_active = false;
+	m_locked = -1;
+
+	registerInput(m_in);
+	_block_init = true;
+}
+
+int
+AutoDecoder::run()
+{
+	const int64_t start = m_metrics ? PipelineMetrics::nowNs() : 0;
+	int count;
+
+	if ((count = m_in->read()) < 0) return -1;
+	if (m_metrics) m_metrics->addRead(count, PipelineMetrics::nowNs() - start);
+	stampRead(count);
+
+	process(m_in->readBuf, count);
+
+	m_in->flush();
+	return 0;
+}
+
+uint64_t
+AutoDecoder::process(const float *src, int count)
+{
+	uint64_t fields;
+
+	if (!m_active) search();
+
+	if (m_locked >= 0) {
+		const int64_t now = PipelineMetrics::nowNs();
+
+		/* Idle time is counted both in samples, for recordings decoded faster
+		 * than real time, and on the clock, since nothing comes in at all
+		 * while the squelch is closed */
+		if ((fields = m_decoders[m_locked]->process(src, count))) {
+			m_idleSamples = 0;
+			m_lastFieldsNs = now;
+		} else if ((m_idleSamples += count) > m_lockTimeout
+		           || now - m_lastFieldsNs > LOCK_TIMEOUT_SEC * 1000000000LL) {
+			unlock();
+		}
+		return fields;
+	}
+
+	m_buf = src;
+	m_count = count;
+	m_pool.parallelFor(m_decoders.size(), processLane, this);
+
+	for (size_t i=0; i<m_decoders.size(); i++) {
+		if (m_fields[i] & LOCK_FIELDS) {
+			lock(i);
+			return m_fields[i];
+		}
+	}
+	return 0;
+}
+
+void
+AutoDecoder::setInput(dsp::stream<float> *in)
+{
+	assert(_block_init);
+	std::lock_guard<std::recursive_mutex> lck(ctrlMtx);
+	tempStop();
+	unregisterInput(m_in);
+	m_in = in;
+	registerInput(m_in);
+	tempStart();
+}
+
+void
+AutoDecoder::setSamplerate(int samplerate)
+{
+	std::lock_guard<std::recursive_mutex> lck(ctrlMtx);
+	tempStop();
+	for (auto decoder : m_decoders) {
+		decoder->setSamplerate(samplerate);
+	}
+	m_samplerate = samplerate;
+	m_lockTimeout = (long)samplerate * LOCK_TIMEOUT_SEC;
+	tempStart();
+}
+
+void
+AutoDecoder::setMetrics(PipelineMetrics *metrics)
+{
+	/* Samples are counted here, parser results by each decoder */
+	m_metrics = metrics;
+	for (auto decoder : m_decoders) {
+		decoder->setMetrics(metrics);
+	}
+}
+
+void
+AutoDecoder::setStamp(int64_t capture, int64_t demod, int64_t read)
+{
+	/* The frames are completed, and stamped, by the decoders */
+	DecoderBase::setStamp(capture, demod, read);
+	for (auto decoder : m_decoders) {
+		decoder->setStamp(capture, demod, read);
+	}
+}
+
+void
+AutoDecoder::release()
+{
+	for (auto decoder : m_decoders) {
+		decoder->release();
+	}
+
+	/* Whatever it was locked on is gone along with the contexts */
+	m_active = false;
+	m_locked = -1;
+}
+
+void
+AutoDecoder::suspend()
+{
+	for (auto decoder : m_decoders) {
+		decoder->suspend();
+	}
+}
+
+void
+AutoDecoder::prepare()
+{
+	/* Only the decoder locked on needs one, if any */
+	if (m_locked >= 0) {
+		m_decoders[m_locked]->prepare();
+		return;
+	}
+	for (auto decoder : m_decoders) {
+		decoder->prepare();
+	}
+}
+
+int
+AutoDecoder::contexts() const
+{
+	int count = 0;
+	for (auto decoder : m_decoders) {
+		count += decoder->contexts();
+	}
+	return count;
+}
+
+size_t
+AutoDecoder::memoryUsage() const
+{
+	size_t total = 0;
+	for (auto decoder : m_decoders) {
+		total += decoder->memoryUsage();
+	}
+	return total;
+}
+
+void
+AutoDecoder::doStart()
+{
+	m_threaded = true;
+	search();
+	prepare();
+
+	dsp::block::doStart();
+}
+
+void
+AutoDecoder::doStop()
+{
+	dsp::block::doStop();
+
+	m_pool.stop();
+	m_threaded = m_active = false;
+	m_locked = -1;
+	for (auto decoder : m_decoders) {
+		decoder->setMuted(false);
+	}
+}
+
+/* Private methods {{{ */
+void
+AutoDecoder::processLane(int idx, void *ctx)
+{
+	AutoDecoder *_this = (AutoDecoder*)ctx;
+	_this->m_fields[idx] = _this->m_decoders[idx]->process(_this->m_buf, _this->m_count);
+}
+
+void
+AutoDecoder::search()
+{
+	for (auto decoder : m_decoders) {
+		decoder->clearData();
+		decoder->setMuted(true);
+	}
+	m_locked = -1;
+	m_active = true;
+	if (m_threaded) m_pool.start(m_poolSize);
+}
+
+void
+AutoDecoder::lock(int idx)
+{
+	/* Only one decoder is going to run from now on, no need for workers */
+	m_pool.stop();
+
+	/* The other parsers can go back to the pool until the next search,
+	 * which takes them back as they are unless someone else needed them.
+	 * Either way, nothing is freed or allocated here */
+	for (size_t i=0; i<m_decoders.size(); i++) {
+		if ((int)i == idx) continue;
+		m_decoders[i]->clearData();
+		m_decoders[i]->suspend();
+	}
+
+	m_idleSamples = 0;
+	m_lastFieldsNs = PipelineMetrics::nowNs();
+	m_locked = idx;
+
+	/* Report the fragments that triggered the lock */
+	m_decoders[idx]->setMuted(false);
+	m_decoders[idx]->emit();
+}
+
+void
+AutoDecoder::unlock()
+{
+	search();
+}
+/* }}} */
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <dsp/block.h>
+#include <vector>
+#include "decoder.hpp"
+#include "threadpool.hpp"
+
+namespace radiosonde {
+	/**
+	 * Feeds the same stream to several decoders in parallel, until one of them
+	 * parses a valid serial number or position. From then on only that decoder
+	 * is run, until it goes quiet for a while and the search starts over.
+	 * Can also be driven without a stream, through process().
+	 */
+	class AutoDecoder : public DecoderBase {
+		public:
+			AutoDecoder() {}
+			~AutoDecoder();
+
+			/**
+			 * Initialize the block
+			 *
+			 * @param in stream to read samples from
+			 * @param samplerate sample rate of the input stream
+			 * @param decoders decoders to try. They must have been initialized
+			 *        with the same sample rate, but must not be running.
+			 * @param count number of decoders
+			 * @param threads number of worker threads to use while searching,
+			 *        -1 to pick one based on the number of CPUs
+			 */
+			void init(dsp::stream<float> *in, int samplerate, DecoderBase **decoders, int count, int threads = -1);
+
+			/**
+			 * @return index of the decoder currently locked on, -1 if none
+			 */
+			int locked() const { return m_locked; }
+
+			int run() override;
+			uint64_t process(const float *src, int count) override;
+			void setInput(dsp::stream<float> *in) override;
+
+			/**
+			 * Change the sample rate of all the decoders. Must be called
+			 * while none of them is running.
+			 */
+			void setSamplerate(int samplerate) override;
+			void setMetrics(PipelineMetrics *metrics) override;
+			void setStamp(int64_t capture, int64_t demod, int64_t read) override;
+
+			/**
+			 * Release, suspend, prepare, count or measure the contexts of
+			 * all the decoders. While locked, only the locked decoder holds
+			 * one: the others are suspended until the next search.
+			 * Releasing also drops the lock, so the search starts over
+			 * afterwards.
+			 */
+			void release() override;
+			void suspend() override;
+			void prepare() override;
+			int contexts() const override;
+			size_t memoryUsage() const override;
+
+		protected:
+			void doStart() override;
+			void doStop() override;
+
+		private:
+			static void processLane(int idx, void *ctx);
+			void search();
+			void lock(int idx);
+			void unlock();
+
+			dsp::stream<float> *m_in;
+			std::vector<DecoderBase*> m_decoders;
+			std::vector<uint64_t> m_fields;
+			ThreadPool m_pool;
+			int m_poolSize;
+
+			std::atomic<int> m_locked{-1};
+			bool m_threaded, m_active;
+			long m_idleSamples, m_lockTimeout;
+			int64_t m_lastFieldsNs;                 /* Monotonic, see PipelineMetrics::nowNs() */
+
+			const float *m_buf;
+			int m_count;
+	};
+}
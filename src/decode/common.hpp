@@ -1,28 +1,42 @@
 #pragma once
-#include <string>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <type_traits>
 
+#define SONDE_SERIAL_LEN 32
+#define SONDE_AUX_LEN 64
+
+/**
+ * Merged sonde data. Fixed-layout and trivially copyable, so that it can be
+ * handed between threads and queued with plain copies, without ever touching
+ * the heap.
+ */
 class SondeFullData {
 public:
 	SondeFullData() { init(); }
 	void init() {
-		serial = "";
-		seq = time = burstkill = 0;
-		lat = lon = alt = 0;
-		spd = hdg = climb = 0;
-		temp = rh = dewpt = pressure = 0;
-		calibrated = false;
-		auxData = "";
+		memset(this, 0, sizeof(*this));
 	};
 
-	std::string serial;         /* Serial number */
+	char serial[SONDE_SERIAL_LEN];  /* Serial number, NUL-terminated */
 	int seq;                    /* Frame sequence number */
+	uint64_t fields;            /* DATA_* bits received since the sequence number last changed */
 	time_t time;                /* Onboard time */
 	int burstkill;              /* Time to shutdown, -1 if inactive */
 	float lat, lon, alt;        /* Latitude (degrees), longitude (degrees) altitude (meters) */
 	float spd, hdg, climb;      /* Speed (m/s), heading (degrees), climb (m/s) */
 	float temp, rh;             /* Temperature (degrees C), relative humidity (%) */
-	float dewpt, pressure;      /* Dew point (degrees C), pressure (hPa) */
+	float dewpt, pressure;      /* Dew point (degrees C), pressure (hPa, <= 0 if not measured).
+	                               Neither is derived by the decoders: see DerivedMeteo::fill() */
 	bool calibrated;            /* Whether all the calibration data has been received */
 	float calib_percent;        /* Calibration status (0-100) */
-	std::string auxData;        /* Auxiliary freeform data */
+	char auxData[SONDE_AUX_LEN];    /* Auxiliary freeform data, NUL-terminated */
+	int64_t rxTime;             /* Receive time (microseconds since the Unix epoch) */
+	int64_t rxMonotonic;        /* Receive time (microseconds, monotonic clock) */
+	int64_t captureMonotonic;   /* When the plugin got the samples that completed the frame, 0 if
+	                               unknown (same clock). rxMonotonic minus this is the latency */
+	int64_t demodMonotonic;     /* When the same samples came out of the demodulator */
+	int64_t readMonotonic;      /* When the decoder read them */
 };
+static_assert(std::is_trivially_copyable<SondeFullData>::value, "SondeFullData must be trivially copyable");
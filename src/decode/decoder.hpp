@@ -1,8 +1,14 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <dsp/block.h>
+#include <map>
 #include <mutex>
 #include "common.hpp"
+#include "parseralloc.hpp"
+#include "../metrics.hpp"
+#include "../streamclock.hpp"
 extern "C" {
 #include "sondedump/include/c50.h"
 #include "sondedump/include/dfm09.h"
@@ -15,12 +21,259 @@ extern "C" {
 
 #define LEN(x) (sizeof(x)/sizeof(*x))
 
-static float dewpt(float temp, float rh);
-static float altitude_to_pressure(float alt);
+static void format_ozone(char *dst, size_t len, float o3_mpa);
 
 namespace radiosonde {
+	/**
+	 * Type-independent part of a decoder. Holds the merged sonde data and the
+	 * callback used to report it, and allows blocks that multiplex several
+	 * decoders onto a single stream to feed samples to them directly.
+	 */
+	class DecoderBase : public dsp::block {
+		public:
+			/**
+			 * Decode a buffer of samples, merging every parsed fragment into
+			 * the internal sonde data and invoking the callback unless muted.
+			 *
+			 * @param src samples to decode
+			 * @param count number of samples in src
+			 * @return bitmask of all the fields parsed from the buffer
+			 */
+			virtual uint64_t process(const float *src, int count) = 0;
+
+			/**
+			 * Change the stream the block reads from when started
+			 */
+			virtual void setInput(dsp::stream<float> *in) = 0;
+
+			/**
+			 * Switch the decoder to a different input sample rate. The
+			 * current context goes back to the pool, and one for the new
+			 * rate is taken out on the next call to process(). Merged data
+			 * is kept.
+			 *
+			 * @param samplerate new sample rate, in Hz
+			 */
+			virtual void setSamplerate(int samplerate) = 0;
+
+			/**
+			 * @return sample rate the decoder is currently set up for
+			 */
+			int samplerate() const { return m_samplerate; }
+
+			/**
+			 * Suppress or re-enable the data callback. Fragments are still
+			 * merged while muted, so that emit() can report them later on.
+			 */
+			void setMuted(bool muted) { m_muted = muted; }
+
+			/**
+			 * Invoke the data callback with the current merged sonde data
+			 */
+			void emit() {
+				m_data.rxTime = std::chrono::duration_cast<std::chrono::microseconds>(
+						std::chrono::system_clock::now().time_since_epoch()).count();
+				m_data.rxMonotonic = std::chrono::duration_cast<std::chrono::microseconds>(
+						std::chrono::steady_clock::now().time_since_epoch()).count();
+				if (m_metrics && m_data.captureMonotonic) m_metrics->addLatency(&m_data);
+				m_callback(&m_data, m_ctx);
+			}
+
+			/**
+			 * Forget all the data merged so far
+			 */
+			void clearData() { m_data.init(); }
+
+			/**
+			 * Take the timestamps of every buffer read from the stream from
+			 * the given clock, or stop if NULL
+			 */
+			virtual void setClock(StreamClock *clock) { m_clock = clock; }
+
+			/**
+			 * Set the timestamps of the samples about to be processed, for
+			 * callers that feed process() directly. Frames completed by them
+			 * carry these timestamps.
+			 *
+			 * @param capture when the samples entered the plugin (microseconds,
+			 *        monotonic clock)
+			 * @param demod when they were demodulated
+			 * @param read when they were handed to the decoder
+			 */
+			virtual void setStamp(int64_t capture, int64_t demod, int64_t read) {
+				m_data.captureMonotonic = capture;
+				m_data.demodMonotonic = demod;
+				m_data.readMonotonic = read;
+			}
+
+			/**
+			 * Report sample counts, parser results and timings to the given
+			 * metrics, or stop reporting if NULL
+			 */
+			virtual void setMetrics(PipelineMetrics *metrics) { m_metrics = metrics; }
+
+			/**
+			 * Hand the parser context(s) back to the process-wide pool.
+			 * process() takes one out again when needed. Must not be called
+			 * while the block is running.
+			 */
+			virtual void release() = 0;
+
+			/**
+			 * Like release(), but the decoder gets its own context(s) back,
+			 * parser state included, unless someone else needed them in the
+			 * meantime. For decoders that pause on the same signal.
+			 */
+			virtual void suspend() = 0;
+
+			/**
+			 * Take the parser context(s) out of the pool now, rather than on
+			 * the first call to process(). Getting one may mean initializing
+			 * it, which is best kept off the sample path.
+			 */
+			virtual void prepare() = 0;
+
+			/**
+			 * @return number of parser contexts currently held
+			 */
+			virtual int contexts() const = 0;
+
+			/**
+			 * @return memory allocated by the parsers for the contexts
+			 *         currently held, in bytes
+			 */
+			virtual size_t memoryUsage() const = 0;
+
+		protected:
+			void (*m_callback)(const SondeFullData *data, void *ctx);
+			void *m_ctx;
+			int m_samplerate;
+			bool m_muted = false;
+			PipelineMetrics *m_metrics = NULL;
+			StreamClock *m_clock = NULL;
+			SondeFullData m_data;
+
+			/* Stamp the buffer just read from the stream, if there is a clock */
+			void stampRead(int count) {
+				StreamClock::Stamp stamp;
+
+				if (!m_clock) return;
+				if (m_clock->take(count, &stamp)) {
+					setStamp(stamp.capture, stamp.ready, PipelineMetrics::nowNs() / 1000);
+				} else {
+					setStamp(0, 0, 0);
+				}
+			}
+	};
+
+	/**
+	 * Process-wide pool of idle parser contexts of a given type, keyed by
+	 * sample rate, so that instances and lanes that come and go reuse the
+	 * same few contexts instead of reallocating them every time. Contexts go
+	 * back to the pool as they are, which is cheap enough for the DSP thread.
+	 * The parsers have no reset, so a context is initialized again when it
+	 * is taken out by anyone but the decoder that suspended it: no parser
+	 * state leaks from one user to the next.
+	 */
+	template<typename T, T* (*decoder_init)(int), void (*decoder_deinit)(T*)>
+	class DecoderPool {
+		public:
+			~DecoderPool() {
+				for (auto& entry : m_idle) decoder_deinit(entry.second.decoder);
+			}
+
+			static DecoderPool& instance() {
+				static DecoderPool pool;
+				return pool;
+			}
+
+			/**
+			 * Take an idle context for the given sample rate out of the pool,
+			 * allocating a new one if there is none. The one the caller
+			 * suspended comes back untouched; any other is initialized again.
+			 * Contexts suspended by others are only taken as a last resort.
+			 *
+			 * @param samplerate sample rate the context must be set up for
+			 * @param owner caller, as passed to release()
+			 * @param size filled with the memory allocated for the context
+			 * @return parser context
+			 */
+			T* acquire(int samplerate, const void *owner, size_t *size) {
+				T *decoder = NULL;
+				size_t before;
+
+				{
+					std::lock_guard<std::mutex> lck(m_mtx);
+					auto range = m_idle.equal_range(samplerate);
+					auto pick = range.second;
+
+					for (auto it = range.first; it != range.second; it++) {
+						if (it->second.owner == owner) {
+							decoder = it->second.decoder;
+							*size = m_sizes[samplerate];
+							m_idle.erase(it);
+							return decoder;
+						}
+						if (pick == range.second || (pick->second.owner && !it->second.owner)) pick = it;
+					}
+					if (pick != range.second) {
+						decoder = pick->second.decoder;
+						m_idle.erase(pick);
+					}
+				}
+
+				/* Outside of the lock, this is where the time goes */
+				if (decoder) decoder_deinit(decoder);
+				before = parserBytesAllocated();
+				decoder = decoder_init(samplerate);
+				*size = parserBytesAllocated() - before;
+
+				std::lock_guard<std::mutex> lck(m_mtx);
+				m_sizes[samplerate] = *size;
+				return decoder;
+			}
+
+			/**
+			 * Return a context to the pool, parser state and all
+			 *
+			 * @param decoder context to return
+			 * @param samplerate sample rate it was set up for
+			 * @param owner caller that may want this very context back,
+			 *        NULL if its state is no use to anyone
+			 */
+			void release(T *decoder, int samplerate, const void *owner) {
+				std::lock_guard<std::mutex> lck(m_mtx);
+				m_idle.emplace(samplerate, Idle{decoder, owner});
+			}
+
+			/**
+			 * Forget that a caller suspended any of the idle contexts, so
+			 * that they get initialized again before being used
+			 */
+			void disown(const void *owner) {
+				std::lock_guard<std::mutex> lck(m_mtx);
+				for (auto& entry : m_idle) {
+					if (entry.second.owner == owner) entry.second.owner = NULL;
+				}
+			}
+
+		private:
+			struct Idle {
+				T *decoder;
+				const void *owner;
+			};
+
+			DecoderPool() {}
+
+			std::mutex m_mtx;
+			std::multimap<int, Idle> m_idle;
+			std::map<int, size_t> m_sizes;  /* Last measured, per sample rate */
+	};
+
 	template<typename T, T* (*decoder_init)(int), void (*decoder_deinit)(T*), ParserStatus (*decoder_get)(T*, SondeData*, const float*, size_t)>
-	class Decoder : public dsp::block {
+	class Decoder : public DecoderBase {
+		typedef DecoderPool<T, decoder_init, decoder_deinit> Pool;
+
 		public:
 			Decoder() {}
 			~Decoder() {
@@ -29,14 +282,22 @@ namespace radiosonde {
 				dsp::block::unregisterInput(m_in);
 				dsp::block::_block_init = false;
 
-				decoder_deinit(m_decoder);
+				release();
 			}
 
-			void init(dsp::stream<float> *in, int samplerate, void (*callback)(SondeFullData *data, void *ctx), void *ctx) {
+			/**
+			 * Initialize the block. The parser context is only taken from
+			 * the pool when the block starts, or the first time samples are
+			 * processed.
+			 */
+			void init(dsp::stream<float> *in, int samplerate, void (*callback)(const SondeFullData *data, void *ctx), void *ctx) {
 				m_in = in;
 				m_ctx = ctx;
 				m_callback = callback;
-				m_decoder = decoder_init(samplerate);
+				m_samplerate = samplerate;
+				m_decoder = NULL;
+				m_held = false;
+				m_size = 0;
 				m_count = m_offset = 0;
 
 				dsp::block::registerInput(m_in);
@@ -47,23 +308,90 @@ namespace radiosonde {
 				dsp::block::stop();
 				dsp::block::unregisterInput(m_in);
 
-				decoder_deinit(m_decoder);
+				release();
 			}
 
+			void setInput(dsp::stream<float> *in) override {
+				assert(dsp::block::_block_init);
+				std::lock_guard<std::recursive_mutex> lck(dsp::block::ctrlMtx);
+				dsp::block::tempStop();
+				dsp::block::unregisterInput(m_in);
+				m_in = in;
+				dsp::block::registerInput(m_in);
+				dsp::block::tempStart();
+			}
+
+			void setSamplerate(int samplerate) override {
+				assert(dsp::block::_block_init);
+				if (samplerate == m_samplerate) return;
+
+				std::lock_guard<std::recursive_mutex> lck(dsp::block::ctrlMtx);
+				dsp::block::tempStop();
+				release();
+				m_samplerate = samplerate;
+				dsp::block::tempStart();
+			}
+
+			void release() override {
+				/* A suspended context is no use to anyone either now */
+				if (!m_decoder) Pool::instance().disown(this);
+				giveBack(NULL);
+			}
+			void suspend() override { giveBack(this); }
+
+			void prepare() override {
+				size_t size;
+
+				if (m_decoder) return;
+				m_decoder = Pool::instance().acquire(m_samplerate, this, &size);
+				m_size = size;
+				m_held = true;
+			}
+
+			int contexts() const override { return m_held.load(std::memory_order_relaxed); }
+			size_t memoryUsage() const override { return m_held.load(std::memory_order_relaxed) ? m_size.load(std::memory_order_relaxed) : 0; }
+
 			int run() {
-				SondeData fragment;
+				const int64_t start = m_metrics ? PipelineMetrics::nowNs() : 0;
 				int count;
 
 				assert(dsp::block::_block_init);
 
 				if ((count = m_in->read()) < 0) return -1;
+				if (m_metrics) m_metrics->addRead(count, PipelineMetrics::nowNs() - start);
+				stampRead(count);
+
+				process(m_in->readBuf, count);
+
+				m_in->flush();
+				return 0;
+			}
 
-				while (decoder_get(m_decoder, &fragment, m_in->readBuf, count) != PROCEED) {
-					std::ostringstream auxStream;
+			uint64_t process(const float *src, int count) override {
+				SondeData fragment;
+				ParserStatus status;
+				uint64_t fields = 0;
+				int64_t start;
+
+				if (!m_decoder) prepare();
+
+				for (;;) {
+					start = m_metrics ? PipelineMetrics::nowNs() : 0;
+					status = decoder_get(m_decoder, &fragment, src, count);
+					if (m_metrics) {
+						m_metrics->addDecode(status, status != PROCEED ? fragment.fields : 0,
+						                     status != PROCEED && (fragment.fields & DATA_SEQ) && fragment.seq != m_data.seq,
+						                     PipelineMetrics::nowNs() - start);
+					}
+					if (status == PROCEED) break;
+
+					fields |= fragment.fields;
 
 					if (fragment.fields & DATA_SEQ) {
+						if (fragment.seq != m_data.seq) m_data.fields = 0;
 						m_data.seq = fragment.seq;
 					}
+					m_data.fields |= fragment.fields;
 
 					if (fragment.fields & DATA_POS) {
 						m_data.lat = fragment.lat;
@@ -87,11 +415,10 @@ namespace radiosonde {
 						m_data.temp = fragment.temp;
 						m_data.rh = fragment.rh;
 						m_data.pressure = fragment.pressure;
-						m_data.dewpt = dewpt(m_data.temp, m_data.rh);
 					}
 
 					if (fragment.fields & DATA_SERIAL) {
-						m_data.serial = fragment.serial;
+						strncpy(m_data.serial, fragment.serial, sizeof(m_data.serial)-1);
 					}
 
 					if (fragment.fields & DATA_SHUTDOWN) {
@@ -100,75 +427,72 @@ namespace radiosonde {
 
 					/* Auxiliary data */
 					if (fragment.fields & DATA_OZONE) {
-						auxStream.precision(2);
-						auxStream << "O3=" << std::fixed << fragment.o3_mpa << "mPa";
-						m_data.auxData = auxStream.str();
-					}
-
-					if (m_data.pressure <= 0) {
-						m_data.pressure = altitude_to_pressure(m_data.alt);
+						format_ozone(m_data.auxData, sizeof(m_data.auxData), fragment.o3_mpa);
 					}
 
-					if (fragment.fields) {
-						m_callback(&m_data, m_ctx);
+					if (fragment.fields && !m_muted) {
+						emit();
 					}
 				}
 
-				m_in->flush();
-				return 0;
+				return fields;
+			}
+
+		protected:
+			void doStart() override {
+				prepare();
+				dsp::block::doStart();
 			}
 
 		private:
+			void giveBack(const void *owner) {
+				if (!m_decoder) return;
+				Pool::instance().release(m_decoder, m_samplerate, owner);
+				m_decoder = NULL;
+				m_held = false;
+			}
+
 			dsp::stream<float> *m_in;
-			void (*m_callback)(SondeFullData *data, void *ctx);
-			void *m_ctx;
 			T *m_decoder;
+			std::atomic<bool> m_held;       /* Read by the UI thread */
+			std::atomic<size_t> m_size;
 			int m_count, m_offset;
-			SondeFullData m_data;
 
 	};
 }
 
-static float
-dewpt(float temp, float rh)
-{
-	const float tmp = (logf(rh / 100.0f) + (17.27f * temp / (237.3f + temp))) / 17.27f;
-	return 237.3f * tmp  / (1 - tmp);
-}
-static float
-altitude_to_pressure(float alt)
+/**
+ * Format an ozone partial pressure as "O3=x.xxmPa". Hand-rolled to keep the
+ * per-fragment path free of allocations and locale lookups.
+ */
+static void
+format_ozone(char *dst, size_t len, float o3_mpa)
 {
-	const float g0 = 9.80665;
-	const float M = 0.0289644;
-	const float R_star = 8.3144598;
-
-	const float hbs[] = {0.0,      11000.0, 20000.0, 32000.0, 47000.0, 51000.0, 77000.0};
-	const float Lbs[] = {-0.0065,  0.0,     0.001,   0.0028,  0.0,     -0.0028, -0.002};
-	const float Pbs[] = {101325.0, 22632.1, 5474.89, 868.02,  110.91,  66.94,   3.96};
-	const float Tbs[] = {288.15,   216.65,  216.65,  228.65,  270.65,  270.65,  214.65};
-
-	float Lb, Pb, Tb, hb;
-	int b;
-
-	for (b=0; b<(int)LEN(Lbs)-1; b++) {
-		if (alt < hbs[b+1]) {
-			Lb = Lbs[b];
-			Pb = Pbs[b];
-			Tb = Tbs[b];
-			hb = hbs[b];
-			break;
-		}
-	}
-
-	if (b == (int)LEN(Lbs) - 1) {
-		Lb = Lbs[b];
-		Pb = Pbs[b];
-		Tb = Tbs[b];
-		hb = hbs[b];
-	}
-
-	if (Lb != 0) {
-		return 1e-2 * Pb * powf((Tb + Lb * (alt - hb)) / Tb, - (g0 * M) / (R_star * Lb));
-	}
-	return 1e-2 * Pb * expf(-g0 * M * (alt - hb) / (R_star * Tb));
+	char tmp[32];
+	unsigned long hundredths;
+	int i = sizeof(tmp);
+	bool negative = o3_mpa < 0;
+
+	if (!(fabsf(o3_mpa) < 1e9f)) o3_mpa = 0;    /* Also catches NaN */
+	hundredths = (unsigned long)(fabsf(o3_mpa) * 100.0f + 0.5f);
+
+	/* Build the string backwards, starting from the unit */
+	tmp[--i] = '\0';
+	tmp[--i] = 'a';
+	tmp[--i] = 'P';
+	tmp[--i] = 'm';
+	tmp[--i] = '0' + hundredths % 10; hundredths /= 10;
+	tmp[--i] = '0' + hundredths % 10; hundredths /= 10;
+	tmp[--i] = '.';
+	do {
+		tmp[--i] = '0' + hundredths % 10;
+		hundredths /= 10;
+	} while (hundredths);
+	if (negative) tmp[--i] = '-';
+	tmp[--i] = '=';
+	tmp[--i] = '3';
+	tmp[--i] = 'O';
+
+	strncpy(dst, tmp + i, len - 1);
+	dst[len - 1] = '\0';
 }
@@ -0,0 +1,37 @@
+/* Built into the sondedump library, whose sources see malloc() & co. renamed
+ * to the functions below. The real ones are needed here. */
+#undef malloc
+#undef calloc
+#undef realloc
+#include <stdlib.h>
+#include "parseralloc.hpp"
+
+static thread_local size_t allocated = 0;
+
+extern "C" void*
+radiosonde_malloc(size_t size)
+{
+	allocated += size;
+	return malloc(size);
+}
+
+extern "C" void*
+radiosonde_calloc(size_t count, size_t size)
+{
+	allocated += count * size;
+	return calloc(count, size);
+}
+
+extern "C" void*
+radiosonde_realloc(void *ptr, size_t size)
+{
+	/* The old size is unknown: count the whole new block */
+	allocated += size;
+	return realloc(ptr, size);
+}
+
+size_t
+radiosonde::parserBytesAllocated()
+{
+	return allocated;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stddef.h>
+
+namespace radiosonde {
+	/**
+	 * Bytes allocated by the sondedump parsers on the calling thread so far.
+	 * sondedump is built with its allocator redirected here (see
+	 * CMakeLists.txt), so the difference around a call only counts what that
+	 * call allocated, whatever the other threads are doing.
+	 */
+	size_t parserBytesAllocated();
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <array>
+#include <tuple>
+#include <type_traits>
+#include "decoder.hpp"
+
+/* Decoder families compiled in, set by the OPT_RADIOSONDE_* CMake options */
+#ifndef RADIOSONDE_WITH_RS41
+#define RADIOSONDE_WITH_RS41 1
+#endif
+#ifndef RADIOSONDE_WITH_DFM09
+#define RADIOSONDE_WITH_DFM09 1
+#endif
+#ifndef RADIOSONDE_WITH_IMS100
+#define RADIOSONDE_WITH_IMS100 1
+#endif
+#ifndef RADIOSONDE_WITH_M10
+#define RADIOSONDE_WITH_M10 1
+#endif
+#ifndef RADIOSONDE_WITH_IMET4
+#define RADIOSONDE_WITH_IMET4 1
+#endif
+#ifndef RADIOSONDE_WITH_C50
+#define RADIOSONDE_WITH_C50 1
+#endif
+#ifndef RADIOSONDE_WITH_MRZN1
+#define RADIOSONDE_WITH_MRZN1 1
+#endif
+
+/* Sample rate every decoder runs at, the only one they have been checked at
+ * on real recordings */
+#define DECODER_SAMPLE_RATE 48000
+
+namespace radiosonde {
+	/*
+	 * One spec per decoder family: display name, FM bandwidth (Hz), and
+	 * decoder type. Families that are not enabled are never instantiated, so
+	 * the sondedump code for them is not linked in.
+	 */
+	struct RS41Spec {
+		static constexpr const char *name = "RS41";
+		static constexpr float bandwidth = 1e4;
+		static constexpr bool enabled = RADIOSONDE_WITH_RS41;
+		typedef Decoder<RS41Decoder, rs41_decoder_init, rs41_decoder_deinit, rs41_decode> decoder_t;
+	};
+	struct DFM09Spec {
+		static constexpr const char *name = "DFM06/09";
+		static constexpr float bandwidth = 1.5e4;
+		static constexpr bool enabled = RADIOSONDE_WITH_DFM09;
+		typedef Decoder<DFM09Decoder, dfm09_decoder_init, dfm09_decoder_deinit, dfm09_decode> decoder_t;
+	};
+	struct IMS100Spec {
+		static constexpr const char *name = "iMS100/RS-11G";
+		static constexpr float bandwidth = 2e4;
+		static constexpr bool enabled = RADIOSONDE_WITH_IMS100;
+		typedef Decoder<IMS100Decoder, ims100_decoder_init, ims100_decoder_deinit, ims100_decode> decoder_t;
+	};
+	struct M10Spec {
+		static constexpr const char *name = "M10/M20";
+		static constexpr float bandwidth = 5e4;
+		static constexpr bool enabled = RADIOSONDE_WITH_M10;
+		typedef Decoder<M10Decoder, m10_decoder_init, m10_decoder_deinit, m10_decode> decoder_t;
+	};
+	struct IMET4Spec {
+		static constexpr const char *name = "iMet-4";
+		static constexpr float bandwidth = 2e4;
+		static constexpr bool enabled = RADIOSONDE_WITH_IMET4;
+		typedef Decoder<IMET4Decoder, imet4_decoder_init, imet4_decoder_deinit, imet4_decode> decoder_t;
+	};
+	struct C50Spec {
+		static constexpr const char *name = "SRS-C50";
+		static constexpr float bandwidth = 2e4;
+		static constexpr bool enabled = RADIOSONDE_WITH_C50;
+		typedef Decoder<C50Decoder, c50_decoder_init, c50_decoder_deinit, c50_decode> decoder_t;
+	};
+	struct MRZN1Spec {
+		static constexpr const char *name = "MRZ-N1";
+		static constexpr float bandwidth = 2e4;
+		static constexpr bool enabled = RADIOSONDE_WITH_MRZN1;
+		typedef Decoder<MRZN1Decoder, mrzn1_decoder_init, mrzn1_decoder_deinit, mrzn1_decode> decoder_t;
+	};
+
+	/* Tuple of the enabled specs, in the given order */
+	template<typename... Specs>
+	using enabled_specs_t = decltype(std::tuple_cat(
+			std::declval<typename std::conditional<Specs::enabled, std::tuple<Specs>, std::tuple<>>::type>()...));
+
+	template<typename SpecList> class DecoderRegistry;
+
+	/**
+	 * Everything that depends on the set of decoders, generated from a single
+	 * list of specs: storage for one decoder of each type, the per-type
+	 * parameters, and factories for decoders owned elsewhere (e.g. lanes).
+	 * Indices are positions in the list, and match the type menu.
+	 */
+	template<typename... Specs>
+	class DecoderRegistry<std::tuple<Specs...>> {
+		public:
+			typedef void (*callback_t)(const SondeFullData *data, void *ctx);
+			typedef DecoderBase* (*factory_t)(int samplerate, callback_t callback, void *ctx);
+
+		private:
+			/* Declared first, since the constant tables below use them */
+			template<typename D>
+			static DecoderBase* create(int samplerate, callback_t callback, void *ctx) {
+				D *decoder = new D();
+				decoder->init(NULL, samplerate, callback, ctx);
+				return decoder;
+			}
+
+			template<typename T, size_t N>
+			static constexpr T largest(const std::array<T, N>& values) {
+				T result = values[0];
+				for (size_t i=1; i<N; i++) result = values[i] > result ? values[i] : result;
+				return result;
+			}
+
+		public:
+			/* One decoder of each type */
+			typedef std::tuple<typename Specs::decoder_t...> Storage;
+
+			static constexpr int count = sizeof...(Specs);
+			static_assert(count > 0, "At least one decoder family must be enabled");
+
+			static constexpr std::array<const char*, count> names = {{Specs::name...}};
+			static constexpr std::array<float, count> bandwidths = {{Specs::bandwidth...}};
+
+			/* Heap-allocate a decoder of each type, initialized for process() only */
+			static constexpr std::array<factory_t, count> factories = {{create<typename Specs::decoder_t>...}};
+
+			/* Parameters covering every type, for decoding them all at once */
+			static constexpr float maxBandwidth() { return largest(bandwidths); }
+
+			/**
+			 * Initialize every decoder in storage
+			 */
+			static void init(Storage& storage, dsp::stream<float> *in, int samplerate, callback_t callback, void *ctx) {
+				std::apply([&](auto&... decoder) {
+					(decoder.init(in, samplerate, callback, ctx), ...);
+				}, storage);
+			}
+
+			/**
+			 * @return pointers to the decoders in storage, in list order
+			 */
+			static std::array<DecoderBase*, count> pointers(Storage& storage) {
+				return std::apply([](auto&... decoder) {
+					return std::array<DecoderBase*, count>{{&decoder...}};
+				}, storage);
+			}
+	};
+
+	/* Decoders compiled in, in the order of the type menu */
+	typedef DecoderRegistry<enabled_specs_t<
+		RS41Spec, DFM09Spec, IMS100Spec, M10Spec, IMET4Spec, C50Spec, MRZN1Spec
+	>> Registry;
+}
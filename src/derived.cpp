@@ -0,0 +1,315 @@
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+#include "derived.hpp"
+
+#define LEN(x) (sizeof(x)/sizeof(*x))
+
+#define MAGNUS_B 17.27f
+#define MAGNUS_C 237.3f
+#define LOG_TABLE_BITS 8
+#define PRESSURE_TABLE_STEP 100.0f  /* Meters */
+#define PRESSURE_TABLE_TOP 86000.0f /* Meters, top of the standard atmosphere layers */
+#define HISTORY_LEN 64
+#define WIND_WINDOW 10              /* Seconds of trajectory used for the wind estimate */
+#define WIND_MIN_INTERVAL 2         /* Seconds, shortest interval the wind is estimated over */
+#define LAPSE_MIN_DZ 100.0f         /* Meters, smallest height difference for the lapse rate */
+#define EARTH_RADIUS 6371008.8f     /* Meters, mean radius */
+#define DEG_TO_M (EARTH_RADIUS * (float)M_PI / 180.0f)
+
+static float altitude_to_pressure(float alt);
+
+/* Tables {{{ */
+namespace {
+	/* ln(1 + i/256), 0 <= i <= 256 */
+	struct LogTable {
+		float v[(1 << LOG_TABLE_BITS) + 1];
+
+		LogTable() {
+			for (size_t i=0; i<LEN(v); i++) v[i] = log1p((double)i / (1 << LOG_TABLE_BITS));
+		}
+	};
+
+	/* Standard pressure every PRESSURE_TABLE_STEP meters, from 0 to PRESSURE_TABLE_TOP */
+	struct PressureTable {
+		float v[(int)(PRESSURE_TABLE_TOP / PRESSURE_TABLE_STEP) + 1];
+
+		PressureTable() {
+			for (size_t i=0; i<LEN(v); i++) v[i] = altitude_to_pressure(i * PRESSURE_TABLE_STEP);
+		}
+	};
+
+	const LogTable&
+	logTable()
+	{
+		static const LogTable table;
+		return table;
+	}
+
+	const PressureTable&
+	pressureTable()
+	{
+		static const PressureTable table;
+		return table;
+	}
+}
+/* }}} */
+
+/* Approximations {{{ */
+/**
+ * Natural logarithm of a positive, finite number. Splits off the exponent, then
+ * interpolates ln(mantissa) from the table: the error is at most h^2/8 = 2e-6,
+ * with h = 1/256 the table step.
+ */
+static float
+fast_log(float x)
+{
+	const LogTable& table = logTable();
+	int exp;
+	float mant, pos, frac;
+	int idx;
+
+	mant = frexpf(x, &exp) * 2.0f - 1.0f;       /* x = (1 + mant) * 2^(exp-1) */
+	pos = mant * (1 << LOG_TABLE_BITS);
+	idx = (int)pos;
+	frac = pos - idx;
+
+	return (exp - 1) * (float)M_LN2 + table.v[idx] + frac * (table.v[idx+1] - table.v[idx]);
+}
+
+float
+meteo::dewPoint(float temp, float rh)
+{
+	float gamma;
+
+	if (!(rh > 0) || isinf(rh)) return NAN;
+
+	gamma = (fast_log(rh / 100.0f) + MAGNUS_B * temp / (MAGNUS_C + temp)) / MAGNUS_B;
+	return MAGNUS_C * gamma / (1 - gamma);
+}
+
+/**
+ * The relative error of linear interpolation is at most (h/H)^2/8, with H the
+ * scale height: H is above 6.3 km everywhere in the table, hence < 3.2e-5, plus
+ * float rounding.
+ */
+float
+meteo::standardPressure(float alt)
+{
+	const PressureTable& table = pressureTable();
+	float pos, frac;
+	int idx;
+
+	if (!(alt >= 0 && alt < PRESSURE_TABLE_TOP)) return altitude_to_pressure(alt);
+
+	pos = alt / PRESSURE_TABLE_STEP;
+	idx = (int)pos;
+	frac = pos - idx;
+	return table.v[idx] + frac * (table.v[idx+1] - table.v[idx]);
+}
+
+float
+meteo::geopotentialHeight(float alt, float lat)
+{
+	const float g0 = 9.80665f;
+	const float s = sinf(lat * (float)M_PI / 180.0f);
+	const float s2 = s * s;
+	const float g = 9.7803253359f * (1 + 0.00193185265241f * s2) / sqrtf(1 - 0.00669437999013f * s2);
+
+	return g / g0 * EARTH_RADIUS * alt / (EARTH_RADIUS + alt);
+}
+/* }}} */
+
+/* DerivedMeteo {{{ */
+DerivedMeteo::DerivedMeteo()
+{
+	m_history.resize(HISTORY_LEN);
+	reset();
+}
+
+void
+DerivedMeteo::reset()
+{
+	m_serial[0] = '\0';
+	m_head = m_count = 0;
+	m_temp = m_rh = m_pressure = m_alt = m_lat = NAN;
+	m_cached = 0;
+}
+
+void
+DerivedMeteo::update(const SondeFullData *data)
+{
+	Fix *latest;
+
+	if (data->serial[0] && strncmp(data->serial, m_serial, sizeof(m_serial))) {
+		if (m_serial[0]) reset();
+		strncpy(m_serial, data->serial, sizeof(m_serial)-1);
+		m_serial[sizeof(m_serial)-1] = '\0';
+	}
+
+	/* Partial updates of the same frame overwrite the latest fix */
+	if (!m_count || m_history[m_head].time != data->time) {
+		m_head = (m_head + 1) % m_history.size();
+		m_count = std::min(m_count + 1, m_history.size());
+	}
+	latest = &m_history[m_head];
+	latest->time = data->time;
+	latest->lat = data->lat;
+	latest->lon = data->lon;
+	latest->alt = data->alt;
+	latest->temp = data->temp;
+
+	m_temp = data->temp;
+	m_rh = data->rh;
+	m_pressure = data->pressure;
+	m_alt = data->alt;
+	m_lat = data->lat;
+	m_cached = 0;
+}
+
+void
+DerivedMeteo::fill(SondeFullData *data) const
+{
+	data->dewpt = dewPoint();
+	if (!(data->pressure > 0)) data->pressure = pressure();
+}
+
+float
+DerivedMeteo::dewPoint() const
+{
+	if (!(m_cached & CACHED_DEWPT)) {
+		m_dewpt = meteo::dewPoint(m_temp, m_rh);
+		m_cached |= CACHED_DEWPT;
+	}
+	return m_dewpt;
+}
+
+float
+DerivedMeteo::pressure() const
+{
+	if (m_pressure > 0) return m_pressure;
+
+	if (!(m_cached & CACHED_PRESSURE)) {
+		m_stdPressure = isnan(m_alt) ? NAN : meteo::standardPressure(m_alt);
+		m_cached |= CACHED_PRESSURE;
+	}
+	return m_stdPressure;
+}
+
+float
+DerivedMeteo::geopotential() const
+{
+	if (!(m_cached & CACHED_GEOPOTENTIAL)) {
+		m_geopotential = meteo::geopotentialHeight(m_alt, m_lat);
+		m_cached |= CACHED_GEOPOTENTIAL;
+	}
+	return m_geopotential;
+}
+
+float
+DerivedMeteo::windSpeed() const
+{
+	computeWind();
+	return m_windSpeed;
+}
+
+float
+DerivedMeteo::windDirection() const
+{
+	computeWind();
+	return m_windDir;
+}
+
+/**
+ * Walk back from the newest fix until the height difference is large enough
+ * for the sensor noise not to dominate the result
+ */
+float
+DerivedMeteo::lapseRate() const
+{
+	if (m_cached & CACHED_LAPSE) return m_lapseRate;
+	m_cached |= CACHED_LAPSE;
+	m_lapseRate = NAN;
+
+	if (!m_count) return m_lapseRate;
+	const Fix& newest = fix(0);
+
+	for (size_t age=1; age<m_count; age++) {
+		const Fix& old = fix(age);
+		const float dz = newest.alt - old.alt;
+
+		if (fabsf(dz) >= LAPSE_MIN_DZ) {
+			m_lapseRate = -(newest.temp - old.temp) / dz * 1000.0f;
+			break;
+		}
+	}
+	return m_lapseRate;
+}
+
+/**
+ * The sonde drifts with the wind, so the horizontal wind is its ground
+ * velocity over the last few seconds of the trajectory. Positions are projected
+ * onto a plane tangent at the midpoint, which is accurate to well below the GPS
+ * noise over such short distances.
+ */
+void
+DerivedMeteo::computeWind() const
+{
+	if (m_cached & CACHED_WIND) return;
+	m_cached |= CACHED_WIND;
+	m_windSpeed = m_windDir = NAN;
+
+	if (!m_count) return;
+	const Fix& newest = fix(0);
+	size_t age;
+
+	for (age=1; age<m_count && newest.time - fix(age).time <= WIND_WINDOW; age++);
+	if (--age < 1) return;
+
+	const Fix& old = fix(age);
+	const float dt = newest.time - old.time;
+	if (dt < WIND_MIN_INTERVAL) return;
+
+	const float vy = (newest.lat - old.lat) * DEG_TO_M / dt;
+	const float vx = (newest.lon - old.lon) * DEG_TO_M * cosf((newest.lat + old.lat) * (float)M_PI / 360.0f) / dt;
+
+	m_windSpeed = sqrtf(vx*vx + vy*vy);
+	m_windDir = atan2f(-vx, -vy) * 180.0f / (float)M_PI;
+	if (m_windDir < 0) m_windDir += 360.0f;
+}
+/* }}} */
+
+/**
+ * Exact 1976 US standard atmosphere, used to build the pressure table. The
+ * layer boundaries and base pressures are those of the standard, so that the
+ * pressure is continuous across layers.
+ */
+static float
+altitude_to_pressure(float alt)
+{
+	const float g0 = 9.80665;
+	const float M = 0.0289644;
+	const float R_star = 8.3144598;
+
+	const float hbs[] = {0.0,      11000.0,  20000.0,  32000.0,  47000.0,  51000.0,  71000.0};
+	const float Lbs[] = {-0.0065,  0.0,      0.001,    0.0028,   0.0,      -0.0028,  -0.002};
+	const float Pbs[] = {101325.0, 22632.06, 5474.889, 868.0187, 110.9063, 66.93887, 3.956420};
+	const float Tbs[] = {288.15,   216.65,   216.65,   228.65,   270.65,   270.65,   214.65};
+
+	float Lb, Pb, Tb, hb;
+	int b;
+
+	for (b=0; b<(int)LEN(Lbs)-1; b++) {
+		if (alt < hbs[b+1]) break;
+	}
+
+	Lb = Lbs[b];
+	Pb = Pbs[b];
+	Tb = Tbs[b];
+	hb = hbs[b];
+
+	if (Lb != 0) {
+		return 1e-2 * Pb * powf((Tb + Lb * (alt - hb)) / Tb, - (g0 * M) / (R_star * Lb));
+	}
+	return 1e-2 * Pb * expf(-g0 * M * (alt - hb) / (R_star * Tb));
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "decode/common.hpp"
+#include "serialtracker.hpp"
+
+/**
+ * Fast approximations of the meteorological formulas used on the decoded
+ * stream. Both are table-driven, with the tables built on first use.
+ */
+namespace meteo {
+	/**
+	 * Dew point, Magnus formula (b = 17.27, c = 237.3). The logarithm is
+	 * looked up in a 256-entry table over the mantissa, and linearly
+	 * interpolated: the error against logf() is below 1e-3 degrees C for any
+	 * relative humidity in (0, 100].
+	 *
+	 * @param temp temperature, degrees C
+	 * @param rh relative humidity, %
+	 * @return dew point, degrees C, NAN if rh is not positive
+	 */
+	float dewPoint(float temp, float rh);
+
+	/**
+	 * Pressure of the 1976 US standard atmosphere at the given altitude,
+	 * linearly interpolated from a table with 100 m steps between 0 and
+	 * 86 km. The relative error is below 5e-5; outside of the table the exact
+	 * formula is used.
+	 *
+	 * @param alt geometric altitude, meters
+	 * @return pressure, hPa
+	 */
+	float standardPressure(float alt);
+
+	/**
+	 * Geopotential height, using the normal gravity at the given latitude
+	 * (WGS84) and a spherical Earth.
+	 *
+	 * @param alt geometric altitude, meters
+	 * @param lat latitude, degrees
+	 * @return geopotential height, meters
+	 */
+	float geopotentialHeight(float alt, float lat);
+}
+
+/**
+ * Quantities derived from the decoded stream of a single sonde: dew point,
+ * pressure (when the sonde doesn't measure it), geopotential height, wind
+ * from the trajectory, and temperature lapse rate.
+ *
+ * update() only records the new frame in a short history, and costs the same
+ * no matter how many quantities are derived from it. Each quantity is computed
+ * the first time it is asked for after an update, and cached until the next
+ * one, so that consumers only pay for what they actually read.
+ */
+class DerivedMeteo {
+public:
+	DerivedMeteo();
+
+	/**
+	 * Forget the history, e.g. because the frames now come from a different
+	 * sonde. Also done automatically when the serial number changes.
+	 */
+	void reset();
+
+	/**
+	 * Record a new frame. Several frames with the same onboard time (e.g.
+	 * partial updates of the same frame) only take one slot in the history.
+	 *
+	 * @param data new frame
+	 */
+	void update(const SondeFullData *data);
+
+	/**
+	 * Fill in the dew point, and the pressure if the sonde didn't report it,
+	 * in a frame. Meant for consumers that read those fields directly.
+	 *
+	 * @param data frame to complete, usually the one last passed to update()
+	 */
+	void fill(SondeFullData *data) const;
+
+	/* Derived quantities, NAN if the data needed isn't available (yet) */
+	float dewPoint() const;         /* Degrees C */
+	float pressure() const;         /* hPa, measured or estimated from altitude */
+	bool pressureEstimated() const { return !(m_pressure > 0); }
+	float geopotential() const;     /* Meters */
+	float windSpeed() const;        /* m/s */
+	float windDirection() const;    /* Degrees, direction the wind blows from */
+	float lapseRate() const;        /* K/km, positive when cooling with height */
+
+private:
+	struct Fix {
+		time_t time;
+		float lat, lon, alt, temp;
+	};
+	enum {
+		CACHED_DEWPT = 1 << 0,
+		CACHED_PRESSURE = 1 << 1,
+		CACHED_GEOPOTENTIAL = 1 << 2,
+		CACHED_WIND = 1 << 3,
+		CACHED_LAPSE = 1 << 4,
+	};
+
+	void computeWind() const;
+	const Fix& fix(int age) const { return m_history[(m_head + m_history.size() - age) % m_history.size()]; }
+
+	char m_serial[SONDE_SERIAL_LEN];
+	std::vector<Fix> m_history;     /* Ring, newest at m_head */
+	size_t m_head, m_count;
+	float m_temp, m_rh, m_pressure, m_alt, m_lat;
+
+	/* Computed on demand */
+	mutable unsigned m_cached;
+	mutable float m_dewpt, m_stdPressure, m_geopotential, m_windSpeed, m_windDir, m_lapseRate;
+};
+
+/* One DerivedMeteo per sonde, for streams that interleave several of them */
+typedef SerialTracker<DerivedMeteo> DerivedTracker;
@@ -0,0 +1,51 @@
+#include <math.h>
+#include "fft.hpp"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+void
+FFT::init(int size, bool inverse)
+{
+	const double sign = inverse ? 1.0 : -1.0;
+	int bits, i, j;
+
+	m_size = size;
+	for (bits=0; (1 << bits) < size; bits++);
+
+	m_twiddles.resize(size / 2);
+	for (i=0; i<size/2; i++) {
+		m_twiddles[i] = std::polar(1.0f, (float)(sign * 2.0 * M_PI * i / size));
+	}
+
+	m_bitrev.resize(size);
+	for (i=0; i<size; i++) {
+		int rev = 0;
+		for (j=0; j<bits; j++) rev |= ((i >> j) & 1) << (bits - 1 - j);
+		m_bitrev[i] = rev;
+	}
+}
+
+void
+FFT::execute(std::complex<float> *data) const
+{
+	int len, half, step, i, j;
+
+	for (i=0; i<m_size; i++) {
+		if (i < m_bitrev[i]) std::swap(data[i], data[m_bitrev[i]]);
+	}
+
+	for (len=2; len<=m_size; len <<= 1) {
+		half = len / 2;
+		step = m_size / len;
+		for (i=0; i<m_size; i+=len) {
+			for (j=0; j<half; j++) {
+				const std::complex<float> u = data[i+j];
+				const std::complex<float> v = cmul(data[i+j+half], m_twiddles[j*step]);
+				data[i+j] = u + v;
+				data[i+j+half] = u - v;
+			}
+		}
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <complex>
+#include <vector>
+
+/**
+ * In-place iterative radix-2 FFT, with precomputed twiddles and bit-reversal
+ * table. Sizes must be powers of two.
+ */
+class FFT {
+public:
+	FFT() { m_size = 0; };
+
+	/**
+	 * @param size transform size, must be a power of two
+	 * @param inverse whether to compute the inverse transform (unscaled)
+	 */
+	void init(int size, bool inverse);
+
+	void execute(std::complex<float> *data) const;
+
+	int size() const { return m_size; }
+
+private:
+	int m_size;
+	std::vector<std::complex<float>> m_twiddles;
+	std::vector<int> m_bitrev;
+};
+
+/**
+ * Complex multiplication without the NaN/Inf recovery that the standard
+ * operator has to perform when -ffast-math is not in effect
+ */
+static inline std::complex<float>
+cmul(std::complex<float> a, std::complex<float> b)
+{
+	return std::complex<float>(a.real() * b.real() - a.imag() * b.imag(),
+	                           a.real() * b.imag() + a.imag() * b.real());
+}
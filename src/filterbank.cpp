@@ -0,0 +1,198 @@
+#include <algorithm>
+#include <math.h>
+#include "filterbank.hpp"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define MIN_CHAN_SIZE 16
+
+void
+FilterBank::init(double samplerate, int decimation, double bandwidth)
+{
+	const double cutoff = bandwidth / 2;
+	const double transition = bandwidth / 4;
+	std::vector<float> taps;
+	int minTaps, ntaps, i;
+	double sum;
+
+	m_samplerate = samplerate;
+	m_decimation = decimation;
+	m_channels.clear();
+
+	/* Blackman-windowed sinc: transition width ~5.5 * fs / ntaps. The FFT is
+	 * sized so that the filter spans a quarter of it, giving a 75% hop */
+	minTaps = (int)ceil(5.5 * samplerate / transition);
+	for (m_fftSize = 1; m_fftSize < 4 * minTaps || m_fftSize < MIN_CHAN_SIZE * decimation; m_fftSize <<= 1);
+	m_chanSize = m_fftSize / decimation;
+	m_overlap = m_fftSize / 4;
+	m_hop = m_fftSize - m_overlap;
+	ntaps = m_overlap + 1;
+
+	taps.resize(ntaps);
+	sum = 0;
+	for (i=0; i<ntaps; i++) {
+		const double t = i - (ntaps - 1) / 2.0;
+		const double x = 2 * cutoff / samplerate * t;
+		const double sinc = t == 0 ? 1.0 : sin(M_PI * x) / (M_PI * x);
+		const double window = 0.42 - 0.5 * cos(2 * M_PI * i / (ntaps - 1)) + 0.08 * cos(4 * M_PI * i / (ntaps - 1));
+		taps[i] = sinc * window;
+		sum += taps[i];
+	}
+
+	/* Frequency response of the filter, normalized for unity gain through
+	 * the forward and inverse transforms */
+	m_fwd.init(m_fftSize, false);
+	m_inv.init(m_chanSize, true);
+	m_spectrum.assign(m_fftSize, 0);
+	for (i=0; i<ntaps; i++) m_spectrum[i] = (float)(taps[i] / sum / m_fftSize);
+	m_fwd.execute(m_spectrum.data());
+
+	/* Only the bins that survive decimation are needed */
+	m_response.resize(m_chanSize);
+	for (i=0; i<m_chanSize; i++) {
+		const int bin = i < m_chanSize / 2 ? i : i - m_chanSize;
+		m_response[i] = m_spectrum[(bin + m_fftSize) % m_fftSize];
+	}
+
+	m_input.assign(m_fftSize, 0);
+	m_scratch.resize(m_chanSize);
+	m_fill = 0;
+	setPowerAveraging(m_powerEnabled);
+}
+
+int
+FilterBank::addChannel(double offset)
+{
+	Channel channel;
+
+	tune(&channel, offset);
+	channel.enabled = true;
+	m_channels.push_back(channel);
+	return m_channels.size() - 1;
+}
+
+void
+FilterBank::retuneChannel(int channel, double offset)
+{
+	tune(&m_channels[channel], offset);
+}
+
+void
+FilterBank::clearChannels()
+{
+	m_channels.clear();
+}
+
+void
+FilterBank::setPowerAveraging(bool enabled)
+{
+	m_powerEnabled = enabled;
+	m_power.assign(enabled ? m_fftSize : 0, 0.0f);
+	m_powerBlocks = 0;
+}
+
+int
+FilterBank::takePower(std::vector<float> *dst)
+{
+	const int blocks = m_powerBlocks;
+
+	dst->swap(m_power);
+	m_power.assign(m_fftSize, 0.0f);
+	m_powerBlocks = 0;
+	return blocks;
+}
+
+int
+FilterBank::process(const std::complex<float> *in, int count)
+{
+	const int maxOut = maxOutput(count);
+	int outCount = 0;
+	int chunk;
+
+	for (auto& channel : m_channels) {
+		if ((int)channel.out.size() < maxOut) channel.out.resize(maxOut);
+	}
+
+	while (count > 0) {
+		chunk = std::min(count, m_hop - m_fill);
+		std::copy(in, in + chunk, m_input.begin() + m_overlap + m_fill);
+		m_fill += chunk;
+		in += chunk;
+		count -= chunk;
+
+		if (m_fill == m_hop) {
+			processBlock(outCount);
+			outCount += m_hop / m_decimation;
+
+			/* Keep the tail around for the next block */
+			std::copy(m_input.end() - m_overlap, m_input.end(), m_input.begin());
+			m_fill = 0;
+		}
+	}
+
+	return outCount;
+}
+
+/* Private methods {{{ */
+void
+FilterBank::tune(Channel *channel, double offset)
+{
+	const double binWidth = m_samplerate / m_fftSize;
+	double residual;
+
+	channel->bin = (int)lround(offset / binWidth);
+	residual = offset - channel->bin * binWidth;
+
+	/* Selecting bins relative to `bin` mixes each block down with a phase
+	 * reference at the block start; correct that so that consecutive blocks
+	 * line up, then remove the offset from the bin center */
+	channel->blockRot = 1;
+	channel->blockRotStep = std::polar(1.0f, (float)(-2 * M_PI * fmod((double)channel->bin * m_hop / m_fftSize, 1.0)));
+	channel->fineRot = 1;
+	channel->fineRotStep = std::polar(1.0f, (float)(-2 * M_PI * residual * m_decimation / m_samplerate));
+
+	channel->bin = (channel->bin % m_fftSize + m_fftSize) % m_fftSize;
+}
+
+void
+FilterBank::processBlock(int outOffset)
+{
+	const int discard = m_overlap / m_decimation;
+	const int half = m_chanSize / 2;
+	int i;
+
+	std::copy(m_input.begin(), m_input.end(), m_spectrum.begin());
+	m_fwd.execute(m_spectrum.data());
+
+	if (m_powerEnabled) {
+		for (i=0; i<m_fftSize; i++) m_power[i] += std::norm(m_spectrum[i]);
+		m_powerBlocks++;
+	}
+
+	for (auto& channel : m_channels) {
+		if (!channel.enabled) continue;
+
+		/* Pick the bins around the channel center, and filter them */
+		for (i=0; i<m_chanSize; i++) {
+			const int offset = i < half ? i : i - m_chanSize;
+			const int bin = (channel.bin + offset + m_fftSize) % m_fftSize;
+			m_scratch[i] = cmul(m_spectrum[bin], m_response[i]);
+		}
+		m_inv.execute(m_scratch.data());
+
+		/* The first samples are corrupted by circular convolution */
+		for (i=discard; i<m_chanSize; i++) {
+			channel.out[outOffset + i - discard] = cmul(m_scratch[i], cmul(channel.blockRot, channel.fineRot));
+			channel.fineRot = cmul(channel.fineRot, channel.fineRotStep);
+		}
+
+		channel.blockRot = cmul(channel.blockRot, channel.blockRotStep);
+
+		/* Keep the rotators from drifting away from the unit circle */
+		channel.blockRot /= std::abs(channel.blockRot);
+		channel.fineRot /= std::abs(channel.fineRot);
+	}
+}
+/* }}} */
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <complex>
+#include <vector>
+#include "fft.hpp"
+
+/**
+ * Fast-convolution (overlap-save) filter bank. A single forward FFT of the
+ * wideband input is shared by every channel; each channel then only selects
+ * the bins around its own center frequency, applies the lowpass response and
+ * runs a small inverse FFT, which yields its output already decimated.
+ */
+class FilterBank {
+public:
+	FilterBank() {};
+
+	/**
+	 * Configure the filter bank. Removes all channels.
+	 *
+	 * @param samplerate input sample rate, in Hz
+	 * @param decimation decimation factor, must be a power of two
+	 * @param bandwidth bandwidth of each channel, in Hz
+	 */
+	void init(double samplerate, int decimation, double bandwidth);
+
+	/**
+	 * Add a channel to the filter bank.
+	 *
+	 * @param offset center frequency of the channel, relative to the center
+	 *        of the input signal, in Hz
+	 * @return index of the new channel
+	 */
+	int addChannel(double offset);
+	void clearChannels();
+	int channels() const { return m_channels.size(); }
+
+	/**
+	 * Move an existing channel to a new frequency, e.g. to reuse it for
+	 * another signal. Its output restarts from a clean phase reference.
+	 *
+	 * @param channel index of the channel
+	 * @param offset new center frequency, relative to the center of the input
+	 */
+	void retuneChannel(int channel, double offset);
+
+	/**
+	 * Skip the extraction of a channel (its output is left untouched) until
+	 * it is enabled again. Channels start enabled.
+	 */
+	void setChannelEnabled(int channel, bool enabled) { m_channels[channel].enabled = enabled; }
+
+	/**
+	 * Accumulate the power spectrum of the input, block after block, as a by-
+	 * product of the forward transform. Off by default.
+	 */
+	void setPowerAveraging(bool enabled);
+
+	/**
+	 * Take the power spectrum accumulated since the last call, and restart
+	 * accumulating from zero
+	 *
+	 * @param dst filled with the sum of |X[k]|^2 over the blocks, one entry
+	 *        per bin, in FFT order (DC first, negative frequencies last)
+	 * @return number of blocks accumulated
+	 */
+	int takePower(std::vector<float> *dst);
+	int powerBlocks() const { return m_powerBlocks; }
+	int fftSize() const { return m_fftSize; }
+	double binWidth() const { return m_samplerate / m_fftSize; }
+	int blockLength() const { return m_hop; }
+
+	/**
+	 * Feed samples to the filter bank, and compute the new output of every
+	 * channel. All channels produce the same number of output samples.
+	 *
+	 * @param in input samples
+	 * @param count number of input samples
+	 * @return number of new output samples per channel
+	 */
+	int process(const std::complex<float> *in, int count);
+
+	/**
+	 * @return output of a channel, as computed by the last call to process()
+	 */
+	const std::complex<float> *output(int channel) const { return m_channels[channel].out.data(); }
+
+	/**
+	 * @return maximum number of output samples a call to process() with the
+	 *         given number of input samples can produce
+	 */
+	int maxOutput(int count) const { return (count / m_hop + 1) * (m_hop / m_decimation); }
+
+	double outputSamplerate() const { return m_samplerate / m_decimation; }
+
+private:
+	struct Channel {
+		int bin;                            /* Bin the channel is centered on */
+		std::complex<float> blockRot;       /* Phase correction for the current block */
+		std::complex<float> blockRotStep;
+		std::complex<float> fineRot;        /* Residual offset from the bin center */
+		std::complex<float> fineRotStep;
+		std::vector<std::complex<float>> out;
+		bool enabled;
+	};
+
+	void tune(Channel *channel, double offset);
+	void processBlock(int outOffset);
+
+	double m_samplerate;
+	int m_decimation;
+	int m_fftSize, m_chanSize;          /* Forward and inverse transform sizes */
+	int m_overlap, m_hop;               /* Samples shared with the previous block, new samples per block */
+	int m_fill;                         /* New samples currently in the input buffer */
+
+	FFT m_fwd, m_inv;
+	std::vector<std::complex<float>> m_input, m_spectrum, m_scratch;
+	std::vector<std::complex<float>> m_response;    /* Lowpass response, inverse FFT order */
+	std::vector<Channel> m_channels;
+
+	bool m_powerEnabled = false;
+	std::vector<float> m_power;
+	int m_powerBlocks = 0;
+};
@@ -0,0 +1,319 @@
+#include <array>
+#include <stddef.h>
+#include <string.h>
+#include "flightlog.hpp"
+#include "utils.hpp"
+
+#define SEGMENT_SIZE (1 << 20)
+#define MAX_MOVED_ASIDE 100             /* Numbered names tried before giving up */
+#define HEADER_SIZE 16
+#define V1_RECORD_SIZE (sizeof(FlightLogRecord) - sizeof(int64_t))    /* No captureMonotonic */
+
+static uint32_t crc32(const void *data, size_t len);
+static bool record_valid(const void *rec, size_t size);
+
+/* FlightLogRecord {{{ */
+void
+FlightLogRecord::fromData(const SondeFullData *data)
+{
+	memset(this, 0, sizeof(*this));
+
+	magic = FLIGHTLOG_RECORD_MAGIC;
+	rxTime = data->rxTime;
+	rxMonotonic = data->rxMonotonic;
+	captureMonotonic = data->captureMonotonic;
+	time = data->time;
+	seq = data->seq;
+	burstkill = data->burstkill;
+	lat = data->lat;
+	lon = data->lon;
+	alt = data->alt;
+	spd = data->spd;
+	hdg = data->hdg;
+	climb = data->climb;
+	temp = data->temp;
+	rh = data->rh;
+	dewpt = data->dewpt;
+	pressure = data->pressure;
+	calibPercent = data->calib_percent;
+	calibrated = data->calibrated;
+	strncpy(serial, data->serial, sizeof(serial)-1);
+	strncpy(auxData, data->auxData, sizeof(auxData)-1);
+
+	crc = crc32((const uint8_t*)this + offsetof(FlightLogRecord, rxTime),
+	            sizeof(*this) - offsetof(FlightLogRecord, rxTime));
+}
+
+void
+FlightLogRecord::toData(SondeFullData *data) const
+{
+	data->rxTime = rxTime;
+	data->rxMonotonic = rxMonotonic;
+	data->captureMonotonic = captureMonotonic;
+	data->time = time;
+	data->seq = seq;
+	data->burstkill = burstkill;
+	data->lat = lat;
+	data->lon = lon;
+	data->alt = alt;
+	data->spd = spd;
+	data->hdg = hdg;
+	data->climb = climb;
+	data->temp = temp;
+	data->rh = rh;
+	data->dewpt = dewpt;
+	data->pressure = pressure;
+	data->calib_percent = calibPercent;
+	data->calibrated = calibrated;
+	memcpy(data->serial, serial, sizeof(data->serial));
+	memcpy(data->auxData, auxData, sizeof(data->auxData));
+	data->serial[sizeof(data->serial)-1] = '\0';
+	data->auxData[sizeof(data->auxData)-1] = '\0';
+}
+/* }}} */
+/* FlightLogWriter {{{ */
+bool
+FlightLogWriter::init(const char *fname)
+{
+	uint8_t header[HEADER_SIZE];
+	FlightLogRecord rec;
+	const uint32_t version = FLIGHTLOG_VERSION;
+	const uint32_t recordSize = sizeof(FlightLogRecord);
+	static const FlightLogRecord zero = {};
+	unsigned long offset;
+
+	if (m_fd) deinit();
+	m_movedAside.clear();
+
+	memset(header, 0, sizeof(header));
+	memcpy(header, FLIGHTLOG_MAGIC, 8);
+	memcpy(header + 8, &version, sizeof(version));
+	memcpy(header + 12, &recordSize, sizeof(recordSize));
+
+	/* Append to an existing log if it is compatible with this version. Any
+	 * other file is someone's data: keep it under another name */
+	if ((m_fd = fopen(fname, "r+b"))) {
+		uint8_t existing[HEADER_SIZE];
+
+		memset(existing, 0, sizeof(existing));
+		if (fread(existing, sizeof(existing), 1, m_fd) != 1 || memcmp(existing, header, sizeof(header))) {
+			fseek(m_fd, 0, SEEK_END);
+			const bool empty = ftell(m_fd) == 0;
+
+			fclose(m_fd);
+			m_fd = NULL;
+			if (!empty && !moveAside(fname, existing)) return false;
+		}
+	}
+
+	if (m_fd) {
+		/* Skip over all the records written so far, including corrupted
+		 * ones (readers skip those), up to the last one that isn't all
+		 * zeroes: a zeroed record may just be a hole left by a crash, with
+		 * more records after it */
+		m_offset = offset = HEADER_SIZE;
+		while (fread(&rec, sizeof(rec), 1, m_fd) == 1) {
+			offset += sizeof(rec);
+			if (memcmp(&rec, &zero, sizeof(rec))) m_offset = offset;
+		}
+		fseek(m_fd, 0, SEEK_END);
+		m_allocated = ftell(m_fd);
+	} else {
+		if (!(m_fd = fopen(fname, "w+b"))) return false;
+		fwrite(header, sizeof(header), 1, m_fd);
+		m_offset = m_allocated = HEADER_SIZE;
+	}
+
+	if (!preallocate()) {
+		deinit();
+		return false;
+	}
+	fseek(m_fd, m_offset, SEEK_SET);
+	return true;
+}
+
+void
+FlightLogWriter::deinit()
+{
+	if (!m_fd) return;
+	fclose(m_fd);
+	m_fd = NULL;
+}
+
+void
+FlightLogWriter::addPoint(const SondeFullData *data)
+{
+	FlightLogRecord rec;
+
+	if (!m_fd) return;
+
+	if (m_offset + sizeof(rec) > m_allocated) {
+		if (!preallocate()) return;
+		fseek(m_fd, m_offset, SEEK_SET);
+	}
+
+	rec.fromData(data);
+	if (fwrite(&rec, sizeof(rec), 1, m_fd) == 1) m_offset += sizeof(rec);
+}
+
+void
+FlightLogWriter::flush(bool sync)
+{
+	if (!m_fd) return;
+	fflush(m_fd);
+	if (sync) syncFile(m_fd);
+}
+
+/**
+ * Rename an incompatible file out of the way, to <fname>.v<version> if it is
+ * a log of another version, <fname>.old otherwise, numbered if that is taken
+ *
+ * @param fname path of the file
+ * @param header first bytes of the file, zero-padded if shorter
+ * @return whether the file was moved
+ */
+bool
+FlightLogWriter::moveAside(const char *fname, const uint8_t *header)
+{
+	std::string base = fname, dst;
+	uint32_t version;
+	FILE *fd;
+
+	if (!memcmp(header, FLIGHTLOG_MAGIC, 8)) {
+		memcpy(&version, header + 8, sizeof(version));
+		base += ".v" + std::to_string(version);
+	} else {
+		base += ".old";
+	}
+
+	for (int i=0; i<MAX_MOVED_ASIDE; i++) {
+		dst = i ? base + "." + std::to_string(i) : base;
+		if ((fd = fopen(dst.c_str(), "rb"))) {
+			fclose(fd);
+			continue;
+		}
+		if (rename(fname, dst.c_str())) return false;
+		m_movedAside = dst;
+		return true;
+	}
+	return false;
+}
+
+/**
+ * Make sure there is at least a full segment of zeroes past the current
+ * offset. Leaves the file position at the end of the file.
+ */
+bool
+FlightLogWriter::preallocate()
+{
+	static const uint8_t zeroes[4096] = {0};
+
+	if (m_allocated >= m_offset + SEGMENT_SIZE) return true;
+
+	fseek(m_fd, m_allocated, SEEK_SET);
+	while (m_allocated < m_offset + SEGMENT_SIZE) {
+		if (fwrite(zeroes, sizeof(zeroes), 1, m_fd) != 1) return false;
+		m_allocated += sizeof(zeroes);
+	}
+	fflush(m_fd);
+	return true;
+}
+/* }}} */
+/* FlightLogReader {{{ */
+bool
+FlightLogReader::init(const char *fname)
+{
+	char magic[8];
+	uint32_t version, recordSize;
+
+	if (m_fd) deinit();
+
+	m_fd = fopen(fname, "rb");
+	if (!m_fd) return false;
+
+	if (fread(magic, sizeof(magic), 1, m_fd) != 1
+	 || fread(&version, sizeof(version), 1, m_fd) != 1
+	 || fread(&recordSize, sizeof(recordSize), 1, m_fd) != 1
+	 || memcmp(magic, FLIGHTLOG_MAGIC, sizeof(magic))
+	 || !((version == FLIGHTLOG_VERSION && recordSize == sizeof(FlightLogRecord))
+	      || (version == 1 && recordSize == V1_RECORD_SIZE))) {
+		deinit();
+		return false;
+	}
+
+	m_version = version;
+	m_recordSize = recordSize;
+	m_corrupted = 0;
+	return true;
+}
+
+void
+FlightLogReader::deinit()
+{
+	if (!m_fd) return;
+	fclose(m_fd);
+	m_fd = NULL;
+}
+
+bool
+FlightLogReader::next(FlightLogRecord *rec)
+{
+	const size_t split = offsetof(FlightLogRecord, captureMonotonic);
+	static const uint8_t zero[sizeof(FlightLogRecord)] = {0};
+	alignas(FlightLogRecord) uint8_t buf[sizeof(FlightLogRecord)];
+
+	if (!m_fd) return false;
+
+	while (fread(buf, m_recordSize, 1, m_fd) == 1) {
+		if (record_valid(buf, m_recordSize)) {
+			if (m_version == FLIGHTLOG_VERSION) {
+				memcpy(rec, buf, sizeof(*rec));
+			} else {
+				/* Version 1 is the same record without the capture time */
+				memcpy(rec, buf, split);
+				rec->captureMonotonic = 0;
+				memcpy((uint8_t*)rec + split + sizeof(int64_t), buf + split, m_recordSize - split);
+			}
+			return true;
+		}
+
+		/* All zeroes: preallocated space, or a hole left by a crash with
+		 * more records after it. Keep going until the end of the file */
+		if (!memcmp(buf, zero, m_recordSize)) continue;
+		m_corrupted++;
+	}
+	return false;
+}
+/* }}} */
+/* Static functions {{{ */
+static bool
+record_valid(const void *rec, size_t size)
+{
+	const FlightLogRecord *hdr = (const FlightLogRecord*)rec;
+
+	return hdr->magic == FLIGHTLOG_RECORD_MAGIC
+	    && hdr->crc == crc32((const uint8_t*)rec + offsetof(FlightLogRecord, rxTime),
+	                         size - offsetof(FlightLogRecord, rxTime));
+}
+
+static uint32_t
+crc32(const void *data, size_t len)
+{
+	static const std::array<uint32_t, 256> table = []{
+		std::array<uint32_t, 256> table;
+		for (uint32_t i=0; i<256; i++) {
+			uint32_t c = i;
+			for (int j=0; j<8; j++) c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+			table[i] = c;
+		}
+		return table;
+	}();
+	const uint8_t *ptr = (const uint8_t*)data;
+	uint32_t crc = 0xFFFFFFFF;
+
+	while (len--) {
+		crc = table[(crc ^ *ptr++) & 0xFF] ^ (crc >> 8);
+	}
+	return crc ^ 0xFFFFFFFF;
+}
+/* }}} */
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include "decode/common.hpp"
+
+#define FLIGHTLOG_MAGIC "RSFLOG\0\0"
+#define FLIGHTLOG_VERSION 2
+#define FLIGHTLOG_RECORD_MAGIC 0x52464C47    /* "GLFR" on disk */
+
+/**
+ * On-disk flight log record. Fixed-size, with no implicit padding, stored in
+ * host byte order (little-endian on every supported platform). The CRC covers
+ * every byte following it, so a record that was only partially written before
+ * a crash can be told apart from a valid one.
+ */
+struct FlightLogRecord {
+	uint32_t magic;             /* FLIGHTLOG_RECORD_MAGIC */
+	uint32_t crc;               /* CRC-32 of the rest of the record */
+	int64_t rxTime;             /* Receive time (microseconds since the Unix epoch) */
+	int64_t rxMonotonic;        /* Receive time (microseconds, monotonic clock) */
+	int64_t captureMonotonic;   /* Capture time (same clock), 0 if unknown. Added in version 2 */
+	int64_t time;               /* Onboard time */
+	int32_t seq;
+	int32_t burstkill;
+	float lat, lon, alt;
+	float spd, hdg, climb;
+	float temp, rh, dewpt, pressure;
+	float calibPercent;
+	uint8_t calibrated;
+	uint8_t reserved[3];
+	char serial[SONDE_SERIAL_LEN];
+	char auxData[SONDE_AUX_LEN];
+
+	void fromData(const SondeFullData *data);
+	void toData(SondeFullData *data) const;
+};
+static_assert(sizeof(FlightLogRecord) == 192, "FlightLogRecord must not contain implicit padding");
+
+/**
+ * Append-only binary flight log. The file is grown in zero-filled segments
+ * ahead of the records being written, so appending never extends the file
+ * and a torn tail shows up as a zeroed or corrupted record. Opening an
+ * existing log appends to it, after the last record that was written, valid
+ * or not. A file that is not a log of this version is renamed aside rather
+ * than overwritten.
+ */
+class FlightLogWriter {
+public:
+	FlightLogWriter() { m_fd = NULL; };
+	~FlightLogWriter() { deinit(); };
+
+	/**
+	 * Open a log for appending, creating it if needed
+	 *
+	 * @param fname path to the log
+	 * @return false if it can't be opened, or if an incompatible file in the
+	 *         way can't be renamed aside
+	 */
+	bool init(const char *fname);
+	void deinit();
+	bool isOpen() const { return m_fd != NULL; }
+
+	/**
+	 * @return where the last init() moved an incompatible file to, empty if
+	 *         it didn't
+	 */
+	const std::string& movedAside() const { return m_movedAside; }
+
+	/**
+	 * Append a new record to the log.
+	 *
+	 * @param data data to log
+	 */
+	void addPoint(const SondeFullData *data);
+
+	/**
+	 * Push buffered records to the OS.
+	 *
+	 * @param sync whether to also wait for the data to hit the disk
+	 */
+	void flush(bool sync);
+private:
+	bool preallocate();
+	bool moveAside(const char *fname, const uint8_t *header);
+
+	FILE *m_fd;
+	unsigned long m_offset, m_allocated;
+	std::string m_movedAside;
+};
+
+/**
+ * Sequential reader for flight logs. Records that fail validation are
+ * skipped and counted; zeroed ones (unused space, or holes left by a crash)
+ * are skipped silently. Version 1 logs are read too, with an unknown capture
+ * time.
+ */
+class FlightLogReader {
+public:
+	FlightLogReader() { m_fd = NULL; };
+	~FlightLogReader() { deinit(); };
+
+	bool init(const char *fname);
+	void deinit();
+
+	/**
+	 * Read the next valid record.
+	 *
+	 * @param rec record to fill
+	 * @return true if a record was read, false if the end of the log was reached
+	 */
+	bool next(FlightLogRecord *rec);
+
+	/**
+	 * @return number of corrupted records skipped so far
+	 */
+	unsigned long corrupted() const { return m_corrupted; }
+
+private:
+	FILE *m_fd;
+	unsigned long m_corrupted;
+	uint32_t m_version, m_recordSize;
+};
@@ -0,0 +1,470 @@
+#include <chrono>
+#include <map>
+#include <math.h>
+#include <mutex>
+#include <numeric>
+#include <string.h>
+#include "fmresampler.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FMRESAMPLER_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define SIMD_WIDTH 8        /* Taps per phase are padded to a multiple of this */
+#define TRANSITION_RATIO 0.1
+
+/* Minimax fit of atan(a) on [0, 1] as a * P(a^2), max error 1.2e-5 rad */
+#define ATAN_C1 0.99986633f
+#define ATAN_C3 -0.33030479f
+#define ATAN_C5 0.18015929f
+#define ATAN_C7 -0.085156351f
+#define ATAN_C9 0.020845114f
+
+static void discriminate(const dsp::complex_t *in, dsp::complex_t *last, float *out, int count, float gain);
+static float dot(const float *x, const float *taps, int len);
+static float fast_atan2(float y, float x);
+static int64_t now_us();
+
+void
+FMResampler::init(dsp::stream<dsp::complex_t> *in, double samplerate, double bandwidth, double outSamplerate)
+{
+	m_samplerate = samplerate;
+	m_bandwidth = bandwidth;
+	m_outSamplerate = outSamplerate;
+	reconfigure();
+
+	dsp::Processor<dsp::complex_t, float>::init(in);
+}
+
+void
+FMResampler::setRates(double samplerate, double outSamplerate)
+{
+	assert(_block_init);
+	if (samplerate == m_samplerate && outSamplerate == m_outSamplerate) return;
+
+	std::lock_guard<std::recursive_mutex> lck(ctrlMtx);
+	tempStop();
+	m_samplerate = samplerate;
+	m_outSamplerate = outSamplerate;
+	reconfigure();
+	tempStart();
+}
+
+void
+FMResampler::setBandwidth(double bandwidth)
+{
+	assert(_block_init);
+	std::lock_guard<std::recursive_mutex> lck(ctrlMtx);
+	m_bandwidth = bandwidth;
+	m_invDeviation = m_samplerate / (M_PI * m_bandwidth);
+}
+
+void
+FMResampler::setSquelch(bool enabled, float threshold)
+{
+	std::lock_guard<std::recursive_mutex> lck(ctrlMtx);
+	tempStop();
+	if (enabled && !m_squelchEnabled) m_squelch.reset();
+	m_squelch.setThreshold(threshold);
+	m_squelchEnabled = enabled;
+	tempStart();
+}
+
+void
+FMResampler::setCapture(CaptureRing *capture)
+{
+	std::lock_guard<std::recursive_mutex> lck(ctrlMtx);
+	tempStop();
+	m_capture = capture;
+	if (m_capture) m_capture->setSamplerate((int)round(m_outSamplerate));
+	tempStart();
+}
+
+void
+FMResampler::reset()
+{
+	assert(_block_init);
+	std::lock_guard<std::recursive_mutex> lck(ctrlMtx);
+	tempStop();
+	m_last.re = m_last.im = 0;
+	std::fill(m_buf.begin(), m_buf.end(), 0.0f);
+	m_phase = m_offset = 0;
+	m_squelch.reset();
+	tempStart();
+}
+
+int
+FMResampler::process(int count, const dsp::complex_t *in, float *out)
+{
+	float *samples;
+	int outCount, offset, phase;
+
+	if (count <= 0) return 0;
+	if (m_squelchEnabled && !m_squelch.update(in, count)) return 0;
+
+	/* Same rate on both sides, just demodulate */
+	if (m_phaseLen == 0) {
+		discriminate(in, &m_last, out, count, m_invDeviation);
+		return count;
+	}
+
+	/* Demodulate right after the filter history, then run the polyphase
+	 * filter over history + new samples while they're still in cache */
+	if ((int)m_buf.size() < m_phaseLen - 1 + count) m_buf.resize(m_phaseLen - 1 + count);
+	samples = m_buf.data();
+	discriminate(in, &m_last, samples + m_phaseLen - 1, count, m_invDeviation);
+
+	outCount = 0;
+	offset = m_offset;
+	phase = m_phase;
+	while (offset < count) {
+		out[outCount++] = dot(samples + offset, m_taps->taps.data() + phase * m_phaseLen, m_phaseLen);
+		phase += m_decim;
+		offset += phase / m_interp;
+		phase %= m_interp;
+	}
+	m_offset = offset - count;
+	m_phase = phase;
+
+	memmove(samples, samples + count, (m_phaseLen - 1) * sizeof(*samples));
+	return outCount;
+}
+
+void
+FMResampler::prepare(double samplerate, double outSamplerate)
+{
+	int interp, decim;
+
+	ratio(samplerate, outSamplerate, &interp, &decim);
+	if (interp != decim) getTaps(interp, decim);
+}
+
+int
+FMResampler::run()
+{
+	int64_t capture;
+	int count, outCount;
+
+	if ((count = _in->read()) < 0) return -1;
+	capture = now_us();
+
+	outCount = process(count, _in->readBuf, out.writeBuf);
+
+	_in->flush();
+	if (outCount <= 0) return outCount;
+	if (m_capture) m_capture->write(out.writeBuf, outCount);
+
+	m_clock.push(outCount, capture, now_us());
+	if (!out.swap(outCount)) return -1;
+	return outCount;
+}
+
+/* Private methods {{{ */
+/**
+ * Get the filter for a rate ratio, designing it on first use. The prototype is
+ * the same as dsp::multirate::RationalResampler's: cutoff at the lower of the
+ * two Nyquist frequencies, 10% transition width. Normalized to the tap rate,
+ * it only depends on interp and decim.
+ */
+std::shared_ptr<const FMResampler::Taps>
+FMResampler::getTaps(int interp, int decim)
+{
+	static std::mutex cacheMtx;
+	static std::map<std::pair<int, int>, std::shared_ptr<const Taps>> cache;
+	std::lock_guard<std::mutex> lck(cacheMtx);
+	std::shared_ptr<const Taps>& cached = cache[std::make_pair(interp, decim)];
+	std::shared_ptr<Taps> taps;
+	double cutoff, transition, x, window, sum;
+	std::vector<double> proto;
+	int len;
+
+	if (cached) return cached;
+
+	/* Cutoff and transition width relative to the tap rate */
+	cutoff = 0.5 / std::max(interp, decim);
+	transition = cutoff * TRANSITION_RATIO;
+	len = std::max(1, (int)lround(3.8 / transition));
+
+	/* Zero-pad to a whole number of phases, without moving the center */
+	proto.assign(len + (interp - len % interp) % interp, 0.0);
+	sum = 0;
+	for (int i=0; i<len; i++) {
+		x = i - (len - 1) / 2.0;
+		window = 0.355768 - 0.487396 * cos(2 * M_PI * i / (len - 1))
+		       + 0.144232 * cos(4 * M_PI * i / (len - 1)) - 0.012604 * cos(6 * M_PI * i / (len - 1));
+		proto[i] = (x == 0 ? 1.0 : sin(2 * M_PI * cutoff * x) / (2 * M_PI * cutoff * x)) * window;
+		sum += proto[i];
+	}
+
+	/* Split into phases, time-reversed so that each output is a plain dot
+	 * product with the input, and zero-padded to the SIMD width */
+	taps = std::make_shared<Taps>();
+	len = proto.size();
+	taps->phaseLen = (len / interp + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH;
+	taps->taps.assign(interp * taps->phaseLen, 0.0f);
+	for (int p=0; p<interp; p++) {
+		for (int k=0; p + k*interp < len; k++) {
+			taps->taps[p * taps->phaseLen + taps->phaseLen - 1 - k] = proto[p + k*interp] * interp / sum;
+		}
+	}
+
+	cached = taps;
+	return cached;
+}
+
+void
+FMResampler::ratio(double samplerate, double outSamplerate, int *interp, int *decim)
+{
+	const int inRate = (int)round(samplerate);
+	const int outRate = (int)round(outSamplerate);
+	const int gcd = std::gcd(inRate, outRate);
+
+	*interp = outRate / gcd;
+	*decim = inRate / gcd;
+}
+
+void
+FMResampler::reconfigure()
+{
+	/* Deviation is half the bandwidth, same as dsp::demod::FM */
+	m_invDeviation = m_samplerate / (M_PI * m_bandwidth);
+	m_last.re = m_last.im = 0;
+	m_phase = m_offset = 0;
+	m_squelch.setSamplerate(m_samplerate);
+	m_squelch.reset();
+	if (m_capture) m_capture->setSamplerate((int)round(m_outSamplerate));
+
+	ratio(m_samplerate, m_outSamplerate, &m_interp, &m_decim);
+	if (m_interp == m_decim) {
+		m_phaseLen = 0;
+		m_taps.reset();
+		m_buf.clear();
+		return;
+	}
+
+	m_taps = getTaps(m_interp, m_decim);
+	m_phaseLen = m_taps->phaseLen;
+	m_buf.assign(m_phaseLen - 1, 0.0f);
+}
+/* }}} */
+
+/* Static functions {{{ */
+static int64_t
+now_us()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Polynomial atan2 approximation, max error 1.2e-5 rad
+ */
+static inline float
+fast_atan2(float y, float x)
+{
+	const float ax = fabsf(x), ay = fabsf(y);
+	const float mx = std::max(ax, ay), mn = std::min(ax, ay);
+	const float a = mx > 0 ? mn / mx : 0;
+	const float s = a * a;
+	float r;
+
+	r = ((((ATAN_C9 * s + ATAN_C7) * s + ATAN_C5) * s + ATAN_C3) * s + ATAN_C1) * a;
+	if (ay > ax) r = (float)(M_PI / 2) - r;
+	if (x < 0) r = (float)M_PI - r;
+	return y < 0 ? -r : r;
+}
+
+#if defined(__AVX2__)
+static inline __m256
+atan2_ps(__m256 y, __m256 x)
+{
+	const __m256 signMask = _mm256_set1_ps(-0.0f);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 ax = _mm256_andnot_ps(signMask, x), ay = _mm256_andnot_ps(signMask, y);
+	const __m256 mx = _mm256_max_ps(ax, ay), mn = _mm256_min_ps(ax, ay);
+	const __m256 a = _mm256_and_ps(_mm256_div_ps(mn, mx), _mm256_cmp_ps(mx, zero, _CMP_GT_OQ));
+	const __m256 s = _mm256_mul_ps(a, a);
+	__m256 r;
+
+	r = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(ATAN_C9), s), _mm256_set1_ps(ATAN_C7));
+	r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(ATAN_C5));
+	r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(ATAN_C3));
+	r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(ATAN_C1));
+	r = _mm256_mul_ps(r, a);
+	r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(M_PI / 2), r), _mm256_cmp_ps(ay, ax, _CMP_GT_OQ));
+	r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(M_PI), r), _mm256_cmp_ps(x, zero, _CMP_LT_OQ));
+	return _mm256_xor_ps(r, _mm256_and_ps(y, signMask));
+}
+
+static inline void
+load_complex(const dsp::complex_t *src, __m256 *re, __m256 *im)
+{
+	const __m256 lo = _mm256_loadu_ps((const float*)src);
+	const __m256 hi = _mm256_loadu_ps((const float*)(src + 4));
+
+	/* Shuffles work within 128-bit lanes, fix up the order afterwards */
+	*re = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(2,0,2,0))), _MM_SHUFFLE(3,1,2,0)));
+	*im = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(3,1,3,1))), _MM_SHUFFLE(3,1,2,0)));
+}
+#elif defined(FMRESAMPLER_SSE2)
+static inline __m128
+atan2_ps(__m128 y, __m128 x)
+{
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 ax = _mm_andnot_ps(signMask, x), ay = _mm_andnot_ps(signMask, y);
+	const __m128 mx = _mm_max_ps(ax, ay), mn = _mm_min_ps(ax, ay);
+	const __m128 a = _mm_and_ps(_mm_div_ps(mn, mx), _mm_cmpgt_ps(mx, zero));
+	const __m128 s = _mm_mul_ps(a, a);
+	__m128 r, mask;
+
+	r = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ATAN_C9), s), _mm_set1_ps(ATAN_C7));
+	r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(ATAN_C5));
+	r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(ATAN_C3));
+	r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(ATAN_C1));
+	r = _mm_mul_ps(r, a);
+	mask = _mm_cmpgt_ps(ay, ax);
+	r = _mm_or_ps(_mm_and_ps(mask, _mm_sub_ps(_mm_set1_ps(M_PI / 2), r)), _mm_andnot_ps(mask, r));
+	mask = _mm_cmplt_ps(x, zero);
+	r = _mm_or_ps(_mm_and_ps(mask, _mm_sub_ps(_mm_set1_ps(M_PI), r)), _mm_andnot_ps(mask, r));
+	return _mm_xor_ps(r, _mm_and_ps(y, signMask));
+}
+
+static inline void
+load_complex(const dsp::complex_t *src, __m128 *re, __m128 *im)
+{
+	const __m128 lo = _mm_loadu_ps((const float*)src);
+	const __m128 hi = _mm_loadu_ps((const float*)(src + 2));
+
+	*re = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2,0,2,0));
+	*im = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3,1,3,1));
+}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+static inline float32x4_t
+atan2_ps(float32x4_t y, float32x4_t x)
+{
+	const float32x4_t zero = vdupq_n_f32(0);
+	const float32x4_t ax = vabsq_f32(x), ay = vabsq_f32(y);
+	const float32x4_t mx = vmaxq_f32(ax, ay), mn = vminq_f32(ax, ay);
+	const float32x4_t a = vbslq_f32(vcgtq_f32(mx, zero), vdivq_f32(mn, mx), zero);
+	const float32x4_t s = vmulq_f32(a, a);
+	float32x4_t r;
+
+	r = vmlaq_f32(vdupq_n_f32(ATAN_C7), vdupq_n_f32(ATAN_C9), s);
+	r = vmlaq_f32(vdupq_n_f32(ATAN_C5), r, s);
+	r = vmlaq_f32(vdupq_n_f32(ATAN_C3), r, s);
+	r = vmlaq_f32(vdupq_n_f32(ATAN_C1), r, s);
+	r = vmulq_f32(r, a);
+	r = vbslq_f32(vcgtq_f32(ay, ax), vsubq_f32(vdupq_n_f32(M_PI / 2), r), r);
+	r = vbslq_f32(vcltq_f32(x, zero), vsubq_f32(vdupq_n_f32(M_PI), r), r);
+	return vbslq_f32(vcltq_f32(y, zero), vnegq_f32(r), r);
+}
+#endif
+
+/**
+ * FM discriminator: phase difference between consecutive samples, computed
+ * as arg(x[n] * conj(x[n-1])) so that no phase unwrapping is needed
+ */
+static void
+discriminate(const dsp::complex_t *in, dsp::complex_t *last, float *out, int count, float gain)
+{
+	int i;
+
+	out[0] = fast_atan2(in[0].im * last->re - in[0].re * last->im, in[0].re * last->re + in[0].im * last->im) * gain;
+	i = 1;
+
+#if defined(__AVX2__)
+	const __m256 vgain = _mm256_set1_ps(gain);
+	for (; i + 8 <= count; i += 8) {
+		__m256 re, im, pre, pim;
+		load_complex(in + i, &re, &im);
+		load_complex(in + i - 1, &pre, &pim);
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(vgain, atan2_ps(
+		                 _mm256_sub_ps(_mm256_mul_ps(im, pre), _mm256_mul_ps(re, pim)),
+		                 _mm256_add_ps(_mm256_mul_ps(re, pre), _mm256_mul_ps(im, pim)))));
+	}
+#elif defined(FMRESAMPLER_SSE2)
+	const __m128 vgain = _mm_set1_ps(gain);
+	for (; i + 4 <= count; i += 4) {
+		__m128 re, im, pre, pim;
+		load_complex(in + i, &re, &im);
+		load_complex(in + i - 1, &pre, &pim);
+		_mm_storeu_ps(out + i, _mm_mul_ps(vgain, atan2_ps(
+		              _mm_sub_ps(_mm_mul_ps(im, pre), _mm_mul_ps(re, pim)),
+		              _mm_add_ps(_mm_mul_ps(re, pre), _mm_mul_ps(im, pim)))));
+	}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	const float32x4_t vgain = vdupq_n_f32(gain);
+	for (; i + 4 <= count; i += 4) {
+		const float32x4x2_t cur = vld2q_f32((const float*)(in + i));
+		const float32x4x2_t prev = vld2q_f32((const float*)(in + i - 1));
+		vst1q_f32(out + i, vmulq_f32(vgain, atan2_ps(
+		          vmlsq_f32(vmulq_f32(cur.val[1], prev.val[0]), cur.val[0], prev.val[1]),
+		          vmlaq_f32(vmulq_f32(cur.val[0], prev.val[0]), cur.val[1], prev.val[1]))));
+	}
+#endif
+
+	for (; i < count; i++) {
+		out[i] = fast_atan2(in[i].im * in[i-1].re - in[i].re * in[i-1].im,
+		                    in[i].re * in[i-1].re + in[i].im * in[i-1].im) * gain;
+	}
+
+	*last = in[count - 1];
+}
+
+/**
+ * Dot product of two float vectors, len must be a multiple of SIMD_WIDTH
+ */
+static inline float
+dot(const float *x, const float *taps, int len)
+{
+#if defined(__AVX2__)
+	__m256 acc = _mm256_setzero_ps();
+	__m128 sum;
+
+	for (int i=0; i<len; i += 8) {
+		acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(taps + i)));
+	}
+	sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+	return _mm_cvtss_f32(sum);
+#elif defined(FMRESAMPLER_SSE2)
+	__m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+
+	for (int i=0; i<len; i += 8) {
+		acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(taps + i)));
+		acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(x + i + 4), _mm_loadu_ps(taps + i + 4)));
+	}
+	acc0 = _mm_add_ps(acc0, acc1);
+	acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+	acc0 = _mm_add_ss(acc0, _mm_shuffle_ps(acc0, acc0, 1));
+	return _mm_cvtss_f32(acc0);
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	float32x4_t acc0 = vdupq_n_f32(0), acc1 = vdupq_n_f32(0);
+
+	for (int i=0; i<len; i += 8) {
+		acc0 = vmlaq_f32(acc0, vld1q_f32(x + i), vld1q_f32(taps + i));
+		acc1 = vmlaq_f32(acc1, vld1q_f32(x + i + 4), vld1q_f32(taps + i + 4));
+	}
+	return vaddvq_f32(vaddq_f32(acc0, acc1));
+#else
+	float acc[SIMD_WIDTH] = {0};
+
+	for (int i=0; i<len; i += SIMD_WIDTH) {
+		for (int j=0; j<SIMD_WIDTH; j++) acc[j] += x[i + j] * taps[i + j];
+	}
+	for (int j=1; j<SIMD_WIDTH; j++) acc[0] += acc[j];
+	return acc[0];
+#endif
+}
+/* }}} */
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <dsp/processor.h>
+#include <memory>
+#include <vector>
+#include "capture.hpp"
+#include "squelch.hpp"
+#include "streamclock.hpp"
+
+/**
+ * FM discriminator fused with a rational polyphase resampler. Equivalent to a
+ * dsp::demod::FM<float> followed by a dsp::multirate::RationalResampler<float>,
+ * but runs as a single block with no intermediate stream, and vectorizes both
+ * the discriminator and the filter (AVX2, SSE2 or NEON, depending on the
+ * target, with a scalar fallback).
+ */
+class FMResampler : public dsp::Processor<dsp::complex_t, float> {
+public:
+	FMResampler() {};
+
+	/**
+	 * Initialize the block
+	 *
+	 * @param in stream to read IQ samples from, can be NULL if the block is
+	 *        only going to be used through process()
+	 * @param samplerate input sample rate, in Hz
+	 * @param bandwidth FM bandwidth, in Hz. The deviation is half of this,
+	 *        like in dsp::demod::FM
+	 * @param outSamplerate output sample rate, in Hz. If equal to the input
+	 *        rate, no filtering is done.
+	 */
+	void init(dsp::stream<dsp::complex_t> *in, double samplerate, double bandwidth, double outSamplerate);
+
+	/**
+	 * Change the input and output sample rates. The filter taps for the new
+	 * rate ratio are taken from a process-wide cache, so switching back and
+	 * forth between rate plans does not redesign the filter every time.
+	 * Does nothing if the rates are unchanged.
+	 */
+	void setRates(double samplerate, double outSamplerate);
+	void setBandwidth(double bandwidth);
+	void reset();
+
+	/**
+	 * Skip demodulation while no carrier is detected on the input, so that
+	 * the block (and whatever reads its output) idles on empty channels
+	 *
+	 * @param enabled false to always demodulate
+	 * @param threshold SNR the squelch opens at, dB
+	 */
+	void setSquelch(bool enabled, float threshold);
+	const CarrierSquelch& squelch() const { return m_squelch; }
+	bool squelchEnabled() const { return m_squelchEnabled; }
+
+	/**
+	 * Copy everything written to out to a capture ring as well, and keep the
+	 * ring's sample rate in sync with the output rate
+	 *
+	 * @param capture ring to write to, NULL to stop
+	 */
+	void setCapture(CaptureRing *capture);
+
+	/**
+	 * Design the filter for a given rate pair ahead of time, so that a later
+	 * setRates() or init() with the same ratio only has to swap pointers
+	 */
+	static void prepare(double samplerate, double outSamplerate);
+
+	/**
+	 * Demodulate and resample a buffer of IQ samples
+	 *
+	 * @param count number of samples in in
+	 * @param in IQ samples
+	 * @param out output buffer, must fit at least maxOutput(count) samples
+	 * @return number of samples written to out, 0 if squelched
+	 */
+	int process(int count, const dsp::complex_t *in, float *out);
+	int maxOutput(int count) const { return (int)((long)count * m_interp / m_decim) + 2; }
+
+	/**
+	 * @return timestamps of the buffers written to out by run(), for the
+	 *         reader to pick up
+	 */
+	StreamClock& clock() { return m_clock; }
+
+	int run() override;
+
+private:
+	/* Polyphase filter for an interpolation/decimation pair */
+	struct Taps {
+		int phaseLen;               /* Taps per phase, a multiple of the SIMD width */
+		std::vector<float> taps;    /* interp phases of phaseLen taps, time-reversed */
+	};
+	static std::shared_ptr<const Taps> getTaps(int interp, int decim);
+	static void ratio(double samplerate, double outSamplerate, int *interp, int *decim);
+
+	void reconfigure();
+
+	double m_samplerate, m_bandwidth, m_outSamplerate;
+	float m_invDeviation;
+	dsp::complex_t m_last;
+
+	int m_interp, m_decim;
+	int m_phaseLen;             /* Copy of m_taps->phaseLen, 0 when bypassed */
+	std::shared_ptr<const Taps> m_taps;
+	std::vector<float> m_buf;   /* m_phaseLen-1 samples of history, then the new samples */
+	int m_phase, m_offset;
+
+	CarrierSquelch m_squelch;
+	bool m_squelchEnabled = false;
+	StreamClock m_clock;
+	CaptureRing *m_capture = NULL;
+};
@@ -3,6 +3,7 @@
 #include <string.h>
 #include <ctype.h>
 #include "gpx.hpp"
+#include "utils.hpp"
 
 #define GPX_TIME_FORMAT "%Y-%m-%dT%H:%M:%SZ"
 
@@ -15,6 +16,18 @@ GPXWriter::init(const char *fname)
 	if (!m_fd) return false;
 
 	m_lat = m_lon = m_alt = m_time = 0;
+	m_landingValid = m_landingDirty = false;
+	m_landings.clear();
+	m_trailerLen = 0;
+
+	/* Landing points of a previous file by the same name would no longer
+	 * match its tracks */
+	m_landingPath = fname;
+	if (m_landingPath.size() > 4 && !m_landingPath.compare(m_landingPath.size() - 4, 4, ".gpx")) {
+		m_landingPath.resize(m_landingPath.size() - 4);
+	}
+	m_landingPath += "_landing.gpx";
+	remove(m_landingPath.c_str());
 
 	m_trackActive = false;
 	fprintf(m_fd,
@@ -33,6 +46,7 @@ GPXWriter::deinit()
 	terminateFile();
 	fclose(m_fd);
 	m_fd = NULL;
+	if (m_landingDirty) writeLandings(false);
 }
 
 void
@@ -47,13 +61,11 @@ GPXWriter::startTrack(const char *name)
 	}
 
 	strncpy(sondeSerial, name, sizeof(sondeSerial)-1);
+	m_landingValid = false;
 
-	fseek(m_fd, m_offset, SEEK_SET);
-	fprintf(m_fd, "<trk>\n<name>%s</name>\n<trkseg>\n", name);
-	m_offset = ftell(m_fd);
+	seekToEnd();
+	m_offset += fprintf(m_fd, "<trk>\n<name>%s</name>\n<trkseg>\n", name);
 	m_trackActive = true;
-
-	terminateFile();
 }
 
 
@@ -61,16 +73,16 @@ void
 GPXWriter::stopTrack()
 {
 	if (!m_fd || !m_trackActive) return;
+	seekToEnd();
 	stopTrackInternal();
 	m_trackActive = false;
-	terminateFile();
+	m_landingValid = false;
 }
 
 void
 GPXWriter::addTrackPoint(time_t time, float lat, float lon, float alt, float spd, float hdg)
 {
 	if (!m_fd || !m_trackActive) return;
-	fseek(m_fd, m_offset, SEEK_SET);
 	char timestr[sizeof("YYYY-MM-DDThh:mm:ssZ")+1];
 
 	if (isnan(lat) || isnan(lon) || isnan(alt)) return;
@@ -83,15 +95,34 @@ GPXWriter::addTrackPoint(time_t time, float lat, float lon, float alt, float spd
 	m_time = time;
 
 	strftime(timestr, sizeof(timestr), GPX_TIME_FORMAT, gmtime(&time));
-	fprintf(m_fd, "<trkpt lat=\"%f\" lon=\"%f\">\n", lat, lon);
-	fprintf(m_fd, "<time>%s</time>\n", timestr);
-	fprintf(m_fd, "<ele>%f</ele>\n", alt);
-	fprintf(m_fd, "<speed>%f</speed>\n", spd);
-	fprintf(m_fd, "<course>%f</course>\n", hdg);
-	fprintf(m_fd, "</trkpt>\n");
-	m_offset = ftell(m_fd);
+	seekToEnd();
+	m_offset += fprintf(m_fd, "<trkpt lat=\"%f\" lon=\"%f\">\n", lat, lon);
+	m_offset += fprintf(m_fd, "<time>%s</time>\n", timestr);
+	m_offset += fprintf(m_fd, "<ele>%f</ele>\n", alt);
+	m_offset += fprintf(m_fd, "<speed>%f</speed>\n", spd);
+	m_offset += fprintf(m_fd, "<course>%f</course>\n", hdg);
+	m_offset += fprintf(m_fd, "</trkpt>\n");
+}
 
+void
+GPXWriter::setLandingPoint(float lat, float lon, time_t time)
+{
+	if (!m_fd || !m_trackActive) return;
+	if (isnan(lat) || isnan(lon)) return;
+
+	if (!m_landingValid) m_landings.push_back({sondeSerial, lat, lon, time});
+	else m_landings.back() = {sondeSerial, lat, lon, time};
+	m_landingValid = true;
+	m_landingDirty = true;
+}
+
+void
+GPXWriter::flush(bool sync)
+{
+	if (!m_fd) return;
 	terminateFile();
+	if (sync) syncFile(m_fd);
+	if (m_landingDirty) writeLandings(sync);
 }
 
 void
@@ -104,18 +135,59 @@ GPXWriter::terminateFile()
 
 	if (m_trackActive) stopTrackInternal();
 
-	fprintf(m_fd, "</gpx>\n");
+	m_offset += fprintf(m_fd, "</gpx>\n");
+
+	/* The trailer can be shorter than the previous one, e.g. once the track
+	 * is terminated: blank out what is left of the old one */
+	for (; m_offset < offset + m_trailerLen; m_offset++) fputc(' ', m_fd);
+	m_trailerLen = m_offset - offset;
+
 	fflush(m_fd);
 	m_offset = offset;
+	m_terminated = true;
 }
 
 void
-GPXWriter::stopTrackInternal()
+GPXWriter::seekToEnd()
 {
-	if (!m_fd) return;
+	/* The closing tags are only ever written by terminateFile(), so unless it
+	 * was called, the file position is already right after the last point */
+	if (!m_terminated) return;
 	fseek(m_fd, m_offset, SEEK_SET);
-	fprintf(m_fd, "</trkseg>\n</trk>\n");
-	m_offset = ftell(m_fd);
+	m_terminated = false;
+}
 
+void
+GPXWriter::stopTrackInternal()
+{
+	if (!m_fd) return;
+	m_offset += fprintf(m_fd, "</trkseg>\n</trk>\n");
 }
 
+void
+GPXWriter::writeLandings(bool sync)
+{
+	char timestr[sizeof("YYYY-MM-DDThh:mm:ssZ")+1];
+	FILE *fd;
+
+	/* One waypoint per track, so it is small enough to be rewritten whole */
+	if (!(fd = fopen(m_landingPath.c_str(), "wb"))) return;
+	fprintf(fd,
+			"<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\" ?>\n"
+			"<gpx xmlns=\"http://www.topografix.com/GPX/1/1\" version=\"1.1\" creator=\"SDR++\">\n"
+	);
+	for (const auto& landing : m_landings) {
+		strftime(timestr, sizeof(timestr), GPX_TIME_FORMAT, gmtime(&landing.time));
+		fprintf(fd, "<wpt lat=\"%f\" lon=\"%f\">\n", landing.lat, landing.lon);
+		fprintf(fd, "<time>%s</time>\n", timestr);
+		fprintf(fd, "<name>%s landing</name>\n", landing.name.c_str());
+		fprintf(fd, "<desc>Predicted landing point</desc>\n");
+		fprintf(fd, "</wpt>\n");
+	}
+	fprintf(fd, "</gpx>\n");
+
+	fflush(fd);
+	if (sync) syncFile(fd);
+	fclose(fd);
+	m_landingDirty = false;
+}
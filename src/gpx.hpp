@@ -2,10 +2,14 @@
 
 #include <stdio.h>
 #include <time.h>
+#include <string>
+#include <vector>
 
 /**
- * Wrapper around a GPX file. Will take care of terminating the file properly
- * every time, regardless of whether a track is currently being updated.
+ * Wrapper around a GPX file. Points are appended in place, and the closing
+ * tags are rewritten after them every time flush() is called, so that the file
+ * is well-formed as of the last flush regardless of whether a track is
+ * currently being updated.
  */
 
 class GPXWriter {
@@ -43,14 +47,49 @@ public:
 	 */
 	void addTrackPoint(time_t time, float lat, float lon, float alt, float spd, float hdg);
 
+	/**
+	 * Set the predicted landing point of the current track. GPX requires
+	 * waypoints to come before all the tracks, which a file that is only
+	 * appended to can't do, so landing points go to a file of their own next
+	 * to the track file (track_landing.gpx for track.gpx), rewritten on every
+	 * flush. It holds one waypoint per track, updated until the track is
+	 * terminated.
+	 *
+	 * @param lat latitude of the landing point, in degrees
+	 * @param lon longitude of the landing point, in degrees
+	 * @param time predicted landing time (UTC)
+	 */
+	void setLandingPoint(float lat, float lon, time_t time);
+
+	/**
+	 * Terminate the file after the last point written, and push it to the OS.
+	 *
+	 * @param sync whether to also wait for the data to hit the disk
+	 */
+	void flush(bool sync);
+
 private:
+	void seekToEnd();
 	void terminateFile();
 	void stopTrackInternal();
 	FILE *m_fd;
 	unsigned long m_offset;
 	bool m_trackActive;
+	bool m_terminated;
 	char sondeSerial[64];
 
 	float m_lat, m_lon, m_alt;
 	time_t m_time;
+
+	struct Landing {
+		std::string name;
+		float lat, lon;
+		time_t time;
+	};
+	void writeLandings(bool sync);
+	std::string m_landingPath;
+	std::vector<Landing> m_landings;
+	bool m_landingValid;        /* Whether the last landing is that of the current track */
+	bool m_landingDirty;
+	unsigned long m_trailerLen;
 };
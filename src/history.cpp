@@ -0,0 +1,293 @@
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+#include "history.hpp"
+
+#define LOD_SHIFT 2         /* log2 of the number of buckets merged by each level */
+
+FlightHistory::FlightHistory(size_t maxTracks, size_t capacity)
+{
+	m_maxTracks = maxTracks;
+	m_capacity = std::max<size_t>(capacity, 2);    /* Room to merge a pair */
+	m_clock = 0;
+	m_tracks.resize(maxTracks);
+	clear();
+}
+
+void
+FlightHistory::push(const SondeFullData *data)
+{
+	const bool fix = data->lat != 0 || data->lon != 0;
+	std::lock_guard<std::mutex> lck(m_mtx);
+	Track *track;
+
+	if (!data->serial[0]) return;
+
+	track = findTrack(data->serial);
+	if (!track) track = newTrack(data->serial);
+	track->lastUsed = ++m_clock;
+
+	if (track->pending && (data->seq != track->pendingSeq || data->time != track->pendingTime)) {
+		commit(track);
+	}
+
+	/* Position fields are all zero until the GPS gets a fix */
+	track->pending = true;
+	track->pendingSeq = data->seq;
+	track->pendingTime = data->time;
+	track->pendingValues[COL_ALT] = fix ? data->alt : NAN;
+	track->pendingValues[COL_TEMP] = data->temp;
+	track->pendingValues[COL_RH] = data->rh;
+	track->pendingValues[COL_LAT] = fix ? data->lat : NAN;
+	track->pendingValues[COL_LON] = fix ? data->lon : NAN;
+}
+
+void
+FlightHistory::clear()
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+
+	for (auto& track : m_tracks) {
+		track.serial[0] = '\0';
+		track.lastUsed = 0;
+		track.count = 0;
+		track.pending = false;
+	}
+}
+
+int
+FlightHistory::serials(char (*dst)[SONDE_SERIAL_LEN], int max)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	std::vector<const Track*> active;
+
+	for (auto& track : m_tracks) {
+		if (track.serial[0]) active.push_back(&track);
+	}
+	std::sort(active.begin(), active.end(), [](const Track *a, const Track *b) { return a->lastUsed > b->lastUsed; });
+
+	max = std::min(max, (int)active.size());
+	for (int i=0; i<max; i++) {
+		strncpy(dst[i], active[i]->serial, SONDE_SERIAL_LEN);
+	}
+	return max;
+}
+
+bool
+FlightHistory::query(const char *serial, size_t maxPoints, Series *dst)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	const Track *track = findTrack(serial);
+	const Level *level, *top;
+	size_t buckets, topBuckets;
+	int shift, k;
+
+	if (!track || !track->count || !maxPoints) return false;
+
+	/* Finest level that fits, -1 being the samples themselves */
+	k = -1;
+	shift = 0;
+	buckets = track->count;
+	while (buckets > maxPoints && k + 1 < (int)track->levels.size()) {
+		k++;
+		shift += LOD_SHIFT;
+		buckets = ((track->count - 1) >> shift) + 1;
+	}
+	level = k >= 0 ? &track->levels[k] : &track->samples;
+
+	if (dst->time.size() < buckets) {
+		dst->time.resize(buckets);
+		for (int c=0; c<COL_COUNT; c++) {
+			dst->min[c].resize(buckets);
+			dst->max[c].resize(buckets);
+		}
+	}
+	dst->count = buckets;
+	dst->samples = track->count;
+	dst->stride = track->stride;
+
+	for (size_t i=0; i<buckets; i++) {
+		dst->time[i] = track->time[i << shift];
+	}
+	for (int c=0; c<COL_COUNT; c++) {
+		std::copy(level->min[c].begin(), level->min[c].begin() + buckets, dst->min[c].begin());
+		std::copy(level->max[c].begin(), level->max[c].begin() + buckets, dst->max[c].begin());
+	}
+
+	/* The coarsest level has a handful of buckets at most. Tracks too short
+	 * for any level only have samples */
+	top = track->levels.empty() ? &track->samples : &track->levels.back();
+	topBuckets = ((track->count - 1) >> (LOD_SHIFT * track->levels.size())) + 1;
+	for (int c=0; c<COL_COUNT; c++) {
+		dst->lo[c] = dst->hi[c] = NAN;
+		for (size_t i=0; i<topBuckets; i++) {
+			dst->lo[c] = fminf(dst->lo[c], top->min[c][i]);
+			dst->hi[c] = fmaxf(dst->hi[c], top->max[c][i]);
+		}
+	}
+
+	return true;
+}
+
+size_t
+FlightHistory::memoryUsage()
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	size_t total = 0;
+
+	for (auto& track : m_tracks) {
+		if (!track.time.empty()) total += trackSize();
+	}
+	return total;
+}
+
+/* Private methods {{{ */
+FlightHistory::Track*
+FlightHistory::findTrack(const char *serial)
+{
+	for (auto& track : m_tracks) {
+		if (track.serial[0] && !strncmp(track.serial, serial, SONDE_SERIAL_LEN)) return &track;
+	}
+	return NULL;
+}
+
+/**
+ * Take over the least recently updated track. Its memory is allocated the first
+ * time it is used, and reused from then on.
+ */
+FlightHistory::Track*
+FlightHistory::newTrack(const char *serial)
+{
+	Track *track = &*std::min_element(m_tracks.begin(), m_tracks.end(),
+	                                  [](const Track& a, const Track& b) { return a.lastUsed < b.lastUsed; });
+
+	if (track->time.empty()) {
+		track->time.resize(m_capacity);
+		for (int c=0; c<COL_COUNT; c++) {
+			track->samples.min[c].resize(m_capacity);
+			track->samples.max[c].resize(m_capacity);
+		}
+		for (size_t size = m_capacity >> LOD_SHIFT; size; size >>= LOD_SHIFT) {
+			track->levels.emplace_back();
+			for (int c=0; c<COL_COUNT; c++) {
+				track->levels.back().min[c].resize(size + 1);
+				track->levels.back().max[c].resize(size + 1);
+			}
+		}
+	}
+
+	strncpy(track->serial, serial, SONDE_SERIAL_LEN - 1);
+	track->serial[SONDE_SERIAL_LEN - 1] = '\0';
+	track->count = 0;
+	track->stride = 1;
+	track->skip = 0;
+	track->pending = false;
+	return track;
+}
+
+void
+FlightHistory::commit(Track *track)
+{
+	const bool merge = track->skip++ % track->stride;
+	Level& samples = track->samples;
+	size_t idx;
+
+	track->pending = false;
+	track->skip %= track->stride;
+
+	/* Frames in between the first ones of each stride are merged into the
+	 * last sample, rather than dropped */
+	if (merge) {
+		idx = track->count - 1;
+		for (int c=0; c<COL_COUNT; c++) {
+			samples.min[c][idx] = fminf(samples.min[c][idx], track->pendingValues[c]);
+			samples.max[c][idx] = fmaxf(samples.max[c][idx], track->pendingValues[c]);
+		}
+		aggregate(track, idx);
+		return;
+	}
+
+	if (track->count == m_capacity) {
+		compact(track);
+		return;
+	}
+
+	idx = track->count++;
+	track->time[idx] = track->pendingTime;
+	for (int c=0; c<COL_COUNT; c++) {
+		samples.min[c][idx] = samples.max[c][idx] = track->pendingValues[c];
+	}
+	aggregate(track, idx);
+}
+
+/**
+ * Merge a sample into the buckets that contain it, on every level. The first
+ * sample of a bucket resets it. fminf()/fmaxf() ignore NaNs, so that missing
+ * values don't poison the buckets.
+ */
+void
+FlightHistory::aggregate(Track *track, size_t idx)
+{
+	const Level& samples = track->samples;
+	int shift = 0;
+
+	for (auto& level : track->levels) {
+		shift += LOD_SHIFT;
+		const size_t bucket = idx >> shift;
+		const bool first = !(idx & ((1 << shift) - 1));
+
+		for (int c=0; c<COL_COUNT; c++) {
+			level.min[c][bucket] = first ? samples.min[c][idx] : fminf(level.min[c][bucket], samples.min[c][idx]);
+			level.max[c][bucket] = first ? samples.max[c][idx] : fmaxf(level.max[c][bucket], samples.max[c][idx]);
+		}
+	}
+}
+
+/**
+ * Merge samples in pairs and rebuild the levels, then merge twice as many
+ * frames into each sample. Only happens once the track is full, so its linear
+ * cost is amortized over as many frames.
+ */
+void
+FlightHistory::compact(Track *track)
+{
+	Level& samples = track->samples;
+	const size_t count = track->count;
+
+	/* With an odd count, the last sample joins the last pair */
+	track->count = count / 2;
+	for (size_t i=0; i<track->count; i++) {
+		const size_t end = i + 1 < track->count ? 2*i + 2 : count;
+
+		track->time[i] = track->time[2*i];
+		for (int c=0; c<COL_COUNT; c++) {
+			float min = samples.min[c][2*i], max = samples.max[c][2*i];
+			for (size_t j=2*i + 1; j<end; j++) {
+				min = fminf(min, samples.min[c][j]);
+				max = fmaxf(max, samples.max[c][j]);
+			}
+			samples.min[c][i] = min;
+			samples.max[c][i] = max;
+		}
+	}
+	for (size_t i=0; i<track->count; i++) {
+		aggregate(track, i);
+	}
+
+	/* The frame that triggered this one starts a new stride, record it */
+	track->stride *= 2;
+	track->skip = 0;
+	commit(track);
+}
+
+size_t
+FlightHistory::trackSize() const
+{
+	size_t size = m_capacity * (sizeof(time_t) + 2 * COL_COUNT * sizeof(float));
+
+	for (size_t level = m_capacity >> LOD_SHIFT; level; level >>= LOD_SHIFT) {
+		size += 2 * COL_COUNT * (level + 1) * sizeof(float);
+	}
+	return size;
+}
+/* }}} */
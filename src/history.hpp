@@ -0,0 +1,126 @@
+#pragma once
+
+#include <mutex>
+#include <stdint.h>
+#include <time.h>
+#include <vector>
+#include "decode/common.hpp"
+
+/**
+ * In-memory flight history, one track per sonde serial number.
+ *
+ * Each track stores its samples column by column, plus a pyramid of
+ * downsampled levels: each level keeps the minimum and maximum of groups of 4
+ * buckets of the level below, and is updated incrementally on every append.
+ * Queries pick the finest level that fits the number of points asked for, so
+ * that drawing a plot costs the same whether the flight lasted ten minutes or
+ * three hours, without downsampling ever hiding a spike.
+ *
+ * Memory has a fixed ceiling: at most maxTracks tracks of capacity samples
+ * each, the least recently updated track being recycled when a new serial
+ * shows up. Samples are min/max buckets too: a track that fills up merges
+ * them in pairs, and from then on merges twice as many frames into each, so
+ * that long flights are still covered end to end without losing any spike.
+ *
+ * Thread-safe: push() is called by the decoders, query() by the GUI.
+ */
+class FlightHistory {
+public:
+	enum Column {
+		COL_ALT = 0,
+		COL_TEMP,
+		COL_RH,
+		COL_LAT,
+		COL_LON,
+		COL_COUNT
+	};
+
+	/* Result of a query, one bucket per point, in time order */
+	struct Series {
+		size_t count;                   /* Number of buckets */
+		size_t samples;                 /* Number of samples they cover */
+		int stride;                     /* Frames merged into each sample */
+		std::vector<time_t> time;       /* Time of the first sample of each bucket */
+		std::vector<float> min[COL_COUNT], max[COL_COUNT];
+		float lo[COL_COUNT], hi[COL_COUNT];     /* Range over the whole track */
+	};
+
+	/**
+	 * @param maxTracks maximum number of sondes tracked at the same time
+	 * @param capacity samples per track before halving its resolution (the
+	 *        default is over 4 hours at one frame per second)
+	 */
+	FlightHistory(size_t maxTracks = 4, size_t capacity = 16384);
+
+	/**
+	 * Record a frame. Frames are merged until the sequence number or the
+	 * onboard time changes, so that each frame takes a single sample even if
+	 * it was reported in several parts.
+	 *
+	 * @param data frame to record, ignored if it has no serial number
+	 */
+	void push(const SondeFullData *data);
+
+	/**
+	 * Forget every track. Memory stays allocated for reuse.
+	 */
+	void clear();
+
+	/**
+	 * @param dst serial numbers of the tracks, most recently updated first
+	 * @param max maximum number of serial numbers to return
+	 * @return number of serial numbers written
+	 */
+	int serials(char (*dst)[SONDE_SERIAL_LEN], int max);
+
+	/**
+	 * Get the history of a sonde, downsampled to at most maxPoints buckets.
+	 * The vectors in dst are only ever grown, so that a Series reused across
+	 * queries stops allocating after the first one.
+	 *
+	 * @param serial serial number of the sonde
+	 * @param maxPoints maximum number of buckets to return
+	 * @param dst series to fill in
+	 * @return false if no sample of that sonde has been recorded
+	 */
+	bool query(const char *serial, size_t maxPoints, Series *dst);
+
+	/**
+	 * @return bytes currently allocated, and bytes allocated when every
+	 *         track is in use
+	 */
+	size_t memoryUsage();
+	size_t memoryCeiling() const { return m_maxTracks * trackSize(); }
+
+private:
+	struct Level {
+		std::vector<float> min[COL_COUNT], max[COL_COUNT];
+	};
+	struct Track {
+		char serial[SONDE_SERIAL_LEN];
+		uint64_t lastUsed;
+		size_t count;
+		int stride, skip;
+		std::vector<time_t> time;
+		Level samples;                  /* One bucket per sample, of stride frames */
+		std::vector<Level> levels;      /* levels[k] groups 4^(k+1) samples */
+
+		/* Frame being merged, recorded once the next one starts */
+		bool pending;
+		int pendingSeq;
+		time_t pendingTime;
+		float pendingValues[COL_COUNT];
+	};
+
+	Track *findTrack(const char *serial);
+	Track *newTrack(const char *serial);
+	void commit(Track *track);
+	void aggregate(Track *track, size_t idx);
+	void compact(Track *track);
+	size_t trackSize() const;
+
+	std::mutex m_mtx;
+	std::vector<Track> m_tracks;
+	size_t m_maxTracks, m_capacity;
+	uint64_t m_clock;
+};
@@ -6,14 +6,17 @@
 #include <module.h>
 #include <signal_path/signal_path.h>
 #include <time.h>
+#include <algorithm>
 #include "main.hpp"
 #include "utils.hpp"
 
-#define CONCAT(a, b)    ((std::string(a) + b).c_str())
-
 #define SNAP_INTERVAL 1000
 #define UNCAL_COLOR IM_COL32(255,234,0,255)
-#define OUT_SAMPLE_RATE 48000
+#define LANE_OVERSAMPLING 1.25f     /* Minimum lane sample rate, relative to the channel bandwidth */
+#define PLOT_HEIGHT 120
+#define PLOT_ALT_COLOR IM_COL32(80,160,255,255)
+#define PLOT_TEMP_COLOR IM_COL32(255,110,80,255)
+#define PLOT_RH_COLOR IM_COL32(80,220,120,255)
 
 SDRPP_MOD_INFO {
     /* Name:            */ "radiosonde_decoder",
@@ -25,12 +28,23 @@ SDRPP_MOD_INFO {
 
 ConfigManager config;
 
+static std::vector<double> parse_channels(const char *list);
+static void draw_history(ImDrawList *draw, ImVec2 p0, ImVec2 p1, const FlightHistory::Series& series,
+                         int xcol, int ycol, ImU32 color);
+
 RadiosondeDecoderModule::RadiosondeDecoderModule(std::string name)
 {
+	auto registered = radiosonde::Registry::pointers(decoders);
 	float bw;
+
+	for (int i=0; i<radiosonde::Registry::count; i++) {
+		supportedTypes[i] = sondespec_t(radiosonde::Registry::names[i], radiosonde::Registry::bandwidths[i], registered[i]);
+	}
+	supportedTypes[radiosonde::Registry::count] = sondespec_t("Auto", radiosonde::Registry::maxBandwidth(), &autoDecoder);
+
 	bool created = false;
 	int typeToSelect;
-	std::string gpxPath, ptuPath;
+	std::string gpxPath, ptuPath, logPath, channels, metricsPath, host, capturePath, uploadPath, uploaderName, spoolPath;
 
 	this->name = name;
 	selectedType = -1;
@@ -40,38 +54,175 @@ RadiosondeDecoderModule::RadiosondeDecoderModule(std::string name)
 	if (!config.conf.contains(name)) {
 		config.conf[name]["gpxPath"] = getTempFile("radiosonde.gpx");
 		config.conf[name]["ptuPath"] = getTempFile("radiosonde_ptu.csv");
-		config.conf[name]["sondeType"] = 0;
+		config.conf[name]["sondeType"] = std::get<0>(supportedTypes[0]);
+		created = true;
+	}
+	if (!config.conf[name].contains("flushInterval")) {
+		config.conf[name]["flushInterval"] = 1000;
+		config.conf[name]["durability"] = (int)OutputWorker::DURABILITY_FLUSH;
+		created = true;
+	}
+	if (!config.conf[name].contains("burstAltitude")) {
+		config.conf[name]["burstAltitude"] = 30000;
+		created = true;
+	}
+	if (!config.conf[name].contains("logPath")) {
+		config.conf[name]["logPath"] = getTempFile("radiosonde_flight.rslog");
+		created = true;
+	}
+	if (!config.conf[name].contains("channels")) {
+		config.conf[name]["channels"] = "";
+		created = true;
+	}
+	if (!config.conf[name].contains("scan")) {
+		config.conf[name]["scan"] = false;
+		config.conf[name]["scanStart"] = 400.0;
+		config.conf[name]["scanEnd"] = 406.0;
+		config.conf[name]["scanThreshold"] = 6.0f;
+		created = true;
+	}
+	if (!config.conf[name].contains("metricsPath")) {
+		config.conf[name]["metricsPath"] = getTempFile("radiosonde_metrics.json");
+		config.conf[name]["metricsDump"] = false;
+		config.conf[name]["metricsInterval"] = 10;
+		created = true;
+	}
+	if (!config.conf[name].contains("netHost")) {
+		config.conf[name]["netOutput"] = false;
+		config.conf[name]["netHost"] = "127.0.0.1";
+		config.conf[name]["netPort"] = 5371;
+		config.conf[name]["netProtocol"] = (int)NetSink::PROTOCOL_UDP;
+		config.conf[name]["netFormat"] = (int)NetSink::FORMAT_JSON;
+		created = true;
+	}
+	if (!config.conf[name].contains("squelch")) {
+		config.conf[name]["squelch"] = false;
+		config.conf[name]["squelchLevel"] = 1.0f;
+		created = true;
+	}
+	if (!config.conf[name].contains("mergeOutput")) {
+		config.conf[name]["mergeOutput"] = false;
+		created = true;
+	}
+	if (!config.conf[name].contains("capture")) {
+		config.conf[name]["capture"] = false;
+		config.conf[name]["captureLength"] = 60;
+		config.conf[name]["capturePath"] = getTempFile("radiosonde_capture");
+		config.conf[name]["captureOnSerial"] = true;
+		config.conf[name]["captureOnGap"] = true;
+		created = true;
+	}
+	if (!config.conf[name].contains("upload")) {
+		config.conf[name]["upload"] = false;
+		config.conf[name]["uploadUrl"] = "http://127.0.0.1:8080/telemetry";
+		config.conf[name]["uploadName"] = name;
+		config.conf[name]["uploadWindow"] = 2;
+		config.conf[name]["uploadCompress"] = true;
+		config.conf[name]["uploadSpool"] = getTempFile("radiosonde_spool");
 		created = true;
 	}
 	gpxPath = config.conf[name]["gpxPath"];
 	ptuPath = config.conf[name]["ptuPath"];
-	typeToSelect = config.conf[name]["sondeType"];
+	logPath = config.conf[name]["logPath"];
+	channels = config.conf[name]["channels"];
+	scan = config.conf[name]["scan"];
+	scanStart = config.conf[name]["scanStart"];
+	scanEnd = config.conf[name]["scanEnd"];
+	scanThreshold = config.conf[name]["scanThreshold"];
+	if (config.conf[name]["sondeType"].is_string()) {
+		typeToSelect = findType(config.conf[name]["sondeType"].get<std::string>().c_str());
+	} else {
+		/* Older versions saved an index into the full list of types */
+		static const char *legacyTypes[] = {"RS41", "DFM06/09", "iMS100/RS-11G", "M10/M20", "iMet-4", "SRS-C50",
+		                                    "MRZ-N1", "Auto"};
+		const int legacy = config.conf[name]["sondeType"];
+		typeToSelect = legacy >= 0 && legacy < (int)LEN(legacyTypes) ? findType(legacyTypes[legacy]) : -1;
+	}
+	if (typeToSelect < 0) typeToSelect = LEN(supportedTypes) - 1;     /* Not built in: try the others */
+	flushInterval = config.conf[name]["flushInterval"];
+	durability = config.conf[name]["durability"];
+	burstAltitude = config.conf[name]["burstAltitude"];
+	metricsPath = config.conf[name]["metricsPath"];
+	metricsDump = config.conf[name]["metricsDump"];
+	metricsInterval = config.conf[name]["metricsInterval"];
+	netOutput = config.conf[name]["netOutput"];
+	host = config.conf[name]["netHost"];
+	netPort = config.conf[name]["netPort"];
+	netProtocol = config.conf[name]["netProtocol"];
+	netFormat = config.conf[name]["netFormat"];
+	squelch = config.conf[name]["squelch"];
+	squelchLevel = config.conf[name]["squelchLevel"];
+	mergeOutput = config.conf[name]["mergeOutput"];
+	captureEnabled = config.conf[name]["capture"].get<bool>();
+	captureLength = config.conf[name]["captureLength"];
+	capturePath = config.conf[name]["capturePath"];
+	captureOnSerial = config.conf[name]["captureOnSerial"].get<bool>();
+	captureOnGap = config.conf[name]["captureOnGap"].get<bool>();
+	uploadEnabled = config.conf[name]["upload"];
+	uploadWindow = config.conf[name]["uploadWindow"];
+	uploadCompress = config.conf[name]["uploadCompress"];
+	uploadPath = config.conf[name]["uploadUrl"];
+	uploaderName = config.conf[name]["uploadName"];
+	spoolPath = config.conf[name]["uploadSpool"];
 	config.release(created);
 
+	outputWorker.setFlushInterval(flushInterval);
+	outputWorker.setDurability((OutputWorker::Durability)durability);
+	outputWorker.setBurstAltitude(burstAltitude);
+	outputWorker.setMetrics(&metrics);
+	metrics.read(&metricsCur);
+	metricsPrev = metricsCur;
+
 	strncpy(gpxFilename, gpxPath.c_str(), sizeof(gpxFilename)-1);
 	strncpy(ptuFilename, ptuPath.c_str(), sizeof(ptuFilename)-1);
+	strncpy(logFilename, logPath.c_str(), sizeof(logFilename)-1);
+	strncpy(channelList, channels.c_str(), sizeof(channelList)-1);
+	strncpy(metricsFilename, metricsPath.c_str(), sizeof(metricsFilename)-1);
+	strncpy(netHost, host.c_str(), sizeof(netHost)-1);
+	strncpy(captureFilename, capturePath.c_str(), sizeof(captureFilename)-1);
+	capturePrefix = capturePath;
+	strncpy(uploadUrl, uploadPath.c_str(), sizeof(uploadUrl)-1);
+	strncpy(uploadName, uploaderName.c_str(), sizeof(uploadName)-1);
+	strncpy(uploadSpool, spoolPath.c_str(), sizeof(uploadSpool)-1);
+	if (uploadEnabled) uploadEnabled = uploader.start(uploadUrl, uploadName, uploadSpool, uploadWindow * 1000, uploadCompress);
+	if (netOutput) netOutput = netSink.start((NetSink::Protocol)netProtocol, netHost, netPort, (NetSink::Format)netFormat);
+	if (mergeOutput) {
+		mergeSource = FrameMerger::instance().attach(name, mergedDataHandler, this);
+		mergeOutput = mergeSource >= 0;
+	}
 
 	bw = std::get<1>(supportedTypes[typeToSelect]);
 	vfo = sigpath::vfoManager.createVFO(name, ImGui::WaterfallVFO::REF_CENTER, 0, bw, bw, bw, bw, true);
 	vfo->setSnapInterval(SNAP_INTERVAL);
-	fmDemod.init(vfo->output, bw, bw/2.0f, false);
+	fmDemod.init(vfo->output, bw, bw/2.0f, bw);
+	fmDemod.setSquelch(squelch, squelchLevel);
+	if (captureEnabled) {
+		capture.configure(captureLength, bw);
+		fmDemod.setCapture(&capture);
+	}
+	for (auto& type : supportedTypes) {
+		FMResampler::prepare(std::max((int)std::get<1>(type), DECODER_SAMPLE_RATE), DECODER_SAMPLE_RATE);
+	}
 
-	/* Resampler to 48kHz */
-	resampler.init(&fmDemod.out, bw, OUT_SAMPLE_RATE);
+	radiosonde::Registry::init(decoders, &fmDemod.out, DECODER_SAMPLE_RATE, sondeDataHandler, this);
+	for (auto& type : supportedTypes) std::get<2>(type)->setClock(&fmDemod.clock());
 
-	dfm09decoder.init(&resampler.out, OUT_SAMPLE_RATE, sondeDataHandler, this);
-	c50decoder.init(&resampler.out, OUT_SAMPLE_RATE, sondeDataHandler, this);
-	imet4decoder.init(&resampler.out, OUT_SAMPLE_RATE, sondeDataHandler, this);
-	ims100decoder.init(&resampler.out, OUT_SAMPLE_RATE, sondeDataHandler, this);
-	m10decoder.init(&resampler.out, OUT_SAMPLE_RATE, sondeDataHandler, this);
-	mrzn1decoder.init(&resampler.out, OUT_SAMPLE_RATE, sondeDataHandler, this);
-	rs41decoder.init(&resampler.out, OUT_SAMPLE_RATE, sondeDataHandler, this);
+	/* Same order as supportedTypes, so that the locked index maps to a type */
+	autoDecoder.init(&fmDemod.out, DECODER_SAMPLE_RATE, registered.data(), registered.size());
+	autoDecoder.setMetrics(&metrics);
+	channelizer.init(NULL);
+	channelizer.setMetrics(&metrics);
+	channelizer.setSquelch(squelch, squelchLevel);
+	if (metricsDump) metricsDumper.start(&metrics, name, metricsFilename, metricsInterval * 1000);
 
 	fmDemod.start();
-	resampler.start();
 	onTypeSelected(this, typeToSelect);
+	multiChannel = startChannels();
 	enabled = true;
 
+	retuneHandler.handler = onSourceRetuned;
+	retuneHandler.ctx = this;
+	sigpath::sourceManager.onRetune.bindHandler(&retuneHandler);
 	gui::menu.registerEntry(name, menuHandler, this, this);
 }
 
@@ -82,32 +233,41 @@ RadiosondeDecoderModule::~RadiosondeDecoderModule()
 		sigpath::vfoManager.deleteVFO(vfo);
 		vfo = NULL;
 	}
+	if (mergeSource >= 0) FrameMerger::instance().detach(mergeSource);
+	sigpath::sourceManager.onRetune.unbindHandler(&retuneHandler);
 	gui::menu.removeEntry(name);
 }
 
 void
 RadiosondeDecoderModule::enable() {
 	/* Make a new VFO, wire it into the DSP path, then start the appropriate decoder */
+	if (multiChannel && startChannels()) {
+		enabled = true;
+		return;
+	}
+	multiChannel = false;
 	onTypeSelected(this, selectedType);
 
 	fmDemod.start();
-	resampler.start();
 	enabled = true;
 }
 
 void
 RadiosondeDecoderModule::disable() {
-	if (activeDecoder) activeDecoder->stop();
+	if (activeDecoder) {
+		activeDecoder->stop();
+		activeDecoder->release();
+	}
 	activeDecoder = NULL;
 
 	fmDemod.stop();
-	resampler.stop();
+	stopChannels();
 
 	if (vfo) sigpath::vfoManager.deleteVFO(vfo);
 	vfo = NULL;
 
-	gpxWriter.stopTrack();
-	lastData.init();
+	outputWorker.stopTrack();
+	clearSnapshot();
 	enabled = false;
 }
 
@@ -121,21 +281,268 @@ RadiosondeDecoderModule::postInit() {
 }
 
 /* Private methods {{{*/
+/**
+ * Replace the single-channel DSP path with a wide VFO feeding one decoder lane
+ * per frequency in the channel list, or a pool of lanes handed out by the
+ * scanner in scan mode. Returns false, leaving everything as is, if neither
+ * is configured, or if the channels don't fit in the band the source is tuned
+ * to (see channelError). The scan range is narrowed to that band instead.
+ */
+bool
+RadiosondeDecoderModule::startChannels()
+{
+	std::vector<double> freqs = parse_channels(channelList);
+	const int type = scan ? IM_ARRAYSIZE(supportedTypes) - 1 : selectedType;     /* Scanner lanes try every type */
+	const double srcCenter = gui::waterfall.getCenterFrequency();
+	const double srcBw = gui::waterfall.getBandwidth();
+	double bw, lo, hi, mid, wideBw, wideRate, laneRate;
+	int decimation;
+
+	channelError[0] = '\0';
+	if (freqs.empty() && !scan) return false;
+
+	/* Pick a wide VFO covering all the channels, with a sample rate that is a
+	 * power-of-two multiple of a lane rate slightly above the bandwidth, and
+	 * no lower than the decoder rate, which the lanes resample to */
+	bw = std::get<1>(supportedTypes[type]);
+	if (scan) {
+		lo = std::min(scanStart, scanEnd) * 1e6;
+		hi = std::max(scanStart, scanEnd) * 1e6;
+		if (srcBw > 0) {
+			lo = std::max(lo, srcCenter - (srcBw - bw) / 2);
+			hi = std::min(hi, srcCenter + (srcBw - bw) / 2);
+		}
+		if (hi <= lo) {
+			snprintf(channelError, sizeof(channelError), "Scan range outside the source band (%.3f-%.3f MHz)",
+			         (srcCenter - srcBw / 2) / 1e6, (srcCenter + srcBw / 2) / 1e6);
+			return false;
+		}
+	} else {
+		lo = *std::min_element(freqs.begin(), freqs.end());
+		hi = *std::max_element(freqs.begin(), freqs.end());
+		if (srcBw > 0 && (lo - bw / 2 < srcCenter - srcBw / 2 || hi + bw / 2 > srcCenter + srcBw / 2)) {
+			snprintf(channelError, sizeof(channelError), "Channels outside the source band (%.3f-%.3f MHz)",
+			         (srcCenter - srcBw / 2) / 1e6, (srcCenter + srcBw / 2) / 1e6);
+			return false;
+		}
+	}
+	mid = (lo + hi) / 2;
+	wideBw = hi - lo + bw;
+
+	/* Tear down the single-channel path */
+	if (activeDecoder) {
+		activeDecoder->stop();
+		activeDecoder->release();
+	}
+	activeDecoder = NULL;
+	fmDemod.stop();
+	if (vfo) sigpath::vfoManager.deleteVFO(vfo);
+	clearSnapshot();
+	laneRate = std::max((double)LANE_OVERSAMPLING * bw, (double)DECODER_SAMPLE_RATE);
+	for (decimation = 1; wideBw / (2 * decimation) >= laneRate; decimation *= 2);
+	wideRate = ceil(std::max(wideBw, laneRate * decimation) / decimation) * decimation;
+
+
+	vfo = sigpath::vfoManager.createVFO(name, ImGui::WaterfallVFO::REF_CENTER, mid - srcCenter,
+	                                    wideBw, wideRate, wideBw, wideBw, true);
+	channelCenter = mid;
+	channelBandwidth = wideBw;
+
+	channelizer.configure(wideRate, decimation, bw, DECODER_SAMPLE_RATE);
+	if (scan) {
+		/* Preallocate the whole pool: lanes are only retuned from then on */
+		channelizer.setScan(true, (hi - lo) / 2, scanThreshold, SCAN_TIMEOUT);
+		freqs.assign(SCAN_LANES, mid);
+	}
+	for (double freq : freqs) {
+		ChannelLane *lane = new ChannelLane();
+		lane->module = this;
+		lane->frequency = freq;
+		lane->type = type;
+		snprintf(lane->freqLabel, sizeof(lane->freqLabel), "%.3f", freq / 1e6);
+		createLaneDecoder(lane, DECODER_SAMPLE_RATE);
+
+		channelizer.addLane(freq - mid, lane->decoder);
+		lanes.push_back(lane);
+	}
+
+	channelizer.setInput(vfo->output);
+	channelizer.start();
+	return true;
+}
+
+/**
+ * Look up a sonde type by name
+ *
+ * @return index into supportedTypes, -1 if there is no such type in this build
+ */
+int
+RadiosondeDecoderModule::findType(const char *typeName) const
+{
+	for (int i=0; i<(int)LEN(supportedTypes); i++) {
+		if (!strcmp(std::get<0>(supportedTypes[i]), typeName)) return i;
+	}
+	return -1;
+}
+
+/**
+ * Stop all the decoder lanes and delete the wide VFO
+ */
+void
+RadiosondeDecoderModule::stopChannels()
+{
+	if (lanes.empty()) return;
+
+	channelizer.stop();
+	channelizer.clearLanes();
+	for (auto lane : lanes) delete lane;
+	lanes.clear();
+
+	if (vfo) sigpath::vfoManager.deleteVFO(vfo);
+	vfo = NULL;
+}
+
+/**
+ * Instantiate the decoder(s) for a lane, based on its sonde type
+ */
+void
+RadiosondeDecoderModule::createLaneDecoder(ChannelLane *lane, int samplerate)
+{
+	const auto& factories = radiosonde::Registry::factories;
+
+	if (std::get<2>(supportedTypes[lane->type]) == &autoDecoder) {
+		/* Lanes already run in parallel, no need for more threads */
+		for (auto factory : factories) lane->owned.push_back(factory(samplerate, laneDataHandler, lane));
+		lane->autoDecoder.init(NULL, samplerate, lane->owned.data(), lane->owned.size(), 0);
+		lane->decoder = &lane->autoDecoder;
+	} else {
+		lane->owned.push_back(factories[lane->type](samplerate, laneDataHandler, lane));
+		lane->decoder = lane->owned[0];
+	}
+	lane->decoder->setMetrics(&metrics);
+}
+
+/**
+ * Add up the parser contexts held by this instance, and the memory allocated
+ * for them
+ */
+void
+RadiosondeDecoderModule::decoderMemory(int *contexts, size_t *memory)
+{
+	*contexts = 0;
+	*memory = 0;
+
+	/* The auto decoder only forwards to these */
+	for (auto& type : supportedTypes) {
+		radiosonde::DecoderBase *decoder = std::get<2>(type);
+		if (decoder == &autoDecoder) continue;
+		*contexts += decoder->contexts();
+		*memory += decoder->memoryUsage();
+	}
+	for (auto lane : lanes) {
+		*contexts += lane->decoder->contexts();
+		*memory += lane->decoder->memoryUsage();
+	}
+}
+
+/**
+ * Dump the capture ring when the decoded stream looks odd: a different sonde
+ * showing up, or frames resuming after a gap. Called on the DSP thread.
+ */
+void
+RadiosondeDecoderModule::checkCaptureTriggers(const SondeFullData *data)
+{
+	if (captureOnGap && captureLastFrame && data->rxMonotonic - captureLastFrame > CAPTURE_GAP_SEC * 1000000LL) {
+		dumpCapture("gap");
+	} else if (captureOnSerial && data->serial[0] && captureSerial[0]
+	           && strncmp(data->serial, captureSerial, sizeof(captureSerial))) {
+		dumpCapture("serial");
+	}
+
+	if (data->serial[0]) strncpy(captureSerial, data->serial, sizeof(captureSerial)-1);
+	captureLastFrame = data->rxMonotonic;
+}
+
+/**
+ * Queue a dump of the capture ring to <prefix>_<UTC date>_<time>_<reason>.wav.
+ * Never waits for the file to be written.
+ */
+bool
+RadiosondeDecoderModule::dumpCapture(const char *reason)
+{
+	const time_t now = time(NULL);
+	char suffix[64];
+	struct tm tm;
+
+#ifdef _WIN32
+	gmtime_s(&tm, &now);
+#else
+	gmtime_r(&now, &tm);
+#endif
+	strftime(suffix, sizeof(suffix), "_%Y%m%d_%H%M%S_", &tm);
+
+	std::lock_guard<std::mutex> lck(captureMtx);
+	return capture.requestDump(capturePrefix + suffix + reason + ".wav");
+}
+
+void
+RadiosondeDecoderModule::clearSnapshot()
+{
+	/* Only valid while no decoder is running, since the triple buffer only
+	 * supports a single producer */
+	snapshot.writeBuffer().init();
+	snapshot.publish();
+}
+
 void
 RadiosondeDecoderModule::menuHandler(void *ctx)
 {
 	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
 	const ImVec2 wh = ImGui::GetContentRegionAvail();
 	const float width = wh.x;
-	char time[64];
-	bool gpxStatusChanged, ptuStatusChanged;
+	const SondeFullData& data = _this->snapshot.read();
+	LandingPredictor::Prediction landing;
+	char landingSerial[SONDE_SERIAL_LEN];
+	bool gpxStatusChanged, ptuStatusChanged, logStatusChanged, netStatusChanged, uploadStatusChanged, scanChanged;
+	int autoLocked;
 
 	if (!_this->enabled) style::beginDisabled();
 
+	/* Widget IDs are scoped to the instance here, instead of each carrying the
+	 * instance name */
+	ImGui::PushID(_this->name.c_str());
+
+	/* Everything displayed is formatted once per received frame or landing
+	 * prediction, and reused by the redraws in between */
+	if (_this->outputWorker.prediction(&landing, landingSerial) &&
+	    (landing.time != _this->landing.time || landing.lat != _this->landing.lat || landing.lon != _this->landing.lon ||
+	     landing.phase != _this->landing.phase || strncmp(landingSerial, _this->landingSerial, SONDE_SERIAL_LEN))) {
+		_this->landing = landing;
+		strncpy(_this->landingSerial, landingSerial, SONDE_SERIAL_LEN);
+		_this->dataGeneration = UINT64_MAX;
+	}
+	if (_this->snapshot.generation() != _this->dataGeneration) {
+		_this->dataGeneration = _this->snapshot.generation();
+		_this->dataTable.format(data, _this->landing, _this->landingSerial);
+	}
+
 	/* Type combobox {{{ */
+	autoLocked = _this->activeDecoder == &_this->autoDecoder ? _this->autoDecoder.locked() : -1;
+	if (_this->selectedType != _this->typeLabelSelected || autoLocked != _this->typeLabelLocked) {
+		_this->typeLabelSelected = _this->selectedType;
+		_this->typeLabelLocked = autoLocked;
+		if (autoLocked >= 0) {
+			snprintf(_this->typeLabel, sizeof(typeLabel), "%s (%s)",
+			         std::get<0>(_this->supportedTypes[_this->selectedType]),
+			         std::get<0>(_this->supportedTypes[autoLocked]));
+		} else {
+			snprintf(_this->typeLabel, sizeof(typeLabel), "%s", std::get<0>(_this->supportedTypes[_this->selectedType]));
+		}
+	}
+
 	ImGui::LeftLabel("Type");
 	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
-	if (ImGui::BeginCombo(CONCAT("##_radiosonde_type_", _this->name), std::get<0>(_this->supportedTypes[_this->selectedType]))) {
+	if (ImGui::BeginCombo("##_radiosonde_type_", _this->typeLabel)) {
 		for (int i=0; i<IM_ARRAYSIZE(_this->supportedTypes); i++) {
 			const char *curItem = std::get<0>(_this->supportedTypes[i]);
 			bool selected = _this->selectedType == i;
@@ -150,184 +557,741 @@ RadiosondeDecoderModule::menuHandler(void *ctx)
 		ImGui::EndCombo();
 	}
 	/* }}} */
+	/* Channel list {{{ */
+	ImGui::LeftLabel("Channels (MHz)");
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	if (ImGui::InputText("##_radiosonde_channels_", _this->channelList, sizeof(channelList)-1,
+	                     ImGuiInputTextFlags_EnterReturnsTrue)) {
+		onChannelsChanged(ctx);
+	}
+	/* }}} */
+	/* Scanner {{{ */
+	scanChanged = ImGui::Checkbox("Scan (MHz)##_scan_", &_this->scan);
+	if (ImGui::IsItemHovered()) {
+		ImGui::SetTooltip("Decode every carrier found in this range, instead of the channel list");
+	}
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth((width - ImGui::GetCursorPosX()) / 2);
+	scanChanged |= ImGui::InputDouble("##_scan_start_", &_this->scanStart, 0, 0, "%.3f", ImGuiInputTextFlags_EnterReturnsTrue);
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	scanChanged |= ImGui::InputDouble("##_scan_end_", &_this->scanEnd, 0, 0, "%.3f", ImGuiInputTextFlags_EnterReturnsTrue);
+	ImGui::LeftLabel("Scan threshold (dB)");
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	scanChanged |= ImGui::InputFloat("##_scan_threshold_", &_this->scanThreshold, 1.0f, 3.0f, "%.1f",
+	                                 ImGuiInputTextFlags_EnterReturnsTrue);
+	if (scanChanged) onScanChanged(ctx);
+	if (_this->channelError[0]) {
+		ImGui::TextWrapped("%s", _this->channelError);
+	} else if (_this->multiChannel && _this->vfo) {
+		/* The wide VFO follows retunes, but may end up past the band edges */
+		const double srcBw = gui::waterfall.getBandwidth();
+		if (fabs(_this->channelCenter - gui::waterfall.getCenterFrequency()) + _this->channelBandwidth / 2 > srcBw / 2) {
+			ImGui::TextWrapped("Channels partly outside the source band");
+		}
+	}
+	/* }}} */
+	/* Carrier squelch {{{ */
+	if (ImGui::Checkbox("Squelch (dB)##_squelch_", &_this->squelch)) onSquelchChanged(ctx);
+	if (ImGui::IsItemHovered()) {
+		ImGui::SetTooltip("Pause demodulation and decoding while the estimated SNR is below this level");
+	}
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	if (ImGui::InputFloat("##_squelch_level_", &_this->squelchLevel, 0.5f, 2.0f, "%.1f")) onSquelchChanged(ctx);
+	if (_this->squelch && _this->multiChannel) {
+		ImGui::Text("Squelch: %d/%d channels open", _this->channelizer.openLanes(), _this->channelizer.laneCount());
+	} else if (_this->squelch) {
+		const CarrierSquelch& squelch = _this->fmDemod.squelch();
+		ImGui::Text("Squelch: %s, SNR %.1f dB", squelch.open() ? "open" : "closed", squelch.snr());
+	}
+	/* }}} */
+	/* Per-lane data display {{{ */
+	if (_this->multiChannel && ImGui::BeginTable("##radiosonde_lanes_", 5,
+	                                             ImGuiTableFlags_SizingFixedFit | ImGuiTableFlags_RowBg)) {
+		ImGui::TableSetupColumn("MHz");
+		ImGui::TableSetupColumn("Type");
+		ImGui::TableSetupColumn("Serial no.");
+		ImGui::TableSetupColumn("Frame");
+		ImGui::TableSetupColumn("Alt.");
+		ImGui::TableHeadersRow();
+
+		for (size_t i=0; i<_this->lanes.size(); i++) {
+			ChannelLane *lane = _this->lanes[i];
+			const SondeFullData& laneData = lane->snapshot.read();
+			bool stale = false;
+
+			/* Scanner lanes: only show the tuned ones, without what was
+			 * decoded before they were last retuned */
+			if (_this->scan) {
+				if (!_this->channelizer.laneActive(i)) continue;
+				if (_this->channelizer.laneAssignment(i) != lane->assignment) {
+					lane->assignment = _this->channelizer.laneAssignment(i);
+					lane->staleGeneration = lane->snapshot.generation();
+					lane->frequency = _this->channelCenter + _this->channelizer.laneOffset(i);
+					snprintf(lane->freqLabel, sizeof(lane->freqLabel), "%.3f", lane->frequency / 1e6);
+				}
+				stale = lane->snapshot.generation() == lane->staleGeneration;
+			}
+
+			if (lane->snapshot.generation() != lane->generation) {
+				lane->generation = lane->snapshot.generation();
+				snprintf(lane->seqLabel, sizeof(lane->seqLabel), "%d", laneData.seq);
+				snprintf(lane->altLabel, sizeof(lane->altLabel), "%.0fm", laneData.alt);
+			}
+
+			autoLocked = lane->decoder == &lane->autoDecoder ? lane->autoDecoder.locked() : lane->type;
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::TextUnformatted(lane->freqLabel);
+			ImGui::TableNextColumn();
+			ImGui::TextUnformatted(autoLocked >= 0 ? std::get<0>(_this->supportedTypes[autoLocked]) : "-");
+			ImGui::TableNextColumn();
+			ImGui::TextUnformatted(stale ? "-" : laneData.serial);
+			ImGui::TableNextColumn();
+			ImGui::TextUnformatted(stale ? "-" : lane->seqLabel);
+			ImGui::TableNextColumn();
+			ImGui::TextUnformatted(stale ? "-" : lane->altLabel);
+		}
+
+		ImGui::EndTable();
+	}
+	/* }}} */
 	/* Sonde data display {{{ */
 	ImGui::SetNextItemWidth(width);
-	if (ImGui::BeginTable(CONCAT("##radiosonde_data_", _this->name), 2, ImGuiTableFlags_SizingFixedFit)) {
-		ImGui::TableNextColumn();
-		ImGui::Text("Serial no.");
-		if (_this->enabled) {
+	if (!_this->multiChannel && ImGui::BeginTable("##radiosonde_data_", 2, ImGuiTableFlags_SizingFixedFit)) {
+		for (int i=0; i<_this->dataTable.count(); i++) {
+			const DataTable::Row& row = _this->dataTable.row(i);
+			const bool uncalibrated = (row.flags & DataTable::ROW_PTU) && !data.calibrated;
+
+			ImGui::TableNextRow();
 			ImGui::TableNextColumn();
-			ImGui::Text("%s", _this->lastData.serial.c_str());
-		}
+			ImGui::TextUnformatted(row.label);
+			if (!_this->enabled || !row.value[0]) continue;
 
-		ImGui::TableNextRow();
-		ImGui::TableNextColumn();
-		ImGui::Text("Frame no.");
-		if (_this->enabled) {
 			ImGui::TableNextColumn();
-			ImGui::Text("%d", _this->lastData.seq);
+			if (uncalibrated) ImGui::PushStyleColor(ImGuiCol_Text, UNCAL_COLOR);
+			ImGui::TextUnformatted(row.value);
+			if (uncalibrated) ImGui::PopStyleColor();
+			if (uncalibrated && ImGui::IsItemHovered()) {
+				ImGui::SetTooltip("Calibration data not yet complete (%.0f%%).", data.calib_percent);
+			} else if (row.tooltip && ImGui::IsItemHovered()) {
+				ImGui::SetTooltip("%s", row.tooltip);
+			}
+		}
+
+		ImGui::EndTable();
+	}
+
+	ImGui::LeftLabel("Burst alt. (m)");
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	if (ImGui::InputInt("##_burst_altitude_", &_this->burstAltitude, 500, 5000)) {
+		onBurstAltitudeChanged(ctx);
+	}
+	/* }}} */
+	/* GPX output file {{{ */
+	gpxStatusChanged = ImGui::Checkbox("GPX track##_gpx_track_", &_this->gpxOutput);
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	gpxStatusChanged |= ImGui::InputText("##_gpx_fname_", _this->gpxFilename, sizeof(gpxFilename)-1,
+	                                     ImGuiInputTextFlags_EnterReturnsTrue);
+	if (gpxStatusChanged) onGPXOutputChanged(ctx);
+	/* }}} */
+	/* Log output file {{{ */
+	ptuStatusChanged = ImGui::Checkbox("Log data##_ptu_log_", &_this->ptuOutput);
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	ptuStatusChanged |= ImGui::InputText("##_ptu_fname_", _this->ptuFilename, sizeof(ptuFilename)-1,
+	                                     ImGuiInputTextFlags_EnterReturnsTrue);
+	if (ptuStatusChanged) onPTUOutputChanged(ctx);
+	/* }}} */
+	/* Binary flight log {{{ */
+	logStatusChanged = ImGui::Checkbox("Flight log##_flight_log_", &_this->logOutput);
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	logStatusChanged |= ImGui::InputText("##_log_fname_", _this->logFilename, sizeof(logFilename)-1,
+	                                     ImGuiInputTextFlags_EnterReturnsTrue);
+	if (logStatusChanged) onLogOutputChanged(ctx);
+	if (!_this->logNotice.empty()) ImGui::TextWrapped("%s", _this->logNotice.c_str());
+	/* }}} */
+	/* Output thread settings {{{ */
+	ImGui::LeftLabel("Flush every (ms)");
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	if (ImGui::InputInt("##_flush_interval_", &_this->flushInterval, 100, 1000)) {
+		if (_this->flushInterval < 0) _this->flushInterval = 0;
+		onOutputSettingsChanged(ctx);
+	}
+	ImGui::LeftLabel("Durability");
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	if (ImGui::Combo("##_durability_", &_this->durability, "Buffered\0Flush\0Sync to disk\0")) {
+		onOutputSettingsChanged(ctx);
+	}
+	ImGui::Text("Output queue: %zu/%zu, %lu dropped",
+	            _this->outputWorker.queueDepth(), _this->outputWorker.queueCapacity(), _this->outputWorker.dropped());
+	/* }}} */
+	/* Network output {{{ */
+	netStatusChanged = ImGui::Checkbox("Network##_net_output_", &_this->netOutput);
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	netStatusChanged |= ImGui::InputText("##_net_host_", _this->netHost, sizeof(netHost)-1,
+	                                     ImGuiInputTextFlags_EnterReturnsTrue);
+	ImGui::LeftLabel("Port");
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	netStatusChanged |= ImGui::InputInt("##_net_port_", &_this->netPort, 1, 100,
+	                                    ImGuiInputTextFlags_EnterReturnsTrue);
+	ImGui::LeftLabel("Protocol");
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	netStatusChanged |= ImGui::Combo("##_net_protocol_", &_this->netProtocol, "UDP\0TCP server\0");
+	ImGui::LeftLabel("Format");
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	netStatusChanged |= ImGui::Combo("##_net_format_", &_this->netFormat, "Binary\0JSON lines\0");
+	if (netStatusChanged) onNetOutputChanged(ctx);
+
+	if (_this->netSink.running()) {
+		ImGui::Text("Network: %lu sent, %lu dropped, %lu slow clients disconnected",
+		            _this->netSink.sent(), _this->netSink.dropped(), _this->netSink.kicked());
+		for (auto& client : _this->netSink.clients()) {
+			ImGui::BulletText("%s: %zu bytes behind", client.address.c_str(), client.backlog);
+		}
+	}
+	/* }}} */
+	/* HTTP upload {{{ */
+	uploadStatusChanged = ImGui::Checkbox("Upload##_upload_", &_this->uploadEnabled);
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	uploadStatusChanged |= ImGui::InputText("##_upload_url_", _this->uploadUrl, sizeof(uploadUrl)-1,
+	                                        ImGuiInputTextFlags_EnterReturnsTrue);
+	if (ImGui::IsItemHovered()) ImGui::SetTooltip("Endpoint the frames are POSTed to, http://host[:port]/path");
+	ImGui::LeftLabel("Uploader");
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	uploadStatusChanged |= ImGui::InputText("##_upload_name_", _this->uploadName, sizeof(uploadName)-1,
+	                                        ImGuiInputTextFlags_EnterReturnsTrue);
+	ImGui::LeftLabel("Batch every (s)");
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	if (ImGui::InputInt("##_upload_window_", &_this->uploadWindow, 1, 10, ImGuiInputTextFlags_EnterReturnsTrue)) {
+		_this->uploadWindow = std::clamp(_this->uploadWindow, 1, 600);
+		uploadStatusChanged = true;
+	}
+	ImGui::LeftLabel("Spool");
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	uploadStatusChanged |= ImGui::InputText("##_upload_spool_", _this->uploadSpool, sizeof(uploadSpool)-1,
+	                                        ImGuiInputTextFlags_EnterReturnsTrue);
+	if (ImGui::IsItemHovered()) ImGui::SetTooltip("Directory batches are kept in until they can be sent");
+	if (!HttpUploader::compressionAvailable()) style::beginDisabled();
+	uploadStatusChanged |= ImGui::Checkbox("Compress##_upload_compress_", &_this->uploadCompress);
+	if (!HttpUploader::compressionAvailable()) style::endDisabled();
+	if (uploadStatusChanged) onUploadChanged(ctx);
+
+	if (_this->uploader.running()) {
+		HttpUploader::Stats stats;
+
+		_this->uploader.stats(&stats);
+		ImGui::Text("Upload: %lu frames sent, %lu dropped, %lu failed attempts",
+		            stats.uploaded, stats.dropped, stats.failures);
+		if (std::isnan(stats.lag)) {
+			ImGui::Text("Queue: %zu frames, %zu batches spooled", stats.queued, stats.spooled);
+		} else {
+			ImGui::Text("Queue: %zu frames, %zu batches spooled, lag %.1fs", stats.queued, stats.spooled, stats.lag);
+		}
+		if (stats.status && (stats.status < 200 || stats.status >= 300)) {
+			ImGui::Text("Last upload rejected: HTTP %d", stats.status);
 		}
+	}
+	/* }}} */
+	/* Merge with other instances {{{ */
+	if (ImGui::Checkbox("Merge with other instances##_merge_output_", &_this->mergeOutput)) {
+		onMergeChanged(ctx);
+	}
+	if (ImGui::IsItemHovered()) {
+		ImGui::SetTooltip("Deduplicate the frames decoded by all the instances with this option on, "
+		                  "and send them to the outputs of the first one only");
+	}
+	if (_this->mergeSource >= 0) {
+		FrameMerger& merger = FrameMerger::instance();
 
-		ImGui::TableNextRow();
-		ImGui::TableNextColumn();
-		ImGui::Text("Onboard time");
-		if (_this->enabled) {
-			if (strftime(time, sizeof(time), "%a %b %d %Y %H:%M:%S", gmtime(&_this->lastData.time))) {
+		if (PipelineMetrics::nowNs() / 1000 - _this->mergeStatsTime >= 1000000) {
+			_this->mergeFrames = merger.stats(&_this->mergeStats);
+			_this->mergeStatsTime = PipelineMetrics::nowNs() / 1000;
+		}
+		ImGui::Text("Merged: %lu frames, %lu duplicates dropped", merger.emitted(), merger.duplicates());
+		if (_this->mergeFrames && ImGui::BeginTable("##_merge_stats_", 4,
+		                                            ImGuiTableFlags_SizingFixedFit | ImGuiTableFlags_RowBg)) {
+			ImGui::TableSetupColumn("Instance");
+			ImGui::TableSetupColumn("Received");
+			ImGui::TableSetupColumn("Kept");
+			ImGui::TableSetupColumn("Only here");
+			ImGui::TableHeadersRow();
+
+			/* Percentages of the distinct frames in the merge window */
+			for (auto& source : _this->mergeStats) {
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::Text("%s%s", source.name.c_str(), source.writer ? " (output)" : "");
 				ImGui::TableNextColumn();
-				ImGui::Text("%s", time);
+				ImGui::Text("%.0f%%", 100.0f * source.received / _this->mergeFrames);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.0f%%", 100.0f * source.chosen / _this->mergeFrames);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.0f%%", 100.0f * source.exclusive / _this->mergeFrames);
 			}
+			ImGui::EndTable();
 		}
+	}
+	/* }}} */
+	/* Flight history {{{ */
+	if (ImGui::CollapsingHeader("Flight history##_history_")) {
+		char serials[HISTORY_TRACKS][SONDE_SERIAL_LEN];
+		const int count = _this->history.serials(serials, HISTORY_TRACKS);
+		int selected = 0;
 
-		ImGui::TableNextRow();
-		ImGui::TableNextColumn();
-		ImGui::Text(" ");
+		/* Follow the most recent sonde, unless another one was picked */
+		for (int i=0; i<count; i++) {
+			if (!strncmp(serials[i], _this->historySerial, SONDE_SERIAL_LEN)) selected = i;
+		}
 
-		ImGui::TableNextRow();
-		ImGui::TableNextColumn();
-		ImGui::Text("Latitude");
-		if (_this->enabled) {
-			ImGui::TableNextColumn();
-			ImGui::Text("%8.5f%c", fabs(_this->lastData.lat), (_this->lastData.lat >= 0 ? 'N' : 'S'));
+		ImGui::LeftLabel("Serial no.");
+		ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+		if (ImGui::BeginCombo("##_history_serial_", count ? serials[selected] : "")) {
+			for (int i=0; i<count; i++) {
+				if (ImGui::Selectable(serials[i], i == selected)) {
+					strncpy(_this->historySerial, serials[i], SONDE_SERIAL_LEN);
+					selected = i;
+				}
+			}
+			ImGui::EndCombo();
 		}
 
-		ImGui::TableNextRow();
-		ImGui::TableNextColumn();
-		ImGui::Text("Longitude");
-		if (_this->enabled) {
-			ImGui::TableNextColumn();
-			ImGui::Text("%8.5f%c", fabs(_this->lastData.lon), (_this->lastData.lon >= 0 ? 'E' : 'W'));
+		if (count && _this->history.query(serials[selected], (size_t)std::max(1.0f, width), &_this->historySeries)) {
+			const FlightHistory::Series& series = _this->historySeries;
+			ImDrawList *draw = ImGui::GetWindowDrawList();
+			ImVec2 p0;
+
+			ImGui::Text("Altitude, %.0f-%.0fm", series.lo[FlightHistory::COL_ALT], series.hi[FlightHistory::COL_ALT]);
+			p0 = ImGui::GetCursorScreenPos();
+			ImGui::Dummy(ImVec2(width, PLOT_HEIGHT));
+			draw_history(draw, p0, ImVec2(p0.x + width, p0.y + PLOT_HEIGHT), series, -1, FlightHistory::COL_ALT, PLOT_ALT_COLOR);
+
+			ImGui::Text("Temperature %.0f-%.0f°C, humidity vs. altitude",
+			            series.lo[FlightHistory::COL_TEMP], series.hi[FlightHistory::COL_TEMP]);
+			p0 = ImGui::GetCursorScreenPos();
+			ImGui::Dummy(ImVec2(width, PLOT_HEIGHT));
+			draw_history(draw, p0, ImVec2(p0.x + width, p0.y + PLOT_HEIGHT), series,
+			             FlightHistory::COL_RH, FlightHistory::COL_ALT, PLOT_RH_COLOR);
+			draw_history(draw, p0, ImVec2(p0.x + width, p0.y + PLOT_HEIGHT), series,
+			             FlightHistory::COL_TEMP, FlightHistory::COL_ALT, PLOT_TEMP_COLOR);
+
+			ImGui::TextUnformatted("Track");
+			p0 = ImGui::GetCursorScreenPos();
+			ImGui::Dummy(ImVec2(width, PLOT_HEIGHT));
+			draw_history(draw, p0, ImVec2(p0.x + width, p0.y + PLOT_HEIGHT), series,
+			             FlightHistory::COL_LON, FlightHistory::COL_LAT, PLOT_ALT_COLOR);
+
+			ImGui::Text("%zu samples (%d frames each), %.1f of %.1fMB in use", series.samples, series.stride,
+			            _this->history.memoryUsage() / 1e6, _this->history.memoryCeiling() / 1e6);
 		}
 
-		ImGui::TableNextRow();
-		ImGui::TableNextColumn();
-		ImGui::Text("Altitude");
-		if (_this->enabled) {
-			ImGui::TableNextColumn();
-			ImGui::Text("%.1fm", _this->lastData.alt);
+		if (ImGui::Button("Clear##_history_clear_")) {
+			_this->history.clear();
 		}
+	}
+	/* }}} */
+	/* Capture ring {{{ */
+	if (ImGui::CollapsingHeader("Capture##_capture_")) {
+		/* The DSP thread reads the flags, so edit copies of them */
+		bool captureEnabled = _this->captureEnabled, captureOnSerial = _this->captureOnSerial;
+		bool captureOnGap = _this->captureOnGap;
 
-		ImGui::TableNextRow();
-		ImGui::TableNextColumn();
-		ImGui::Text("Speed");
-		if (_this->enabled) {
-			ImGui::TableNextColumn();
-			ImGui::Text("%.1fm/s", _this->lastData.spd);
+		if (ImGui::Checkbox("Keep last (s)##_capture_", &captureEnabled)) {
+			_this->captureEnabled = captureEnabled;
+			onCaptureChanged(ctx);
+		}
+		if (ImGui::IsItemHovered()) {
+			ImGui::SetTooltip("Keep the demodulated signal in memory, so that it can be saved as a WAV file\n"
+			                  "and replayed with radiosonde_replay");
+		}
+		ImGui::SameLine();
+		ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+		if (ImGui::InputInt("##_capture_length_", &_this->captureLength, 10, 60, ImGuiInputTextFlags_EnterReturnsTrue)) {
+			_this->captureLength = std::max(1, std::min(_this->captureLength, 3600));
+			onCaptureChanged(ctx);
+		}
+		ImGui::LeftLabel("Prefix");
+		ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+		if (ImGui::InputText("##_capture_fname_", _this->captureFilename, sizeof(captureFilename)-1,
+		                     ImGuiInputTextFlags_EnterReturnsTrue)) {
+			onCaptureChanged(ctx);
+		}
+		if (ImGui::Checkbox("On serial change##_capture_serial_", &captureOnSerial)) {
+			_this->captureOnSerial = captureOnSerial;
+			onCaptureChanged(ctx);
+		}
+		ImGui::SameLine();
+		if (ImGui::Checkbox("On decode gap##_capture_gap_", &captureOnGap)) {
+			_this->captureOnGap = captureOnGap;
+			onCaptureChanged(ctx);
 		}
 
-		ImGui::TableNextRow();
-		ImGui::TableNextColumn();
-		ImGui::Text("Heading");
-		if (_this->enabled) {
-			ImGui::TableNextColumn();
-			ImGui::Text("%.0f°", _this->lastData.hdg);
+		/* Nothing feeds the ring in multi-channel mode, it only holds stale signal */
+		const bool canDump = _this->captureEnabled && !_this->multiChannel;
+		if (!canDump) style::beginDisabled();
+		if (ImGui::Button("Dump now##_capture_dump_")) _this->dumpCapture("manual");
+		if (!canDump) style::endDisabled();
+
+		if (_this->captureEnabled && _this->multiChannel) {
+			ImGui::TextUnformatted("Not available in multi-channel mode");
+		} else if (_this->capture.dumps() || _this->capture.failures()) {
+			ImGui::Text("%u dump%s, %u failed", _this->capture.dumps(), _this->capture.dumps() == 1 ? "" : "s",
+			            _this->capture.failures());
+			if (_this->capture.dumps()) ImGui::TextWrapped("Last: %s", _this->capture.lastDump().c_str());
 		}
+	}
+	/* }}} */
+	/* Pipeline metrics {{{ */
+	if (ImGui::CollapsingHeader("Pipeline metrics##_metrics_")) {
+		const MetricsSnapshot& cur = _this->metricsCur;
+		const MetricsSnapshot& prev = _this->metricsPrev;
+		double dt;
+		uint64_t fragments, written;
+		size_t memory;
+		int contexts;
 
-		ImGui::TableNextRow();
-		ImGui::TableNextColumn();
-		ImGui::Text("Climb");
-		if (_this->enabled) {
-			ImGui::TableNextColumn();
-			ImGui::Text("%.1fm/s", _this->lastData.climb);
+		if (PipelineMetrics::nowNs() / 1000 - cur.time >= 1000000) {
+			_this->metricsPrev = _this->metricsCur;
+			_this->metrics.read(&_this->metricsCur);
 		}
+		dt = std::max<int64_t>(cur.time - prev.time, 1) * 1e-6;
+		fragments = cur.status[PARSED] - prev.status[PARSED];
+		written = cur.written - prev.written;
 
-		ImGui::TableNextRow();
-		ImGui::TableNextColumn();
-		ImGui::Text(" ");
+		if (ImGui::BeginTable("##radiosonde_metrics_", 2, ImGuiTableFlags_SizingFixedFit)) {
+			ImGui::TableNextColumn();
+			ImGui::Text("Samples/s");
+			ImGui::TableNextColumn();
+			ImGui::Text("%.0f", cur.rate(&MetricsSnapshot::samples, prev));
 
-		ImGui::TableNextRow();
-		ImGui::TableNextColumn();
-		ImGui::Text("Temperature");
-		if (_this->enabled) {
+			ImGui::TableNextRow();
 			ImGui::TableNextColumn();
-			if (!_this->lastData.calibrated) ImGui::PushStyleColor(ImGuiCol_Text, UNCAL_COLOR);
-			ImGui::Text("%.1f°C", _this->lastData.temp);
-			if (!_this->lastData.calibrated) ImGui::PopStyleColor();
-			if (!_this->lastData.calibrated && ImGui::IsItemHovered()) {
-				ImGui::SetTooltip("Calibration data not yet complete (%.0f%%).", _this->lastData.calib_percent);
-			}
-		}
+			ImGui::Text("Frames/s");
+			ImGui::TableNextColumn();
+			ImGui::Text("%.2f", cur.rate(&MetricsSnapshot::frames, prev));
 
-		ImGui::TableNextRow();
-		ImGui::TableNextColumn();
-		ImGui::Text("Humidity");
-		if (_this->enabled) {
+			ImGui::TableNextRow();
 			ImGui::TableNextColumn();
-			if (!_this->lastData.calibrated) ImGui::PushStyleColor(ImGuiCol_Text, UNCAL_COLOR);
-			ImGui::Text("%.1f%%", _this->lastData.rh);
-			if (!_this->lastData.calibrated) ImGui::PopStyleColor();
-			if (!_this->lastData.calibrated && ImGui::IsItemHovered()) {
-				ImGui::SetTooltip("Calibration data not yet complete (%.0f%%).", _this->lastData.calib_percent);
-			}
-		}
+			ImGui::Text("Parser calls");
+			ImGui::TableNextColumn();
+			ImGui::Text("%llu parsed, %llu proceed",
+			            (unsigned long long)cur.status[PARSED], (unsigned long long)cur.status[PROCEED]);
 
-		ImGui::TableNextRow();
-		ImGui::TableNextColumn();
-		ImGui::Text("Dew point");
-		if (_this->enabled) {
+			ImGui::TableNextRow();
 			ImGui::TableNextColumn();
-			if (!_this->lastData.calibrated) ImGui::PushStyleColor(ImGuiCol_Text, UNCAL_COLOR);
-			ImGui::Text("%.1f°C", _this->lastData.dewpt);
-			if (!_this->lastData.calibrated) ImGui::PopStyleColor();
-			if (!_this->lastData.calibrated && ImGui::IsItemHovered()) {
-				ImGui::SetTooltip("Calibration data not yet complete (%.0f%%).", _this->lastData.calib_percent);
-			}
-		}
+			ImGui::Text("Decoder load");
+			ImGui::TableNextColumn();
+			ImGui::Text("%.1f%%", (cur.decodeNs - prev.decodeNs) * 1e-7 / dt);
 
-		ImGui::TableNextRow();
-		ImGui::TableNextColumn();
-		ImGui::Text("Pressure");
-		if (_this->enabled) {
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::Text("Read wait");
 			ImGui::TableNextColumn();
-			if (!_this->lastData.calibrated) ImGui::PushStyleColor(ImGuiCol_Text, UNCAL_COLOR);
-			ImGui::Text("%.1fhPa", _this->lastData.pressure);
-			if (!_this->lastData.calibrated) ImGui::PopStyleColor();
-			if (!_this->lastData.calibrated && ImGui::IsItemHovered()) {
-				ImGui::SetTooltip("Calibration data not yet complete (%.0f%%).", _this->lastData.calib_percent);
+			ImGui::Text("%.1f%%", (cur.readWaitNs - prev.readWaitNs) * 1e-7 / dt);
+
+			for (int i=0; i<LATENCY_STAGE_COUNT; i++) {
+				const double p50 = cur.latencyPercentile(i, 0.5), p99 = cur.latencyPercentile(i, 0.99);
+
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::Text("Latency: %s", metricsLatencyNames[i]);
+				ImGui::TableNextColumn();
+				if (std::isnan(p50)) {
+					ImGui::Text("-");
+				} else {
+					ImGui::Text("%.2fms p50, %.2fms p99", p50 * 1e-3, p99 * 1e-3);
+				}
 			}
-		}
 
-		ImGui::TableNextRow();
-		ImGui::TableNextColumn();
-		ImGui::Text("Aux. data");
-		if (_this->enabled) {
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::Text("Write latency");
+			ImGui::TableNextColumn();
+			ImGui::Text("%.1fms avg, %.1fms max",
+			            written ? (cur.latencyUs - prev.latencyUs) * 1e-3 / written : 0.0, cur.latencyMaxUs * 1e-3);
+
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::Text("Write time");
+			ImGui::TableNextColumn();
+			ImGui::Text("%.2fms/s", (cur.writeNs - prev.writeNs) * 1e-6 / dt);
+
+			ImGui::TableNextRow();
 			ImGui::TableNextColumn();
-			ImGui::Text("%s", _this->lastData.auxData.c_str());
+			ImGui::Text("Decoder memory");
+			ImGui::TableNextColumn();
+			_this->decoderMemory(&contexts, &memory);
+			ImGui::Text("%.1f KiB, %d context%s", memory / 1024.0, contexts, contexts == 1 ? "" : "s");
+
+			for (int i=0; i<METRICS_FIELD_COUNT; i++) {
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::Text("Field: %s", metricsFields[i].name);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.0f%%", fragments ? 100.0 * (cur.fields[i] - prev.fields[i]) / fragments : 0.0);
+			}
+
+			ImGui::EndTable();
 		}
 
-		ImGui::EndTable();
+		if (ImGui::Checkbox("Dump##_metrics_dump_", &_this->metricsDump)) {
+			onMetricsDumpChanged(ctx);
+		}
+		ImGui::SameLine();
+		ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+		if (ImGui::InputText("##_metrics_fname_", _this->metricsFilename, sizeof(metricsFilename)-1,
+		                     ImGuiInputTextFlags_EnterReturnsTrue)) {
+			onMetricsDumpChanged(ctx);
+		}
+		ImGui::LeftLabel("Dump every (s)");
+		ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+		if (ImGui::InputInt("##_metrics_interval_", &_this->metricsInterval, 1, 10)) {
+			if (_this->metricsInterval < 1) _this->metricsInterval = 1;
+			onMetricsDumpChanged(ctx);
+		}
 	}
 	/* }}} */
-	/* GPX output file {{{ */
-	gpxStatusChanged = ImGui::Checkbox(CONCAT("GPX track##_gpx_track_", _this->name), &_this->gpxOutput);
-	ImGui::SameLine();
-	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
-	gpxStatusChanged |= ImGui::InputText(CONCAT("##_gpx_fname_", _this->name), _this->gpxFilename, sizeof(gpxFilename)-1,
-	                                     ImGuiInputTextFlags_EnterReturnsTrue);
-	if (gpxStatusChanged) onGPXOutputChanged(ctx);
-	/* }}} */
-	/* Log output file {{{ */
-	ptuStatusChanged = ImGui::Checkbox(CONCAT("Log data##_ptu_log_", _this->name), &_this->ptuOutput);
-	ImGui::SameLine();
-	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
-	ptuStatusChanged |= ImGui::InputText(CONCAT("##_ptu_fname_", _this->name), _this->ptuFilename, sizeof(ptuFilename)-1,
-	                                     ImGuiInputTextFlags_EnterReturnsTrue);
-	if (ptuStatusChanged) onPTUOutputChanged(ctx);
-	/* }}} */
 
+	ImGui::PopID();
 	if (!_this->enabled) style::endDisabled();
 }
 
 void
-RadiosondeDecoderModule::sondeDataHandler(SondeFullData *data, void *ctx)
+RadiosondeDecoderModule::sondeDataHandler(const SondeFullData *data, void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+	_this->snapshot.writeBuffer() = *data;
+	_this->snapshot.publish();
+	_this->history.push(data);
+	if (_this->captureEnabled) _this->checkCaptureTriggers(data);
+
+	/* File and network I/O happen on their own threads */
+	const int mergeSource = _this->mergeSource;
+	if (mergeSource >= 0) {
+		FrameMerger::instance().publish(mergeSource, data);
+	} else {
+		_this->outputWorker.push(data);
+		_this->netSink.push(data);
+		_this->uploader.push(data);
+	}
+}
+
+void
+RadiosondeDecoderModule::laneDataHandler(const SondeFullData *data, void *ctx)
+{
+	ChannelLane *lane = (ChannelLane*)ctx;
+
+	/* Each lane has its own snapshot, since lanes are decoded concurrently */
+	lane->snapshot.writeBuffer() = *data;
+	lane->snapshot.publish();
+	lane->module->history.push(data);
+
+	const int mergeSource = lane->module->mergeSource;
+	if (mergeSource >= 0) {
+		FrameMerger::instance().publish(mergeSource, data);
+	} else {
+		lane->module->outputWorker.push(data);
+		lane->module->netSink.push(data);
+		lane->module->uploader.push(data);
+	}
+}
+
+/**
+ * Called by FrameMerger, on its own thread, with the deduplicated stream of
+ * all the instances, if this one is the writer
+ */
+void
+RadiosondeDecoderModule::mergedDataHandler(const SondeFullData *data, void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+
+	_this->outputWorker.push(data);
+	_this->netSink.push(data);
+	_this->uploader.push(data);
+}
+
+void
+RadiosondeDecoderModule::onMetricsDumpChanged(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+
+	if (_this->metricsDump) {
+		_this->metricsDumper.start(&_this->metrics, _this->name, _this->metricsFilename, _this->metricsInterval * 1000);
+	} else {
+		_this->metricsDumper.stop();
+	}
+
+	config.acquire();
+	config.conf[_this->name]["metricsDump"] = _this->metricsDump;
+	config.conf[_this->name]["metricsPath"] = std::string(_this->metricsFilename);
+	config.conf[_this->name]["metricsInterval"] = _this->metricsInterval;
+	config.release(true);
+}
+
+void
+RadiosondeDecoderModule::onNetOutputChanged(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+
+	if (_this->netOutput) {
+		_this->netOutput = _this->netSink.start((NetSink::Protocol)_this->netProtocol, _this->netHost, _this->netPort,
+		                                        (NetSink::Format)_this->netFormat);
+	} else {
+		_this->netSink.stop();
+	}
+
+	config.acquire();
+	config.conf[_this->name]["netOutput"] = _this->netOutput;
+	config.conf[_this->name]["netHost"] = std::string(_this->netHost);
+	config.conf[_this->name]["netPort"] = _this->netPort;
+	config.conf[_this->name]["netProtocol"] = _this->netProtocol;
+	config.conf[_this->name]["netFormat"] = _this->netFormat;
+	config.release(true);
+}
+
+void
+RadiosondeDecoderModule::onUploadChanged(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+
+	if (_this->uploadEnabled) {
+		_this->uploadEnabled = _this->uploader.start(_this->uploadUrl, _this->uploadName, _this->uploadSpool,
+		                                             _this->uploadWindow * 1000, _this->uploadCompress);
+	} else {
+		_this->uploader.stop();
+	}
+
+	config.acquire();
+	config.conf[_this->name]["upload"] = _this->uploadEnabled;
+	config.conf[_this->name]["uploadUrl"] = std::string(_this->uploadUrl);
+	config.conf[_this->name]["uploadName"] = std::string(_this->uploadName);
+	config.conf[_this->name]["uploadWindow"] = _this->uploadWindow;
+	config.conf[_this->name]["uploadCompress"] = _this->uploadCompress;
+	config.conf[_this->name]["uploadSpool"] = std::string(_this->uploadSpool);
+	config.release(true);
+}
+
+void
+RadiosondeDecoderModule::onSquelchChanged(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+
+	_this->fmDemod.setSquelch(_this->squelch, _this->squelchLevel);
+	_this->channelizer.setSquelch(_this->squelch, _this->squelchLevel);
+
+	config.acquire();
+	config.conf[_this->name]["squelch"] = _this->squelch;
+	config.conf[_this->name]["squelchLevel"] = _this->squelchLevel;
+	config.release(true);
+}
+
+void
+RadiosondeDecoderModule::onCaptureChanged(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+
+	/* Resizing drops the signal kept so far: only do it when the length
+	 * changes, while the demodulator isn't writing to the ring */
+	const double seconds = _this->captureEnabled ? _this->captureLength : 0;
+	if (seconds != _this->capture.seconds()) {
+		_this->fmDemod.setCapture(NULL);
+		_this->capture.configure(seconds, _this->capture.samplerate());
+		if (_this->captureEnabled) _this->fmDemod.setCapture(&_this->capture);
+	}
+
+	{
+		std::lock_guard<std::mutex> lck(_this->captureMtx);
+		_this->capturePrefix = _this->captureFilename;
+	}
+
+	config.acquire();
+	config.conf[_this->name]["capture"] = _this->captureEnabled.load();
+	config.conf[_this->name]["captureLength"] = _this->captureLength;
+	config.conf[_this->name]["capturePath"] = std::string(_this->captureFilename);
+	config.conf[_this->name]["captureOnSerial"] = _this->captureOnSerial.load();
+	config.conf[_this->name]["captureOnGap"] = _this->captureOnGap.load();
+	config.release(true);
+}
+
+void
+RadiosondeDecoderModule::onMergeChanged(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+
+	if (_this->mergeOutput && _this->mergeSource < 0) {
+		_this->mergeSource = FrameMerger::instance().attach(_this->name, mergedDataHandler, _this);
+		_this->mergeOutput = _this->mergeSource >= 0;
+	} else if (!_this->mergeOutput && _this->mergeSource >= 0) {
+		FrameMerger::instance().detach(_this->mergeSource);
+		_this->mergeSource = -1;
+	}
+	_this->mergeStatsTime = 0;
+
+	config.acquire();
+	config.conf[_this->name]["mergeOutput"] = _this->mergeOutput;
+	config.release(true);
+}
+
+void
+RadiosondeDecoderModule::onChannelsChanged(void *ctx)
 {
 	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
-	_this->lastData = *data;
 
-	if (data->serial != "") {
-		_this->gpxWriter.startTrack(data->serial.c_str());
+	config.acquire();
+	config.conf[_this->name]["channels"] = std::string(_this->channelList);
+	config.release(true);
+
+	if (!_this->enabled) {
+		_this->multiChannel = _this->scan || !parse_channels(_this->channelList).empty();
+		return;
+	}
+
+	/* Rebuild the lanes from scratch, falling back to the single-channel path
+	 * if the list is empty */
+	_this->stopChannels();
+	if (!(_this->multiChannel = _this->startChannels())) {
+		onTypeSelected(ctx, _this->selectedType);
 	}
-	_this->gpxWriter.addTrackPoint(data->time, data->lat, data->lon, data->alt, data->spd, data->hdg);
-	_this->ptuWriter.addPoint(data);
+}
+
+void
+RadiosondeDecoderModule::onScanChanged(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+
+	config.acquire();
+	config.conf[_this->name]["scan"] = _this->scan;
+	config.conf[_this->name]["scanStart"] = _this->scanStart;
+	config.conf[_this->name]["scanEnd"] = _this->scanEnd;
+	config.conf[_this->name]["scanThreshold"] = _this->scanThreshold;
+	config.release(true);
+
+	if (!_this->enabled) {
+		_this->multiChannel = _this->scan || !parse_channels(_this->channelList).empty();
+		return;
+	}
+
+	/* Same as a new channel list: rebuild the lanes from scratch */
+	_this->stopChannels();
+	if (!(_this->multiChannel = _this->startChannels())) {
+		onTypeSelected(ctx, _this->selectedType);
+	}
+}
+
+void
+RadiosondeDecoderModule::onSourceRetuned(double freq, void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+
+	/* The single-channel VFO follows the user, but the lanes of the wide VFO
+	 * are at fixed frequencies: keep it centered on them */
+	if (!_this->multiChannel || !_this->vfo) return;
+	_this->vfo->setOffset(_this->channelCenter - freq);
 }
 
 void
@@ -335,9 +1299,9 @@ RadiosondeDecoderModule::onGPXOutputChanged(void *ctx)
 {
 	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
 	if (_this->gpxOutput) {
-		_this->gpxOutput = _this->gpxWriter.init(_this->gpxFilename);
+		_this->gpxOutput = _this->outputWorker.openGPX(_this->gpxFilename);
 	} else {
-		_this->gpxWriter.deinit();
+		_this->outputWorker.closeGPX();
 	}
 
 	if (_this->gpxOutput) {
@@ -352,9 +1316,9 @@ RadiosondeDecoderModule::onPTUOutputChanged(void *ctx)
 {
 	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
 	if (_this->ptuOutput) {
-		_this->ptuOutput = _this->ptuWriter.init(_this->ptuFilename);
+		_this->ptuOutput = _this->outputWorker.openPTU(_this->ptuFilename);
 	} else {
-		_this->ptuWriter.deinit();
+		_this->outputWorker.closePTU();
 	}
 	if (_this->ptuOutput) {
 		config.acquire();
@@ -363,19 +1327,78 @@ RadiosondeDecoderModule::onPTUOutputChanged(void *ctx)
 	}
 }
 
+void
+RadiosondeDecoderModule::onLogOutputChanged(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+	_this->logNotice.clear();
+	if (_this->logOutput) {
+		_this->logOutput = _this->outputWorker.openLog(_this->logFilename);
+		if (!_this->logOutput) {
+			_this->logNotice = "Can't open the log, or move the file in the way aside";
+		} else if (!_this->outputWorker.logMovedAside().empty()) {
+			_this->logNotice = "Not a log of this version, moved to " + _this->outputWorker.logMovedAside();
+		}
+	} else {
+		_this->outputWorker.closeLog();
+	}
+	if (_this->logOutput) {
+		config.acquire();
+		config.conf[_this->name]["logPath"] = _this->logFilename;
+		config.release(true);
+	}
+}
+
+void
+RadiosondeDecoderModule::onOutputSettingsChanged(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+
+	_this->outputWorker.setFlushInterval(_this->flushInterval);
+	_this->outputWorker.setDurability((OutputWorker::Durability)_this->durability);
+
+	config.acquire();
+	config.conf[_this->name]["flushInterval"] = _this->flushInterval;
+	config.conf[_this->name]["durability"] = _this->durability;
+	config.release(true);
+}
+
+void
+RadiosondeDecoderModule::onBurstAltitudeChanged(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+
+	_this->burstAltitude = std::max(1000, _this->burstAltitude);
+	_this->outputWorker.setBurstAltitude(_this->burstAltitude);
+
+	config.acquire();
+	config.conf[_this->name]["burstAltitude"] = _this->burstAltitude;
+	config.release(true);
+}
+
 void
 RadiosondeDecoderModule::onTypeSelected(void *ctx, int selection)
 {
 	float bw;
+	int demodRate;
 	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
 
 	/* Ensure that the selection is within bounds */
-	if (selection > sizeof(_this->supportedTypes)/sizeof(_this->supportedTypes[0])) return;
+	if (selection >= (int)LEN(_this->supportedTypes)) return;
 
-	/* Spin down the currently active decoder */
-	_this->lastData.init();
-	if (_this->activeDecoder) _this->activeDecoder->stop();
+	/* Quiesce the demodulator, then let the outgoing decoder finish the
+	 * buffer it's working on. Whatever is still queued was demodulated for
+	 * the old type, so drop it: switching costs at most one buffer */
+	if (_this->activeDecoder) {
+		_this->fmDemod.stop();
+		_this->activeDecoder->stop();
+		_this->activeDecoder->release();
+		_this->fmDemod.out.flush();
+		_this->fmDemod.clock().clear();
+		if (_this->vfo) _this->vfo->output->flush();
+	}
 	_this->activeDecoder = NULL;
+	_this->clearSnapshot();
 
 	/* If selection is negative, just stop here */
 	if (selection < 0) return;
@@ -383,21 +1406,38 @@ RadiosondeDecoderModule::onTypeSelected(void *ctx, int selection)
 
 	/* Save selection to config */
 	config.acquire();
-	config.conf[_this->name]["sondeType"] = selection;
+	config.conf[_this->name]["sondeType"] = std::get<0>(_this->supportedTypes[selection]);
 	config.release(true);
 
-	/* Get new bandwidth */
+	/* In multi-channel mode, the type applies to all the lanes */
+	if (_this->multiChannel) {
+		_this->stopChannels();
+		if ((_this->multiChannel = _this->startChannels())) return;
+	}
+
+	/* The VFO already resamples from the source rate, so it can output
+	 * straight at the decoder's rate, unless the FM signal doesn't fit */
 	bw = std::get<1>(_this->supportedTypes[selection]);
+	demodRate = std::max((int)bw, DECODER_SAMPLE_RATE);
 
-	/* Update VFO */
+	/* Retune the VFO in place if there is one, so that the source keeps
+	 * streaming. Only create one when coming from disable() or from the
+	 * multi-channel path, which deleted it */
 	_this->fmDemod.stop();
-	if (_this->vfo) sigpath::vfoManager.deleteVFO(_this->vfo);
-	_this->vfo = sigpath::vfoManager.createVFO(_this->name, ImGui::WaterfallVFO::REF_CENTER, 0, bw, bw, bw, bw, true);
-	_this->vfo->setSnapInterval(SNAP_INTERVAL);
-	_this->fmDemod.setInput(_this->vfo->output);
-	_this->fmDemod.start();
+	if (_this->vfo) {
+		_this->vfo->setBandwidthLimits(bw, bw, true);
+		_this->vfo->setSampleRate(demodRate, bw);
+		_this->vfo->setBandwidth(bw);
+	} else {
+		_this->vfo = sigpath::vfoManager.createVFO(_this->name, ImGui::WaterfallVFO::REF_CENTER, 0, bw, demodRate, bw, bw, true);
+		_this->vfo->setSnapInterval(SNAP_INTERVAL);
+		_this->fmDemod.setInput(_this->vfo->output);
+	}
 
-	_this->resampler.setInSamplerate(bw);
+	/* Filter taps for every type were designed in the constructor */
+	_this->fmDemod.setRates(demodRate, DECODER_SAMPLE_RATE);
+	_this->fmDemod.setBandwidth(bw/2.0f);
+	_this->fmDemod.start();
 
 	/* Spin up the appropriate decoder */
 	_this->activeDecoder = std::get<2>(_this->supportedTypes[selection]);
@@ -405,6 +1445,35 @@ RadiosondeDecoderModule::onTypeSelected(void *ctx, int selection)
 }
 /* }}} */
 
+/* Static functions {{{ */
+/**
+ * Parse a list of frequencies in MHz, separated by commas and/or spaces
+ *
+ * @param list the list to parse
+ * @return frequencies in Hz
+ */
+static std::vector<double>
+parse_channels(const char *list)
+{
+	std::vector<double> freqs;
+	char *end;
+	double freq;
+
+	while (*list) {
+		freq = strtod(list, &end);
+		if (end == list) {
+			list++;
+			continue;
+		}
+		if (freq > 0) freqs.push_back(freq * 1e6);
+		list = end;
+	}
+
+	return freqs;
+}
+
+/* }}} */
+
 /* Module exports {{{ */
 MOD_EXPORT void _INIT_() {
     json def = json({});
@@ -427,3 +1496,51 @@ MOD_EXPORT void _END_() {
 }
 
 /* }}} */
+
+/**
+ * Plot a history series in the given rectangle. Each bucket is drawn as the
+ * box spanning its minimum and maximum, so that no extreme goes missing, and
+ * the centers of consecutive boxes are joined. xcol < 0 plots against time.
+ */
+static void
+draw_history(ImDrawList *draw, ImVec2 p0, ImVec2 p1, const FlightHistory::Series& series, int xcol, int ycol, ImU32 color)
+{
+	const float xlo = xcol < 0 ? 0 : series.lo[xcol];
+	const float xhi = xcol < 0 ? series.time[series.count-1] - series.time[0] : series.hi[xcol];
+	const float ylo = series.lo[ycol], yhi = series.hi[ycol];
+	const float xscale = (p1.x - p0.x - 1) / (xhi > xlo ? xhi - xlo : 1);
+	const float yscale = (p1.y - p0.y - 1) / (yhi > ylo ? yhi - ylo : 1);
+	float x0, x1, y0, y1;
+	ImVec2 prev, cur;
+	bool havePrev = false;
+
+	draw->AddRect(p0, p1, IM_COL32(128,128,128,255));
+
+	for (size_t i=0; i<series.count; i++) {
+		if (xcol < 0) {
+			x0 = x1 = series.time[i] - series.time[0];
+		} else {
+			x0 = series.min[xcol][i];
+			x1 = series.max[xcol][i];
+		}
+		y0 = series.min[ycol][i];
+		y1 = series.max[ycol][i];
+		if (std::isnan(x0) || std::isnan(y0)) {
+			havePrev = false;
+			continue;
+		}
+
+		/* Screen y grows downwards */
+		x0 = p0.x + (x0 - xlo) * xscale;
+		x1 = p0.x + (x1 - xlo) * xscale;
+		y0 = p1.y - 1 - (y0 - ylo) * yscale;
+		y1 = p1.y - 1 - (y1 - ylo) * yscale;
+
+		draw->AddRectFilled(ImVec2(x0, y1), ImVec2(x1 + 1, y0 + 1), color);
+		cur = ImVec2((x0 + x1) / 2, (y0 + y1) / 2);
+		if (havePrev) draw->AddLine(prev, cur, color);
+		prev = cur;
+		havePrev = true;
+	}
+}
+
@@ -2,16 +2,31 @@
 
 #include "dsp/block.h"
 #include <module.h>
-#include <dsp/multirate/polyphase_resampler.h>
-#include <dsp/demod/fm.h>
 #include <dsp/window/blackman.h>
 #include <signal_path/signal_path.h>
 #include "decode/decoder.hpp"
-#include "gpx.hpp"
-#include "ptu.hpp"
+#include "decode/autodetect.hpp"
+#include "decode/registry.hpp"
+#include "capture.hpp"
+#include "channelizer.hpp"
+#include "datatable.hpp"
+#include "derived.hpp"
+#include "fmresampler.hpp"
+#include "history.hpp"
+#include "merge.hpp"
+#include "metrics.hpp"
+#include "netsink.hpp"
+#include "output.hpp"
+#include "snapshot.hpp"
+#include "uploader.hpp"
+
+#define HISTORY_TRACKS 4            /* Sondes whose flight history is kept at the same time */
+#define SCAN_LANES 8                /* Decoder lanes available to the scanner */
+#define SCAN_TIMEOUT 60.0           /* Seconds a scanner lane stays tuned after its carrier disappears */
+#define CAPTURE_GAP_SEC 10          /* Frames this far apart trigger a capture dump */
 
 /* Display name, bandwidth, decoder */
-typedef std::tuple<const char*, float, dsp::block*> sondespec_t;
+typedef std::tuple<const char*, float, radiosonde::DecoderBase*> sondespec_t;
 
 class RadiosondeDecoderModule : public ModuleManager::Instance {
 public:
@@ -26,40 +41,125 @@ public:
 private:
 	std::string name;
 	bool enabled = true;
-	bool gpxOutput = false, ptuOutput = false;
+	bool gpxOutput = false, ptuOutput = false, logOutput = false;
 	char gpxFilename[2048];
 	char ptuFilename[2048];
+	char logFilename[2048];
+	std::string logNotice;                      /* What happened to the file the flight log was opened on */
 	VFOManager::VFO *vfo;
-	dsp::demod::FM<float> fmDemod;
-	dsp::multirate::RationalResampler<float> resampler;
-
-	radiosonde::Decoder<RS41Decoder, rs41_decoder_init, rs41_decoder_deinit, rs41_decode> rs41decoder;
-	radiosonde::Decoder<DFM09Decoder, dfm09_decoder_init, dfm09_decoder_deinit, dfm09_decode> dfm09decoder;
-	radiosonde::Decoder<IMS100Decoder, ims100_decoder_init, ims100_decoder_deinit, ims100_decode> ims100decoder;
-	radiosonde::Decoder<M10Decoder, m10_decoder_init, m10_decoder_deinit, m10_decode> m10decoder;
-	radiosonde::Decoder<IMET4Decoder, imet4_decoder_init, imet4_decoder_deinit, imet4_decode> imet4decoder;
-	radiosonde::Decoder<C50Decoder, c50_decoder_init, c50_decoder_deinit, c50_decode> c50decoder;
-	radiosonde::Decoder<MRZN1Decoder, mrzn1_decoder_init, mrzn1_decoder_deinit, mrzn1_decode> mrzn1decoder;
-
-	const sondespec_t supportedTypes[7] = {
-		sondespec_t("RS41", 1e4, &rs41decoder),
-		sondespec_t("DFM06/09", 1.5e4, &dfm09decoder),
-		sondespec_t("iMS100/RS-11G", 2e4, &ims100decoder),
-		sondespec_t("M10/M20", 5e4, &m10decoder),
-		sondespec_t("iMet-4", 2e4, &imet4decoder),
-		sondespec_t("SRS-C50", 2e4, &c50decoder),
-		sondespec_t("MRZ-N1", 2e4, &mrzn1decoder),
-	};
+	CaptureRing capture;        /* Written by fmDemod, so it must outlive it */
+	FMResampler fmDemod;        /* FM discriminator + resampling to the decoder rate, if needed */
+
+	radiosonde::Registry::Storage decoders;   /* One of each type compiled in */
+	radiosonde::AutoDecoder autoDecoder;
+
+	/* Auto must stay last: the decoders it tries are the entries before it */
+	sondespec_t supportedTypes[radiosonde::Registry::count + 1];
 	int selectedType = -1;
-	dsp::block *activeDecoder;
+	radiosonde::DecoderBase *activeDecoder;
+
+	TripleBuffer<SondeFullData> snapshot;     /* Written by the DSP thread, read by the GUI */
+
+	/* Sonde data table, formatted when a new snapshot comes in */
+	DataTable dataTable;
+	uint64_t dataGeneration = UINT64_MAX;
+	LandingPredictor::Prediction landing = {};    /* As of the last formatting */
+	char landingSerial[SONDE_SERIAL_LEN] = "";
+	int burstAltitude;
+	char typeLabel[64];
+	int typeLabelSelected = -1, typeLabelLocked = -1;
+
+	FlightHistory history{HISTORY_TRACKS};
+	FlightHistory::Series historySeries;      /* Reused across redraws */
+	char historySerial[SONDE_SERIAL_LEN] = "";
+
+	/* Multi-channel mode: one wide VFO, split into several decoder lanes */
+	struct ChannelLane {
+		~ChannelLane() { for (auto decoder : owned) delete decoder; }
+
+		RadiosondeDecoderModule *module;
+		double frequency;
+		int type;
+		std::vector<radiosonde::DecoderBase*> owned;
+		radiosonde::AutoDecoder autoDecoder;
+		radiosonde::DecoderBase *decoder;
+		TripleBuffer<SondeFullData> snapshot;
+
+		/* Formatted cells, refreshed when the snapshot changes */
+		uint64_t generation = UINT64_MAX;
+		char freqLabel[16], seqLabel[16], altLabel[16];
+
+		/* Scan mode: the snapshot is stale until it changes after a retune */
+		unsigned assignment = 0;
+		uint64_t staleGeneration = UINT64_MAX;
+	};
+	char channelList[256];
+	bool multiChannel = false;
+	bool scan;
+	double scanStart, scanEnd;                  /* MHz */
+	float scanThreshold;                        /* dB above the noise floor */
+	double channelCenter, channelBandwidth;     /* Hz, wide VFO */
+	char channelError[128] = "";                /* Why the last startChannels() refused to run, if it did */
+	EventHandler<double> retuneHandler;         /* Re-anchors the wide VFO when the source is retuned */
+	Channelizer channelizer;
+	std::vector<ChannelLane*> lanes;
+	PipelineMetrics metrics;
+	MetricsSnapshot metricsPrev, metricsCur;    /* Refreshed by the GUI once per second */
+	MetricsDumper metricsDumper;
+	bool metricsDump;
+	char metricsFilename[2048];
+	int metricsInterval;
+	OutputWorker outputWorker;
+	int flushInterval, durability;
+	NetSink netSink;
+	bool netOutput;
+	char netHost[64];
+	int netPort, netProtocol, netFormat;
+	HttpUploader uploader;
+	bool uploadEnabled, uploadCompress;
+	char uploadUrl[256], uploadName[64], uploadSpool[2048];
+	int uploadWindow;                           /* Seconds */
+	bool squelch;
+	float squelchLevel;                         /* SNR the squelch opens at, dB */
+	bool mergeOutput;
+	std::atomic<int> mergeSource{-1};           /* FrameMerger source ID, -1 if not merging */
+	std::vector<FrameMerger::SourceStats> mergeStats;   /* Refreshed by the GUI once per second */
+	unsigned mergeFrames = 0;
+	int64_t mergeStatsTime = 0;                 /* Microseconds, see PipelineMetrics::nowNs() */
+	std::atomic<bool> captureEnabled, captureOnSerial, captureOnGap;    /* Read by the DSP thread */
+	int captureLength;                          /* Seconds */
+	char captureFilename[2048];                 /* Edited by the GUI */
+	std::string capturePrefix;                  /* Applied copy of captureFilename, guarded by captureMtx */
+	std::mutex captureMtx;
+	char captureSerial[SONDE_SERIAL_LEN] = "";  /* DSP thread only */
+	int64_t captureLastFrame = 0;               /* DSP thread only, monotonic microseconds */
 
-	SondeFullData lastData;
-	GPXWriter gpxWriter;
-	PTUWriter ptuWriter;
+	void clearSnapshot();
+	bool startChannels();
+	void stopChannels();
+	int findType(const char *typeName) const;
+	void createLaneDecoder(ChannelLane *lane, int samplerate);
+	void decoderMemory(int *contexts, size_t *memory);
+	void checkCaptureTriggers(const SondeFullData *data);
+	bool dumpCapture(const char *reason);
 
 	static void menuHandler(void *ctx);
-	static void sondeDataHandler(SondeFullData *data, void *ctx);
+	static void sondeDataHandler(const SondeFullData *data, void *ctx);
+	static void laneDataHandler(const SondeFullData *data, void *ctx);
+	static void mergedDataHandler(const SondeFullData *data, void *ctx);
 	static void onTypeSelected(void *ctx, int selection);
 	static void onGPXOutputChanged(void *ctx);
 	static void onPTUOutputChanged(void *ctx);
+	static void onLogOutputChanged(void *ctx);
+	static void onOutputSettingsChanged(void *ctx);
+	static void onBurstAltitudeChanged(void *ctx);
+	static void onChannelsChanged(void *ctx);
+	static void onScanChanged(void *ctx);
+	static void onSourceRetuned(double freq, void *ctx);
+	static void onMetricsDumpChanged(void *ctx);
+	static void onNetOutputChanged(void *ctx);
+	static void onUploadChanged(void *ctx);
+	static void onMergeChanged(void *ctx);
+	static void onSquelchChanged(void *ctx);
+	static void onCaptureChanged(void *ctx);
 };
@@ -0,0 +1,236 @@
+#include <algorithm>
+#include <chrono>
+#include "merge.hpp"
+
+#define MERGE_DELAY_US 1500000      /* Wait for copies from other sources this long before emitting */
+#define MERGE_WINDOW_US 30000000    /* Remember frames this long, to drop late copies */
+#define POLL_INTERVAL_MS 100
+
+static int64_t now_us();
+static int popcount(uint64_t x);
+
+FrameMerger::FrameMerger()
+{
+	for (auto& source : m_sources) source.active = false;
+	m_pending = 0;
+	m_emitting = -1;
+	m_emitted = m_duplicates = 0;
+	m_running = true;
+	m_thread = std::thread(&FrameMerger::workerLoop, this);
+}
+
+FrameMerger::~FrameMerger()
+{
+	{
+		std::lock_guard<std::mutex> lck(m_mtx);
+		m_running = false;
+	}
+	m_cv.notify_one();
+	m_thread.join();
+}
+
+int
+FrameMerger::attach(const std::string& name, handler_t handler, void *ctx)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+
+	for (int i=0; i<MERGE_MAX_SOURCES; i++) {
+		if (m_sources[i].active) continue;
+		m_sources[i].active = true;
+		m_sources[i].name = name;
+		m_sources[i].handler = handler;
+		m_sources[i].ctx = ctx;
+		return i;
+	}
+	return -1;
+}
+
+void
+FrameMerger::detach(int source)
+{
+	std::unique_lock<std::mutex> lck(m_mtx);
+
+	if (source < 0 || source >= MERGE_MAX_SOURCES) return;
+	m_sources[source].active = false;
+
+	/* Handlers run without the lock held: wait for the current batch, unless
+	 * this is the handler detaching its own source */
+	if (std::this_thread::get_id() != m_thread.get_id()) {
+		m_idleCv.wait(lck, [this, source]{ return m_emitting != source; });
+	}
+
+	/* Forget what it contributed, in case the ID gets reused */
+	for (auto& frame : m_frames) {
+		frame.second.sources &= ~(1u << source);
+		if (frame.second.bestSource == source) frame.second.bestSource = -1;
+	}
+}
+
+void
+FrameMerger::publish(int source, const SondeFullData *data)
+{
+	const int fields = popcount(data->fields);
+	std::lock_guard<std::mutex> lck(m_mtx);
+	Key key;
+
+	if (source < 0 || source >= MERGE_MAX_SOURCES || !m_sources[source].active) return;
+
+	memset(key.serial, 0, sizeof(key.serial));
+	strncpy(key.serial, data->serial, sizeof(key.serial)-1);
+	key.seq = data->seq;
+
+	auto it = m_frames.find(key);
+	if (it == m_frames.end()) {
+		Entry& entry = m_frames[key];
+		entry.best = *data;
+		entry.bestFields = fields;
+		entry.bestSource = source;
+		entry.sources = 1u << source;
+		entry.firstSeen = now_us();
+		entry.emitted = false;
+		m_order.push_back(key);
+		return;
+	}
+
+	/* A source publishes each frame several times, as its fragments come in:
+	 * only the first copy from every other source is a duplicate */
+	Entry& entry = it->second;
+	if (!(entry.sources & (1u << source))) m_duplicates++;
+	entry.sources |= 1u << source;
+	if (entry.emitted) return;
+
+	/* A source refining its own copy always wins ties, since its latest state
+	 * includes everything before it */
+	if (fields > entry.bestFields || (source == entry.bestSource && fields >= entry.bestFields)) {
+		entry.best = *data;
+		entry.bestFields = fields;
+		entry.bestSource = source;
+	}
+}
+
+unsigned
+FrameMerger::stats(std::vector<SourceStats> *stats)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	const int writerId = writer();
+	int index[MERGE_MAX_SOURCES];
+
+	stats->clear();
+	for (int i=0; i<MERGE_MAX_SOURCES; i++) {
+		index[i] = -1;
+		if (!m_sources[i].active) continue;
+		index[i] = stats->size();
+		stats->push_back({m_sources[i].name, i == writerId, 0, 0, 0});
+	}
+
+	for (auto& frame : m_frames) {
+		const Entry& entry = frame.second;
+
+		for (int i=0; i<MERGE_MAX_SOURCES; i++) {
+			if (index[i] < 0 || !(entry.sources & (1u << i))) continue;
+
+			SourceStats& source = (*stats)[index[i]];
+			source.received++;
+			if (entry.bestSource == i) source.chosen++;
+			if (entry.sources == (1u << i)) source.exclusive++;
+		}
+	}
+
+	return m_frames.size();
+}
+
+/* Private methods {{{ */
+void
+FrameMerger::workerLoop()
+{
+	std::unique_lock<std::mutex> lck(m_mtx);
+	handler_t handler;
+	void *ctx;
+	int writerId;
+
+	while (m_running) {
+		m_cv.wait_for(lck, std::chrono::milliseconds(POLL_INTERVAL_MS));
+		writerId = collectReady(now_us(), !m_running);
+		if (m_ready.empty()) continue;
+
+		/* The outputs can take a while, and may call back into the merger:
+		 * run them without holding up publish() */
+		handler = m_sources[writerId].handler;
+		ctx = m_sources[writerId].ctx;
+		m_emitting = writerId;
+		lck.unlock();
+		for (const auto& frame : m_ready) handler(&frame, ctx);
+		lck.lock();
+		m_emitting = -1;
+		m_idleCv.notify_all();
+	}
+}
+
+/**
+ * Copy the frames whose first copy is old enough to m_ready, in order of
+ * arrival, then expire the ones that fell out of the window. Frames are
+ * dropped if no source is attached. Must be called with m_mtx held.
+ *
+ * @return ID of the source the frames go to, -1 if none
+ */
+int
+FrameMerger::collectReady(int64_t now, bool all)
+{
+	const int writerId = writer();
+
+	m_ready.clear();
+	for (; m_pending < m_order.size(); m_pending++) {
+		Entry& entry = m_frames[m_order[m_pending]];
+
+		if (!all && now - entry.firstSeen < MERGE_DELAY_US) break;
+		if (writerId >= 0) m_ready.push_back(entry.best);
+		entry.emitted = true;
+		m_emitted++;
+	}
+
+	while (m_pending > 0 && now - m_frames[m_order.front()].firstSeen >= MERGE_WINDOW_US) {
+		m_frames.erase(m_order.front());
+		m_order.pop_front();
+		m_pending--;
+	}
+	return writerId;
+}
+
+int
+FrameMerger::writer() const
+{
+	for (int i=0; i<MERGE_MAX_SOURCES; i++) {
+		if (m_sources[i].active) return i;
+	}
+	return -1;
+}
+
+size_t
+FrameMerger::KeyHash::operator()(const Key& key) const
+{
+	/* FNV-1a over the serial number, then the sequence number */
+	uint64_t hash = 14695981039346656037ULL;
+
+	for (size_t i=0; i<sizeof(key.serial) && key.serial[i]; i++) {
+		hash = (hash ^ (uint8_t)key.serial[i]) * 1099511628211ULL;
+	}
+	hash = (hash ^ (uint32_t)key.seq) * 1099511628211ULL;
+	return hash;
+}
+/* }}} */
+
+static int64_t
+now_us()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int
+popcount(uint64_t x)
+{
+	int count;
+
+	for (count=0; x; count++) x &= x - 1;
+	return count;
+}
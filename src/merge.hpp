@@ -0,0 +1,127 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "decode/common.hpp"
+
+#define MERGE_MAX_SOURCES 32
+
+/**
+ * Process-wide merge point for several receivers (instances) decoding the same
+ * sondes, e.g. for antenna diversity.
+ *
+ * Every source publishes its frames, which are indexed by serial number and
+ * sequence number. Copies of the same frame are merged by keeping the most
+ * complete one (the one with the most fields received), and each frame is
+ * emitted once, a short delay after its first copy came in, to the output of
+ * a single source: the first one that attached. Frames are remembered for a
+ * sliding window, so that late copies are recognized and dropped.
+ */
+class FrameMerger {
+public:
+	typedef void (*handler_t)(const SondeFullData *data, void *ctx);
+
+	/* Contribution of a source over the window */
+	struct SourceStats {
+		std::string name;
+		bool writer;                    /* Receives the merged stream */
+		unsigned received;              /* Frames it received */
+		unsigned chosen;                /* Frames where its copy was kept */
+		unsigned exclusive;             /* Frames only it received */
+	};
+
+	static FrameMerger& instance() {
+		static FrameMerger merger;
+		return merger;
+	}
+	~FrameMerger();
+
+	/**
+	 * Register a new source
+	 *
+	 * @param name display name of the source
+	 * @param handler function the merged frames are passed to, if this source
+	 *        becomes the writer
+	 * @param ctx context passed to the handler
+	 * @return source ID, -1 if there are too many sources already
+	 */
+	int attach(const std::string& name, handler_t handler, void *ctx);
+
+	/**
+	 * Unregister a source. Once this returns, its handler is never called
+	 * again (unless it is called from the handler itself); frames still
+	 * pending go to the next writer, if any.
+	 *
+	 * @param source source ID returned by attach()
+	 */
+	void detach(int source);
+
+	/**
+	 * Publish a frame received by a source. Never waits on the output.
+	 *
+	 * @param source source ID returned by attach()
+	 * @param data frame to publish
+	 */
+	void publish(int source, const SondeFullData *data);
+
+	/**
+	 * @param stats filled with the contribution of each attached source
+	 * @return number of distinct frames in the window
+	 */
+	unsigned stats(std::vector<SourceStats> *stats);
+
+	unsigned long emitted() const { return m_emitted; }
+	unsigned long duplicates() const { return m_duplicates; }
+
+private:
+	struct Key {
+		char serial[SONDE_SERIAL_LEN];
+		int seq;
+
+		bool operator==(const Key& other) const {
+			return seq == other.seq && !strncmp(serial, other.serial, sizeof(serial));
+		}
+	};
+	struct KeyHash {
+		size_t operator()(const Key& key) const;
+	};
+	struct Entry {
+		SondeFullData best;
+		int bestFields;                 /* Number of fields in best */
+		int bestSource;
+		uint32_t sources;               /* Bitmask of the sources that received it */
+		int64_t firstSeen;              /* Monotonic, microseconds */
+		bool emitted;
+	};
+	struct Source {
+		bool active;
+		std::string name;
+		handler_t handler;
+		void *ctx;
+	};
+
+	FrameMerger();
+	void workerLoop();
+	int collectReady(int64_t now, bool all);
+	int writer() const;
+
+	std::mutex m_mtx;
+	std::condition_variable m_cv, m_idleCv;
+	std::unordered_map<Key, Entry, KeyHash> m_frames;
+	std::deque<Key> m_order;            /* Keys by time of arrival, for expiry */
+	Source m_sources[MERGE_MAX_SOURCES];
+	size_t m_pending;                   /* Index in m_order of the first frame not yet emitted */
+	std::vector<SondeFullData> m_ready; /* Worker thread only: frames being handed to the writer */
+	int m_emitting;                     /* Source whose handler is running outside the lock, -1 if none */
+	std::atomic<unsigned long> m_emitted, m_duplicates;
+	bool m_running;
+	std::thread m_thread;
+};
@@ -0,0 +1,236 @@
+#include <inttypes.h>
+#include <math.h>
+#include "decode/decoder.hpp"
+#include "metrics.hpp"
+
+const MetricsField metricsFields[METRICS_FIELD_COUNT] = {
+	{"seq", DATA_SEQ},
+	{"pos", DATA_POS},
+	{"speed", DATA_SPEED},
+	{"time", DATA_TIME},
+	{"ptu", DATA_PTU},
+	{"serial", DATA_SERIAL},
+	{"shutdown", DATA_SHUTDOWN},
+	{"ozone", DATA_OZONE},
+};
+
+const char *metricsStatusNames[METRICS_STATUS_COUNT] = {"proceed", "parsed"};
+static_assert(PROCEED == 0 && PARSED == 1, "ParserStatus values changed, update metricsStatusNames");
+
+const char *metricsLatencyNames[LATENCY_STAGE_COUNT] = {"demod", "queue", "decode", "total"};
+
+static int latency_bucket(int64_t us);
+
+void
+PipelineMetrics::reset()
+{
+	m_samples = m_readWaitNs = 0;
+	for (auto& status : m_status) status = 0;
+	for (auto& field : m_fields) field = 0;
+	m_frames = m_decodeNs = 0;
+	m_batches = m_written = m_writeNs = m_latencyUs = m_latencyMaxUs = 0;
+	m_dropped = 0;
+	for (auto& stage : m_stageLatency) {
+		for (auto& bucket : stage) bucket = 0;
+	}
+}
+
+void
+PipelineMetrics::addLatency(const SondeFullData *data)
+{
+	const int64_t stages[LATENCY_STAGE_COUNT] = {
+		data->demodMonotonic - data->captureMonotonic,
+		data->readMonotonic - data->demodMonotonic,
+		data->rxMonotonic - data->readMonotonic,
+		data->rxMonotonic - data->captureMonotonic,
+	};
+
+	for (int i=0; i<LATENCY_STAGE_COUNT; i++) {
+		m_stageLatency[i][latency_bucket(stages[i])].fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+void
+PipelineMetrics::addWrite(int count, int64_t ns, uint64_t latencyUs, uint64_t maxLatencyUs)
+{
+	uint64_t prevMax = m_latencyMaxUs.load(std::memory_order_relaxed);
+
+	m_batches.fetch_add(1, std::memory_order_relaxed);
+	m_written.fetch_add(count, std::memory_order_relaxed);
+	m_writeNs.fetch_add(ns, std::memory_order_relaxed);
+	m_latencyUs.fetch_add(latencyUs, std::memory_order_relaxed);
+	while (prevMax < maxLatencyUs && !m_latencyMaxUs.compare_exchange_weak(prevMax, maxLatencyUs, std::memory_order_relaxed));
+}
+
+void
+PipelineMetrics::read(MetricsSnapshot *dst) const
+{
+	dst->time = nowNs() / 1000;
+	dst->samples = m_samples.load(std::memory_order_relaxed);
+	dst->readWaitNs = m_readWaitNs.load(std::memory_order_relaxed);
+	for (int i=0; i<METRICS_STATUS_COUNT; i++) dst->status[i] = m_status[i].load(std::memory_order_relaxed);
+	for (int i=0; i<METRICS_FIELD_COUNT; i++) dst->fields[i] = m_fields[i].load(std::memory_order_relaxed);
+	dst->frames = m_frames.load(std::memory_order_relaxed);
+	dst->decodeNs = m_decodeNs.load(std::memory_order_relaxed);
+	dst->batches = m_batches.load(std::memory_order_relaxed);
+	dst->written = m_written.load(std::memory_order_relaxed);
+	dst->writeNs = m_writeNs.load(std::memory_order_relaxed);
+	dst->latencyUs = m_latencyUs.load(std::memory_order_relaxed);
+	dst->latencyMaxUs = m_latencyMaxUs.load(std::memory_order_relaxed);
+	dst->dropped = m_dropped.load(std::memory_order_relaxed);
+	for (int i=0; i<LATENCY_STAGE_COUNT; i++) {
+		for (int j=0; j<METRICS_LATENCY_BUCKETS; j++) {
+			dst->stageLatency[i][j] = m_stageLatency[i][j].load(std::memory_order_relaxed);
+		}
+	}
+}
+
+double
+MetricsSnapshot::latencyPercentile(int stage, double p) const
+{
+	uint64_t total = 0, rank, seen;
+	int i;
+
+	for (i=0; i<METRICS_LATENCY_BUCKETS; i++) total += stageLatency[stage][i];
+	if (!total) return NAN;
+
+	/* Report the geometric middle of the bucket the rank falls in */
+	rank = std::min<uint64_t>(total - 1, (uint64_t)(p * total));
+	for (i=0, seen=0; i<METRICS_LATENCY_BUCKETS; i++) {
+		seen += stageLatency[stage][i];
+		if (seen > rank) break;
+	}
+	return i ? exp2((i + 0.5) / 4) : 0;
+}
+
+MetricsDumper::~MetricsDumper()
+{
+	stop();
+}
+
+void
+MetricsDumper::start(const PipelineMetrics *metrics, const std::string& name, const char *fname, int intervalMs)
+{
+	stop();
+
+	m_metrics = metrics;
+	m_name = name;
+	m_fname = fname;
+	m_intervalMs = std::max(100, intervalMs);
+	m_metrics->read(&m_prev);
+
+	m_running = true;
+	m_thread = std::thread(&MetricsDumper::workerLoop, this);
+}
+
+void
+MetricsDumper::stop()
+{
+	{
+		std::lock_guard<std::mutex> lck(m_mtx);
+		if (!m_running) return;
+		m_running = false;
+	}
+	m_cv.notify_one();
+	m_thread.join();
+}
+
+void
+MetricsDumper::writeJSON(FILE *fd, const std::string& name, const MetricsSnapshot& cur, const MetricsSnapshot& prev)
+{
+	const double dt = (cur.time - prev.time) * 1e-6;
+	const uint64_t fragments = cur.status[PARSED] - prev.status[PARSED];
+	const uint64_t written = cur.written - prev.written;
+
+	fprintf(fd, "{\n");
+	fprintf(fd, "  \"instance\": \"%s\",\n", name.c_str());
+	fprintf(fd, "  \"timestamp\": %ld,\n", (long)time(NULL));
+	fprintf(fd, "  \"interval\": %.3f,\n", dt);
+	fprintf(fd, "  \"samples\": %" PRIu64 ",\n", cur.samples);
+	fprintf(fd, "  \"samplesPerSec\": %.1f,\n", cur.rate(&MetricsSnapshot::samples, prev));
+	fprintf(fd, "  \"frames\": %" PRIu64 ",\n", cur.frames);
+	fprintf(fd, "  \"framesPerSec\": %.3f,\n", cur.rate(&MetricsSnapshot::frames, prev));
+
+	fprintf(fd, "  \"parserStatus\": {");
+	for (int i=0, first=1; i<METRICS_STATUS_COUNT; i++) {
+		if (!metricsStatusNames[i]) continue;
+		fprintf(fd, "%s\"%s\": %" PRIu64, first ? "" : ", ", metricsStatusNames[i], cur.status[i]);
+		first = 0;
+	}
+	fprintf(fd, "},\n");
+
+	fprintf(fd, "  \"fieldHitRate\": {");
+	for (int i=0; i<METRICS_FIELD_COUNT; i++) {
+		fprintf(fd, "%s\"%s\": %.3f", i ? ", " : "", metricsFields[i].name,
+		        fragments ? (double)(cur.fields[i] - prev.fields[i]) / fragments : 0.0);
+	}
+	fprintf(fd, "},\n");
+
+	fprintf(fd, "  \"decoderLoad\": %.4f,\n", dt > 0 ? (cur.decodeNs - prev.decodeNs) * 1e-9 / dt : 0.0);
+	fprintf(fd, "  \"readWait\": %.4f,\n", dt > 0 ? (cur.readWaitNs - prev.readWaitNs) * 1e-9 / dt : 0.0);
+	fprintf(fd, "  \"pipelineLatency\": {");
+	for (int i=0; i<LATENCY_STAGE_COUNT; i++) {
+		const double p50 = cur.latencyPercentile(i, 0.5), p99 = cur.latencyPercentile(i, 0.99);
+
+		fprintf(fd, "%s\"%s\": {\"p50Ms\": %.3f, \"p99Ms\": %.3f}", i ? ", " : "", metricsLatencyNames[i],
+		        isnan(p50) ? 0.0 : p50 * 1e-3, isnan(p99) ? 0.0 : p99 * 1e-3);
+	}
+	fprintf(fd, "},\n");
+	fprintf(fd, "  \"writer\": {\"batches\": %" PRIu64 ", \"written\": %" PRIu64 ", \"dropped\": %" PRIu64 ", "
+	            "\"writeTimeMs\": %.3f, \"latencyAvgMs\": %.3f, \"latencyMaxMs\": %.3f}\n",
+	        cur.batches, cur.written, cur.dropped,
+	        (cur.writeNs - prev.writeNs) * 1e-6,
+	        written ? (cur.latencyUs - prev.latencyUs) * 1e-3 / written : 0.0,
+	        cur.latencyMaxUs * 1e-3);
+	fprintf(fd, "}\n");
+}
+
+/* Private methods {{{ */
+void
+MetricsDumper::workerLoop()
+{
+	std::unique_lock<std::mutex> lck(m_mtx);
+
+	while (m_running) {
+		m_cv.wait_for(lck, std::chrono::milliseconds(m_intervalMs), [this]{ return !m_running; });
+		if (!m_running) break;
+
+		lck.unlock();
+		dump();
+		lck.lock();
+	}
+}
+
+/**
+ * Write the current metrics to a temporary file, then move it in place
+ */
+void
+MetricsDumper::dump()
+{
+	const std::string tmpName = m_fname + ".tmp";
+	MetricsSnapshot cur;
+	FILE *fd;
+
+	m_metrics->read(&cur);
+	if (!(fd = fopen(tmpName.c_str(), "wb"))) return;
+	writeJSON(fd, m_name, cur, m_prev);
+	fclose(fd);
+
+#ifdef _WIN32
+	remove(m_fname.c_str());
+#endif
+	rename(tmpName.c_str(), m_fname.c_str());
+	m_prev = cur;
+}
+/* }}} */
+
+/**
+ * Histogram bucket of a latency: 4 per octave, the first one also takes
+ * everything below 1us (including clock skew between threads)
+ */
+static int
+latency_bucket(int64_t us)
+{
+	if (us <= 1) return 0;
+	return std::min(METRICS_LATENCY_BUCKETS - 1, (int)(4 * log2((double)us)));
+}
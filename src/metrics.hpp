@@ -0,0 +1,167 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <thread>
+
+#define METRICS_STATUS_COUNT 4      /* Room for every ParserStatus value */
+#define METRICS_FIELD_COUNT 8
+#define METRICS_LATENCY_BUCKETS 112 /* 4 per octave, 1us to 2^28us */
+
+class SondeFullData;
+
+/* Pipeline stages whose latency is tracked, from the samples entering the plugin to the frame */
+enum LatencyStage {
+	LATENCY_DEMOD = 0,              /* Capture to demodulated */
+	LATENCY_QUEUE,                  /* Demodulated to read by the decoder */
+	LATENCY_DECODE,                 /* Read to frame received */
+	LATENCY_TOTAL,                  /* Capture to frame received */
+	LATENCY_STAGE_COUNT
+};
+
+/* DATA_* bits tracked by the field hit counters, with their display names */
+extern const struct MetricsField {
+	const char *name;
+	uint64_t mask;
+} metricsFields[METRICS_FIELD_COUNT];
+
+/* Names of the ParserStatus values, NULL for unused slots */
+extern const char *metricsStatusNames[METRICS_STATUS_COUNT];
+
+/* Names of the LatencyStage values */
+extern const char *metricsLatencyNames[LATENCY_STAGE_COUNT];
+
+/**
+ * Plain copy of all the counters at a given time, used to compute rates
+ */
+struct MetricsSnapshot {
+	int64_t time;                               /* Monotonic, microseconds */
+	uint64_t samples;                           /* Samples fed to the decoders */
+	uint64_t status[METRICS_STATUS_COUNT];      /* decoder_get() return values */
+	uint64_t fields[METRICS_FIELD_COUNT];       /* Fragments containing each field */
+	uint64_t frames;                            /* Fragments with a new sequence number */
+	uint64_t decodeNs;                          /* Time spent in decoder_get() */
+	uint64_t readWaitNs;                        /* Time spent waiting for samples */
+	uint64_t batches, written;                  /* Output thread write batches/frames */
+	uint64_t writeNs;                           /* Time spent writing to file */
+	uint64_t latencyUs, latencyMaxUs;           /* Reception to file write latency */
+	uint64_t dropped;                           /* Frames dropped by the output queue */
+	uint64_t stageLatency[LATENCY_STAGE_COUNT][METRICS_LATENCY_BUCKETS];   /* Frames per latency bucket */
+
+	/* Per-second rate of a counter, between prev and this snapshot */
+	double rate(uint64_t MetricsSnapshot::*counter, const MetricsSnapshot& prev) const {
+		return time > prev.time ? (this->*counter - prev.*counter) * 1e6 / (time - prev.time) : 0;
+	}
+
+	/**
+	 * Latency percentile of a stage, over all the frames since the last
+	 * reset, within a quarter octave
+	 *
+	 * @param stage LatencyStage value
+	 * @param p percentile, between 0 and 1
+	 * @return latency in microseconds, NAN if no frame was stamped
+	 */
+	double latencyPercentile(int stage, double p) const;
+};
+
+/**
+ * Counters and timers for a decoding pipeline, from the stream reads down to
+ * the file writers. Updated with relaxed atomic adds, so that any thread can
+ * contribute (e.g. decoders searching in parallel), and read at any time.
+ */
+class PipelineMetrics {
+public:
+	PipelineMetrics() { reset(); }
+
+	static int64_t nowNs() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	void reset();
+
+	void addRead(int samples, int64_t waitNs) {
+		m_samples.fetch_add(samples, std::memory_order_relaxed);
+		m_readWaitNs.fetch_add(waitNs, std::memory_order_relaxed);
+	}
+
+	void addDecode(int status, uint64_t fields, bool newFrame, int64_t ns) {
+		if ((unsigned)status < METRICS_STATUS_COUNT) m_status[status].fetch_add(1, std::memory_order_relaxed);
+		m_decodeNs.fetch_add(ns, std::memory_order_relaxed);
+		if (!fields) return;
+
+		for (int i=0; i<METRICS_FIELD_COUNT; i++) {
+			if (fields & metricsFields[i].mask) m_fields[i].fetch_add(1, std::memory_order_relaxed);
+		}
+		if (newFrame) m_frames.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void addWrite(int count, int64_t ns, uint64_t latencyUs, uint64_t maxLatencyUs);
+	void addDropped() { m_dropped.fetch_add(1, std::memory_order_relaxed); }
+
+	/**
+	 * Account for the stage latencies of a stamped frame
+	 */
+	void addLatency(const SondeFullData *data);
+
+	void read(MetricsSnapshot *dst) const;
+
+private:
+	std::atomic<uint64_t> m_samples, m_readWaitNs;
+	std::atomic<uint64_t> m_status[METRICS_STATUS_COUNT];
+	std::atomic<uint64_t> m_fields[METRICS_FIELD_COUNT];
+	std::atomic<uint64_t> m_frames, m_decodeNs;
+	std::atomic<uint64_t> m_batches, m_written, m_writeNs, m_latencyUs, m_latencyMaxUs;
+	std::atomic<uint64_t> m_dropped;
+	std::atomic<uint64_t> m_stageLatency[LATENCY_STAGE_COUNT][METRICS_LATENCY_BUCKETS];
+};
+
+/**
+ * Periodically writes the metrics of a pipeline to a JSON file, replacing it
+ * atomically so that monitoring tools never see a partial file.
+ */
+class MetricsDumper {
+public:
+	MetricsDumper() {};
+	~MetricsDumper();
+
+	/**
+	 * Start dumping metrics to file
+	 *
+	 * @param metrics metrics to dump
+	 * @param name instance name, included in the dump
+	 * @param fname path of the JSON file
+	 * @param intervalMs time between dumps
+	 */
+	void start(const PipelineMetrics *metrics, const std::string& name, const char *fname, int intervalMs);
+	void stop();
+
+	/**
+	 * Write a snapshot as a JSON object
+	 *
+	 * @param fd file to write to
+	 * @param name instance name
+	 * @param cur current snapshot
+	 * @param prev previous snapshot, used to compute rates
+	 */
+	static void writeJSON(FILE *fd, const std::string& name, const MetricsSnapshot& cur, const MetricsSnapshot& prev);
+
+private:
+	void workerLoop();
+	void dump();
+
+	const PipelineMetrics *m_metrics;
+	std::string m_name, m_fname;
+	int m_intervalMs;
+	MetricsSnapshot m_prev;
+
+	std::mutex m_mtx;
+	std::condition_variable m_cv;
+	bool m_running = false;
+	std::thread m_thread;
+};
@@ -0,0 +1,465 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+#include "netsink.hpp"
+
+#define POLL_INTERVAL_MS 20     /* How often to accept clients and retry TCP sends */
+#define MAX_DATAGRAM 8192
+#define LISTEN_BACKLOG 8
+#define RECORD_HEADER_LEN 108
+
+#ifdef _WIN32
+#define WOULD_BLOCK() (WSAGetLastError() == WSAEWOULDBLOCK)
+#else
+#define WOULD_BLOCK() (errno == EAGAIN || errno == EWOULDBLOCK)
+#endif
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL     /* Report closed connections as errors, not SIGPIPE */
+#else
+#define SEND_FLAGS 0
+#endif
+
+static intptr_t open_socket(int type);
+static void close_socket(intptr_t fd);
+static bool set_nonblocking(intptr_t fd);
+static void put_u16(std::string *dst, uint16_t x);
+static void put_u32(std::string *dst, uint32_t x);
+static void put_u64(std::string *dst, uint64_t x);
+static void put_f32(std::string *dst, float x);
+static void json_number(std::string *dst, const char *key, double x, const char *fmt);
+static void json_string(std::string *dst, const char *key, const char *str);
+
+NetSink::NetSink(size_t capacity, size_t maxBacklog)
+{
+	m_ring.resize(capacity);
+	m_batch.resize(capacity);
+	m_head = m_count = 0;
+	m_fd = -1;
+	m_maxBacklog = maxBacklog;
+	m_sent = m_dropped = m_kicked = 0;
+	m_running = false;
+}
+
+NetSink::~NetSink()
+{
+	stop();
+}
+
+bool
+NetSink::start(Protocol protocol, const char *host, int port, Format format)
+{
+	struct sockaddr_in addr;
+	int one = 1;
+
+	stop();
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	if (port <= 0 || port > 65535 || inet_pton(AF_INET, host, &addr.sin_addr) != 1) return false;
+
+	if (protocol == PROTOCOL_UDP) {
+		if ((m_fd = open_socket(SOCK_DGRAM)) < 0) return false;
+	} else {
+		if ((m_fd = open_socket(SOCK_STREAM)) < 0) return false;
+		setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, (const char*)&one, sizeof(one));
+		if (bind(m_fd, (struct sockaddr*)&addr, sizeof(addr)) || listen(m_fd, LISTEN_BACKLOG)) {
+			close_socket(m_fd);
+			m_fd = -1;
+			return false;
+		}
+	}
+	set_nonblocking(m_fd);
+
+	m_protocol = protocol;
+	m_format = format;
+	m_host = addr.sin_addr.s_addr;
+	m_port = addr.sin_port;
+	m_head = m_count = 0;
+
+	m_running = true;
+	m_thread = std::thread(&NetSink::workerLoop, this);
+	return true;
+}
+
+void
+NetSink::stop()
+{
+	{
+		std::lock_guard<std::mutex> lck(m_queueMtx);
+		if (!m_running) return;
+		m_running = false;
+	}
+	m_queueCv.notify_one();
+	m_thread.join();
+
+	closeAll();
+}
+
+bool
+NetSink::push(const SondeFullData *data)
+{
+	{
+		std::lock_guard<std::mutex> lck(m_queueMtx);
+		if (!m_running) return false;
+		if (m_count == m_ring.size()) {
+			m_dropped++;
+			return false;
+		}
+		m_ring[(m_head + m_count) % m_ring.size()] = *data;
+		m_count++;
+	}
+	m_queueCv.notify_one();
+	return true;
+}
+
+std::vector<NetSink::Client>
+NetSink::clients()
+{
+	std::lock_guard<std::mutex> lck(m_clientMtx);
+	std::vector<Client> list;
+
+	for (auto& conn : m_clients) list.push_back({conn.address, conn.backlog.size()});
+	return list;
+}
+
+void
+NetSink::encode(std::string *dst, const SondeFullData *data, const DerivedMeteo *derived, Format format)
+{
+	const size_t auxLen = strnlen(data->auxData, sizeof(data->auxData));
+	char serial[SONDE_SERIAL_LEN];
+
+	if (format == FORMAT_BINARY) {
+		dst->append(NETSINK_RECORD_MAGIC, 4);
+		dst->push_back(NETSINK_RECORD_VERSION);
+		dst->push_back(data->calibrated ? 1 : 0);
+		put_u16(dst, RECORD_HEADER_LEN + auxLen);
+		put_u64(dst, data->rxTime);
+		put_u64(dst, data->time);
+		put_u32(dst, data->seq);
+		put_u32(dst, data->burstkill);
+		put_f32(dst, data->lat);
+		put_f32(dst, data->lon);
+		put_f32(dst, data->alt);
+		put_f32(dst, data->spd);
+		put_f32(dst, data->hdg);
+		put_f32(dst, data->climb);
+		put_f32(dst, data->temp);
+		put_f32(dst, data->rh);
+		put_f32(dst, data->dewpt);
+		put_f32(dst, data->pressure);
+		put_f32(dst, data->calib_percent);
+
+		memset(serial, 0, sizeof(serial));
+		strncpy(serial, data->serial, sizeof(serial)-1);
+		dst->append(serial, sizeof(serial));
+		dst->append(data->auxData, auxLen);
+		return;
+	}
+
+	dst->push_back('{');
+	json_string(dst, "serial", data->serial);
+	json_number(dst, "seq", data->seq, "%.0f");
+	json_number(dst, "time", data->time, "%.0f");
+	json_number(dst, "rxTime", data->rxTime, "%.0f");
+	if (data->captureMonotonic) {
+		json_number(dst, "latency", (data->rxMonotonic - data->captureMonotonic) * 1e-3, "%.1f");
+	}
+	json_number(dst, "lat", data->lat, "%.6f");
+	json_number(dst, "lon", data->lon, "%.6f");
+	json_number(dst, "alt", data->alt, "%.1f");
+	json_number(dst, "speed", data->spd, "%.2f");
+	json_number(dst, "heading", data->hdg, "%.1f");
+	json_number(dst, "climb", data->climb, "%.2f");
+	json_number(dst, "temp", data->temp, "%.2f");
+	json_number(dst, "rh", data->rh, "%.2f");
+	json_number(dst, "dewpt", data->dewpt, "%.2f");
+	json_number(dst, "pressure", data->pressure, "%.2f");
+	json_number(dst, "calibPercent", data->calib_percent, "%.0f");
+	json_number(dst, "burstkill", data->burstkill, "%.0f");
+	if (derived) {
+		json_number(dst, "geopotential", derived->geopotential(), "%.1f");
+		json_number(dst, "windSpeed", derived->windSpeed(), "%.2f");
+		json_number(dst, "windDir", derived->windDirection(), "%.1f");
+		json_number(dst, "lapseRate", derived->lapseRate(), "%.2f");
+	}
+	dst->append(data->calibrated ? "\"calibrated\":true," : "\"calibrated\":false,");
+	json_string(dst, "aux", data->auxData);
+	(*dst)[dst->size() - 1] = '}';      /* Replace the trailing comma */
+	dst->push_back('\n');
+}
+
+/* Private methods {{{ */
+void
+NetSink::workerLoop()
+{
+	std::unique_lock<std::mutex> lck(m_queueMtx);
+	std::vector<size_t> ends;
+	std::string buf;
+	size_t count;
+
+	while (m_running) {
+		/* UDP only ever has something to do when frames come in */
+		if (m_protocol == PROTOCOL_UDP) {
+			m_queueCv.wait(lck, [this]{ return !m_running || m_count > 0; });
+		} else {
+			m_queueCv.wait_for(lck, std::chrono::milliseconds(POLL_INTERVAL_MS),
+			                   [this]{ return !m_running || m_count > 0; });
+		}
+
+		count = m_count;
+		for (size_t i=0; i<count; i++) {
+			m_batch[i] = m_ring[(m_head + i) % m_ring.size()];
+		}
+		m_head = (m_head + count) % m_ring.size();
+		m_count = 0;
+		lck.unlock();
+
+		/* Encode everything once, whatever the number of clients */
+		buf.clear();
+		ends.clear();
+		for (size_t i=0; i<count; i++) {
+			DerivedMeteo& derived = m_derived.update(&m_batch[i]);
+
+			derived.fill(&m_batch[i]);
+			encode(&buf, &m_batch[i], &derived, m_format);
+			ends.push_back(buf.size());
+		}
+
+		if (m_protocol == PROTOCOL_UDP) {
+			if (count) sendUDP(buf, ends);
+		} else {
+			acceptClients();
+			if (count) {
+				std::lock_guard<std::mutex> clientLck(m_clientMtx);
+				for (auto& conn : m_clients) conn.backlog.append(buf);
+			}
+			sendTCP();
+		}
+		m_sent += count;
+
+		lck.lock();
+	}
+}
+
+/**
+ * Send a batch of records to the UDP destination, packing as many whole
+ * records as possible in each datagram
+ */
+void
+NetSink::sendUDP(const std::string& buf, const std::vector<size_t>& ends)
+{
+	struct sockaddr_in addr;
+	size_t start = 0, end;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = m_host;
+	addr.sin_port = m_port;
+
+	for (size_t i=0; i<ends.size(); i = end) {
+		for (end = i+1; end < ends.size() && ends[end] - start <= MAX_DATAGRAM; end++);
+
+		/* A full socket buffer drops the datagram, same as the network would */
+		sendto(m_fd, buf.data() + start, ends[end-1] - start, SEND_FLAGS, (struct sockaddr*)&addr, sizeof(addr));
+		start = ends[end-1];
+	}
+}
+
+void
+NetSink::acceptClients()
+{
+	struct sockaddr_in addr;
+	socklen_t addrLen;
+	char host[INET_ADDRSTRLEN];
+	intptr_t fd;
+	int one = 1;
+
+	for (;;) {
+		addrLen = sizeof(addr);
+		if ((fd = accept(m_fd, (struct sockaddr*)&addr, &addrLen)) < 0) return;
+
+		set_nonblocking(fd);
+#ifdef SO_NOSIGPIPE
+		setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, (const char*)&one, sizeof(one));
+#endif
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one));
+		inet_ntop(AF_INET, &addr.sin_addr, host, sizeof(host));
+
+		std::lock_guard<std::mutex> lck(m_clientMtx);
+		m_clients.push_back({fd, std::string(host) + ":" + std::to_string(ntohs(addr.sin_port)), std::string()});
+	}
+}
+
+/**
+ * Send as much of each client's backlog as the socket takes without blocking.
+ * Clients that went away, or whose backlog grew over the limit, are dropped.
+ */
+void
+NetSink::sendTCP()
+{
+	std::lock_guard<std::mutex> lck(m_clientMtx);
+	long len;
+
+	for (auto it = m_clients.begin(); it != m_clients.end();) {
+		Connection& conn = *it;
+		bool alive = true;
+
+		while (!conn.backlog.empty()) {
+			len = send(conn.fd, conn.backlog.data(), conn.backlog.size(), SEND_FLAGS);
+			if (len > 0) {
+				conn.backlog.erase(0, len);
+			} else {
+				alive = len < 0 && WOULD_BLOCK();
+				break;
+			}
+		}
+
+		if (alive && conn.backlog.size() <= m_maxBacklog) {
+			it++;
+			continue;
+		}
+
+		if (alive) m_kicked++;
+		close_socket(conn.fd);
+		it = m_clients.erase(it);
+	}
+}
+
+void
+NetSink::closeAll()
+{
+	std::lock_guard<std::mutex> lck(m_clientMtx);
+
+	for (auto& conn : m_clients) close_socket(conn.fd);
+	m_clients.clear();
+
+	if (m_fd >= 0) close_socket(m_fd);
+	m_fd = -1;
+}
+/* }}} */
+
+/* Static functions {{{ */
+static intptr_t
+open_socket(int type)
+{
+#ifdef _WIN32
+	static bool wsaInit = false;
+	WSADATA wsaData;
+	SOCKET fd;
+
+	if (!wsaInit) wsaInit = !WSAStartup(MAKEWORD(2, 2), &wsaData);
+	if ((fd = socket(AF_INET, type, 0)) == INVALID_SOCKET) return -1;
+	return (intptr_t)fd;
+#else
+	return socket(AF_INET, type, 0);
+#endif
+}
+
+static void
+close_socket(intptr_t fd)
+{
+#ifdef _WIN32
+	closesocket((SOCKET)fd);
+#else
+	close(fd);
+#endif
+}
+
+static bool
+set_nonblocking(intptr_t fd)
+{
+#ifdef _WIN32
+	u_long one = 1;
+	return !ioctlsocket((SOCKET)fd, FIONBIO, &one);
+#else
+	return fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == 0;
+#endif
+}
+
+static void
+put_u16(std::string *dst, uint16_t x)
+{
+	dst->push_back(x & 0xFF);
+	dst->push_back(x >> 8);
+}
+
+static void
+put_u32(std::string *dst, uint32_t x)
+{
+	put_u16(dst, x & 0xFFFF);
+	put_u16(dst, x >> 16);
+}
+
+static void
+put_u64(std::string *dst, uint64_t x)
+{
+	put_u32(dst, x & 0xFFFFFFFF);
+	put_u32(dst, x >> 32);
+}
+
+static void
+put_f32(std::string *dst, float x)
+{
+	uint32_t bits;
+	memcpy(&bits, &x, sizeof(bits));
+	put_u32(dst, bits);
+}
+
+/**
+ * Append "key":value, to a JSON object, with null for non-finite values
+ */
+static void
+json_number(std::string *dst, const char *key, double x, const char *fmt)
+{
+	char tmp[64];
+
+	dst->push_back('"');
+	dst->append(key);
+	dst->append("\":");
+	if (isfinite(x)) {
+		snprintf(tmp, sizeof(tmp), fmt, x);
+		dst->append(tmp);
+	} else {
+		dst->append("null");
+	}
+	dst->push_back(',');
+}
+
+/**
+ * Append "key":"value", to a JSON object, escaping the value
+ */
+static void
+json_string(std::string *dst, const char *key, const char *str)
+{
+	char tmp[8];
+
+	dst->push_back('"');
+	dst->append(key);
+	dst->append("\":\"");
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\') {
+			dst->push_back('\\');
+			dst->push_back(*str);
+		} else if ((unsigned char)*str < 0x20) {
+			snprintf(tmp, sizeof(tmp), "\\u%04x", *str);
+			dst->append(tmp);
+		} else {
+			dst->push_back(*str);
+		}
+	}
+	dst->append("\",");
+}
+/* }}} */
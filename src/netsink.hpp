@@ -0,0 +1,149 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "decode/common.hpp"
+#include "derived.hpp"
+
+#define NETSINK_RECORD_MAGIC "RSDF"
+#define NETSINK_RECORD_VERSION 1
+
+/**
+ * Publishes every frame to local consumers over UDP (to a fixed destination)
+ * or TCP (to every client connected to a listening socket), either as binary
+ * records or as line-delimited JSON.
+ *
+ * Frames are handed over through a bounded queue, like OutputWorker, and
+ * encoded and sent from a dedicated thread, so the caller never waits on the
+ * network. Everything queued is sent together, in as few datagrams or writes
+ * as possible. TCP clients that don't keep up accumulate a backlog, and are
+ * disconnected once it goes over the limit.
+ *
+ * The dew point, and the pressure if the sonde doesn't measure it, are filled
+ * in before sending. JSON lines also carry the geopotential height, the wind
+ * and the lapse rate (see DerivedMeteo).
+ *
+ * Binary records are little-endian, and start with a fixed header:
+ *
+ *   0  char[4]  magic, "RSDF"
+ *   4  u8       version (1)
+ *   5  u8       flags: bit 0 calibrated
+ *   6  u16      total record length, including the header and aux data
+ *   8  i64      receive time, microseconds since the Unix epoch
+ *   16 i64      onboard time, seconds since the Unix epoch
+ *   24 i32      sequence number
+ *   28 i32      burstkill timer, -1 if inactive
+ *   32 f32[11]  lat, lon, alt, speed, heading, climb, temperature, humidity,
+ *               dew point, pressure, calibration percentage
+ *   76 char[32] serial number, NUL-padded
+ *   108         aux data, up to the record length, not NUL-terminated
+ */
+class NetSink {
+public:
+	enum Protocol {
+		PROTOCOL_UDP = 0,
+		PROTOCOL_TCP,
+	};
+	enum Format {
+		FORMAT_BINARY = 0,
+		FORMAT_JSON,
+	};
+
+	/* Connected TCP client, as reported by clients() */
+	struct Client {
+		std::string address;
+		size_t backlog;                 /* Bytes waiting to be sent */
+	};
+
+	/**
+	 * @param capacity maximum number of frames waiting to be sent
+	 * @param maxBacklog maximum bytes waiting to be sent to a TCP client
+	 *        before it gets disconnected
+	 */
+	NetSink(size_t capacity = 256, size_t maxBacklog = 64 * 1024);
+	~NetSink();
+
+	/**
+	 * Start publishing. Any previous endpoint is closed first.
+	 *
+	 * @param protocol UDP or TCP
+	 * @param host numeric IPv4 address: destination for UDP, address to
+	 *        listen on for TCP
+	 * @param port UDP destination port, or TCP port to listen on
+	 * @param format encoding of the frames
+	 * @return false if the socket could not be set up
+	 */
+	bool start(Protocol protocol, const char *host, int port, Format format);
+	void stop();
+
+	/**
+	 * Queue a frame for sending. Never waits for the network.
+	 *
+	 * @param data frame to send
+	 * @return true if queued, false if dropped because the queue is full or
+	 *         the sink is not running
+	 */
+	bool push(const SondeFullData *data);
+
+	/**
+	 * @return currently connected TCP clients
+	 */
+	std::vector<Client> clients();
+
+	unsigned long sent() const { return m_sent; }
+	unsigned long dropped() const { return m_dropped; }
+	unsigned long kicked() const { return m_kicked; }
+	bool running() const { return m_running; }
+
+	/**
+	 * Append a frame to a buffer in the given format
+	 *
+	 * @param dst buffer to append to
+	 * @param data frame to encode
+	 * @param derived quantities derived from the frame, NULL to omit them
+	 * @param format encoding
+	 */
+	static void encode(std::string *dst, const SondeFullData *data, const DerivedMeteo *derived, Format format);
+
+private:
+	struct Connection {
+		intptr_t fd;
+		std::string address;
+		std::string backlog;
+	};
+
+	void workerLoop();
+	void sendUDP(const std::string& buf, const std::vector<size_t>& ends);
+	void acceptClients();
+	void sendTCP();
+	void closeAll();
+
+	/* Queue, shared with the producer */
+	std::mutex m_queueMtx;
+	std::condition_variable m_queueCv;
+	std::vector<SondeFullData> m_ring;
+	size_t m_head, m_count;
+	std::atomic<bool> m_running;
+
+	/* Sockets, owned by the worker thread while running */
+	Protocol m_protocol;
+	Format m_format;
+	intptr_t m_fd;                  /* UDP socket, or TCP listening socket */
+	uint32_t m_host;                /* Network byte order */
+	uint16_t m_port;                /* Network byte order */
+	std::vector<SondeFullData> m_batch;
+	DerivedTracker m_derived;
+	size_t m_maxBacklog;
+
+	/* Client list, also read by clients() */
+	std::mutex m_clientMtx;
+	std::vector<Connection> m_clients;
+
+	std::atomic<unsigned long> m_sent, m_dropped, m_kicked;
+	std::thread m_thread;
+};
@@ -0,0 +1,272 @@
+#include "output.hpp"
+
+OutputWorker::OutputWorker(size_t capacity)
+{
+	m_ring.resize(capacity);
+	m_batch.resize(capacity);
+	m_head = m_count = 0;
+	m_flushInterval = 1000;
+	m_durability = DURABILITY_FLUSH;
+	m_dropped = m_written = 0;
+	m_burstAlt = 30000;
+	m_prediction.valid = false;
+	m_predictionSerial[0] = '\0';
+
+	m_running = true;
+	m_thread = std::thread(&OutputWorker::workerLoop, this);
+}
+
+OutputWorker::~OutputWorker()
+{
+	{
+		std::lock_guard<std::mutex> lck(m_queueMtx);
+		m_running = false;
+	}
+	m_queueCv.notify_one();
+	m_thread.join();
+
+	/* Write out whatever is left, then close the files */
+	std::lock_guard<std::mutex> lck(m_writerMtx);
+	writeQueued();
+	m_gpxWriter.deinit();
+	m_ptuWriter.deinit();
+	m_logWriter.deinit();
+}
+
+bool
+OutputWorker::push(const SondeFullData *data)
+{
+	{
+		std::lock_guard<std::mutex> lck(m_queueMtx);
+		if (m_count == m_ring.size()) {
+			m_dropped++;
+			if (m_metrics) m_metrics->addDropped();
+			return false;
+		}
+		m_ring[(m_head + m_count) % m_ring.size()] = *data;
+		m_count++;
+	}
+	m_queueCv.notify_one();
+	return true;
+}
+
+bool
+OutputWorker::openGPX(const char *fname)
+{
+	std::lock_guard<std::mutex> lck(m_writerMtx);
+	return m_gpxWriter.init(fname);
+}
+
+void
+OutputWorker::closeGPX()
+{
+	std::lock_guard<std::mutex> lck(m_writerMtx);
+	writeQueued();
+	m_gpxWriter.deinit();
+}
+
+bool
+OutputWorker::openPTU(const char *fname)
+{
+	std::lock_guard<std::mutex> lck(m_writerMtx);
+	return m_ptuWriter.init(fname);
+}
+
+void
+OutputWorker::closePTU()
+{
+	std::lock_guard<std::mutex> lck(m_writerMtx);
+	writeQueued();
+	m_ptuWriter.deinit();
+}
+
+bool
+OutputWorker::openLog(const char *fname)
+{
+	std::lock_guard<std::mutex> lck(m_writerMtx);
+	return m_logWriter.init(fname);
+}
+
+void
+OutputWorker::closeLog()
+{
+	std::lock_guard<std::mutex> lck(m_writerMtx);
+	writeQueued();
+	m_logWriter.deinit();
+}
+
+std::string
+OutputWorker::logMovedAside()
+{
+	std::lock_guard<std::mutex> lck(m_writerMtx);
+	return m_logWriter.movedAside();
+}
+
+void
+OutputWorker::stopTrack()
+{
+	std::lock_guard<std::mutex> lck(m_writerMtx);
+	writeQueued();
+	m_gpxWriter.stopTrack();
+	commit();
+}
+
+void
+OutputWorker::setFlushInterval(int ms)
+{
+	m_flushInterval = ms;
+	m_queueCv.notify_one();
+}
+
+void
+OutputWorker::setDurability(Durability durability)
+{
+	m_durability = durability;
+}
+
+void
+OutputWorker::setBurstAltitude(float alt)
+{
+	m_burstAlt = alt;
+}
+
+bool
+OutputWorker::prediction(LandingPredictor::Prediction *dst, char *serial)
+{
+	std::lock_guard<std::mutex> lck(m_predictionMtx);
+
+	if (!m_prediction.valid) return false;
+	*dst = m_prediction;
+	strncpy(serial, m_predictionSerial, SONDE_SERIAL_LEN);
+	return true;
+}
+
+size_t
+OutputWorker::queueDepth()
+{
+	std::lock_guard<std::mutex> lck(m_queueMtx);
+	return m_count;
+}
+
+/* Private methods {{{ */
+void
+OutputWorker::workerLoop()
+{
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_flushInterval);
+	std::unique_lock<std::mutex> lck(m_queueMtx);
+
+	while (m_running) {
+		m_queueCv.wait_until(lck, deadline, [this]{ return !m_running || m_count > 0; });
+		lck.unlock();
+
+		{
+			std::lock_guard<std::mutex> writerLck(m_writerMtx);
+			writeQueued();
+
+			if (std::chrono::steady_clock::now() >= deadline) {
+				commit();
+				deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_flushInterval);
+			}
+		}
+
+		lck.lock();
+	}
+}
+
+/**
+ * Move everything out of the queue, then write it to file. The queue lock is
+ * only held while copying frames, never while doing I/O. Must be called with
+ * m_writerMtx held.
+ */
+void
+OutputWorker::writeQueued()
+{
+	size_t count;
+	int64_t start, now;
+	uint64_t latency, maxLatency;
+
+	for (;;) {
+		{
+			std::lock_guard<std::mutex> lck(m_queueMtx);
+			count = m_count;
+			for (size_t i=0; i<count; i++) {
+				m_batch[i] = m_ring[(m_head + i) % m_ring.size()];
+			}
+			m_head = (m_head + count) % m_ring.size();
+			m_count = 0;
+		}
+
+		if (!count) return;
+
+		start = PipelineMetrics::nowNs();
+		for (size_t i=0; i<count; i++) {
+			SondeFullData *data = &m_batch[i];
+
+			/* Only the PTU and flight log writers need the derived fields */
+			if (m_ptuWriter.isOpen() || m_logWriter.isOpen()) {
+				m_derived.update(data).fill(data);
+			}
+
+			if (data->serial[0]) {
+				m_gpxWriter.startTrack(data->serial);
+			}
+			m_gpxWriter.addTrackPoint(data->time, data->lat, data->lon, data->alt, data->spd, data->hdg);
+
+			if (data->serial[0]) {
+				updatePrediction(data);
+			}
+			m_ptuWriter.addPoint(data);
+			m_logWriter.addPoint(data);
+		}
+		m_written += count;
+
+		if (m_metrics) {
+			now = PipelineMetrics::nowNs();
+			latency = maxLatency = 0;
+			for (size_t i=0; i<count; i++) {
+				const uint64_t frameLatency = std::max<int64_t>(0, now / 1000 - m_batch[i].rxMonotonic);
+				latency += frameLatency;
+				maxLatency = std::max(maxLatency, frameLatency);
+			}
+			m_metrics->addWrite(count, now - start, latency, maxLatency);
+		}
+	}
+}
+
+/**
+ * Feed a frame to the landing predictor of its sonde, and publish the result.
+ * Must be called with m_writerMtx held.
+ */
+void
+OutputWorker::updatePrediction(const SondeFullData *data)
+{
+	LandingPredictor& predictor = m_predictors.update(data);
+	const LandingPredictor::Prediction& prediction = predictor.prediction();
+
+	predictor.setBurstAltitude(m_burstAlt);
+	if (!prediction.valid) return;
+
+	m_gpxWriter.setLandingPoint(prediction.lat, prediction.lon, prediction.time);
+
+	std::lock_guard<std::mutex> lck(m_predictionMtx);
+	m_prediction = prediction;
+	strncpy(m_predictionSerial, data->serial, sizeof(m_predictionSerial)-1);
+	m_predictionSerial[sizeof(m_predictionSerial)-1] = '\0';
+}
+
+/**
+ * Flush the files according to the durability policy. Must be called with
+ * m_writerMtx held.
+ */
+void
+OutputWorker::commit()
+{
+	const bool sync = m_durability == DURABILITY_SYNC;
+
+	if (m_durability == DURABILITY_BUFFERED) return;
+
+	m_gpxWriter.flush(sync);
+	m_ptuWriter.flush(sync);
+	m_logWriter.flush(sync);
+}
+/* }}} */
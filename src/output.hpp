@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "decode/common.hpp"
+#include "derived.hpp"
+#include "flightlog.hpp"
+#include "gpx.hpp"
+#include "metrics.hpp"
+#include "predictor.hpp"
+#include "ptu.hpp"
+
+/**
+ * Dedicated thread that owns the GPX, PTU and flight log writers. Frames are handed over
+ * through a bounded queue, so that slow storage never stalls the caller: if
+ * the queue is full, the frame is dropped and counted. Writes are grouped, and
+ * the files are flushed at most once per flush interval.
+ *
+ * Since it sees every frame in order, it also runs the landing predictor,
+ * whose output goes to the GPX track and to prediction().
+ */
+class OutputWorker {
+public:
+	enum Durability {
+		DURABILITY_BUFFERED = 0,    /* Only flush when closing the files */
+		DURABILITY_FLUSH,           /* Flush to the OS every interval */
+		DURABILITY_SYNC,            /* Flush to disk every interval */
+	};
+
+	OutputWorker(size_t capacity = 256);
+	~OutputWorker();
+
+	/**
+	 * Queue a frame for writing. Never waits for I/O.
+	 *
+	 * @param data frame to write
+	 * @return true if queued, false if dropped because the queue is full
+	 */
+	bool push(const SondeFullData *data);
+
+	bool openGPX(const char *fname);
+	void closeGPX();
+	bool openPTU(const char *fname);
+	void closePTU();
+	bool openLog(const char *fname);
+	void closeLog();
+
+	/**
+	 * @return where the last openLog() moved an incompatible file to, empty
+	 *         if it didn't
+	 */
+	std::string logMovedAside();
+
+	/**
+	 * Write out all the queued frames, then terminate the current GPX track
+	 */
+	void stopTrack();
+
+	void setFlushInterval(int ms);
+	void setDurability(Durability durability);
+
+	/**
+	 * Set the burst altitude the landing predictor assumes during the ascent
+	 *
+	 * @param alt burst altitude, meters
+	 */
+	void setBurstAltitude(float alt);
+
+	/**
+	 * Get the latest landing prediction
+	 *
+	 * @param dst prediction for the sonde whose frame was last written
+	 * @param serial serial number of that sonde, SONDE_SERIAL_LEN bytes
+	 * @return false if there is no prediction yet
+	 */
+	bool prediction(LandingPredictor::Prediction *dst, char *serial);
+
+	/**
+	 * Report write times, reception-to-write latency and drops to the given
+	 * metrics. Must be called before any frame is pushed.
+	 */
+	void setMetrics(PipelineMetrics *metrics) { m_metrics = metrics; }
+
+	size_t queueDepth();
+	size_t queueCapacity() const { return m_ring.size(); }
+	unsigned long dropped() const { return m_dropped; }
+	unsigned long written() const { return m_written; }
+
+private:
+	void workerLoop();
+	void writeQueued();
+	void updatePrediction(const SondeFullData *data);
+	void commit();
+
+	/* Queue, shared with the producer */
+	std::mutex m_queueMtx;
+	std::condition_variable m_queueCv;
+	std::vector<SondeFullData> m_ring;
+	size_t m_head, m_count;
+	bool m_running;
+
+	/* Writers, only touched with m_writerMtx held */
+	std::mutex m_writerMtx;
+	GPXWriter m_gpxWriter;
+	PTUWriter m_ptuWriter;
+	FlightLogWriter m_logWriter;
+	std::vector<SondeFullData> m_batch;
+	DerivedTracker m_derived;
+	PredictorTracker m_predictors;
+	std::atomic<float> m_burstAlt;
+
+	/* Latest prediction, shared with prediction() */
+	std::mutex m_predictionMtx;
+	LandingPredictor::Prediction m_prediction;
+	char m_predictionSerial[SONDE_SERIAL_LEN];
+
+	std::atomic<int> m_flushInterval;
+	std::atomic<int> m_durability;
+	std::atomic<unsigned long> m_dropped, m_written;
+	PipelineMetrics *m_metrics = NULL;
+	std::thread m_thread;
+};
@@ -0,0 +1,216 @@
+#include <algorithm>
+#include <math.h>
+#include "predictor.hpp"
+#include "sondedump/include/data.h"
+
+#define LAYER_HEIGHT 250.0f         /* Meters */
+#define MAX_ALT 50000.0f            /* Meters, top of the highest layer */
+#define LAYER_COUNT ((int)(MAX_ALT / LAYER_HEIGHT))
+#define DENSITY_SCALE_HEIGHT 7200.0f    /* Meters, exponential atmosphere */
+#define ASCENT_MIN_CLIMB 1.0f       /* m/s, slower climbs don't count as ascending */
+#define DESCENT_MIN_SINK 2.0f       /* m/s, slower sinks don't count as descending */
+#define LANDED_MAX_SPEED 1.0f       /* m/s, horizontal and vertical */
+#define PHASE_CHANGE_FRAMES 3       /* Consecutive frames needed to change phase */
+#define LAUNCH_MAX_ALT 3000.0f      /* Meters, first ascent fixes above this aren't the launch site */
+#define RATE_SMOOTHING 0.1f         /* Weight of each new descent rate measurement */
+#define EARTH_RADIUS 6371008.8f     /* Meters, mean radius */
+#define DEG_TO_M (EARTH_RADIUS * (float)M_PI / 180.0f)
+
+/**
+ * sqrt(rho0/rho) at the middle of every layer: terminal velocity scales with
+ * the inverse square root of the air density
+ */
+static const std::vector<float>&
+density_factors()
+{
+	static const std::vector<float> factors = []{
+		std::vector<float> v(LAYER_COUNT);
+		for (int i=0; i<LAYER_COUNT; i++) v[i] = expf((i + 0.5f) * LAYER_HEIGHT / (2 * DENSITY_SCALE_HEIGHT));
+		return v;
+	}();
+	return factors;
+}
+
+LandingPredictor::LandingPredictor(float burstAlt, float descentRate)
+{
+	m_assumedBurstAlt = burstAlt;
+	m_defaultDescentRate = descentRate;
+	m_layers.resize(LAYER_COUNT);
+	reset();
+}
+
+void
+LandingPredictor::reset()
+{
+	for (auto& layer : m_layers) {
+		layer.u = layer.v = 0;
+		layer.count = 0;
+		layer.descent = false;
+	}
+	m_phase = PHASE_UNKNOWN;
+	m_lastTime = 0;
+	m_trend = 0;
+	m_maxAlt = 0;
+	m_groundAlt = NAN;
+	m_seaLevelRate = m_defaultDescentRate;
+	m_rateCalibrated = false;
+	m_prediction.valid = false;
+	m_prediction.phase = PHASE_UNKNOWN;
+}
+
+void
+LandingPredictor::update(const SondeFullData *data)
+{
+	const float hdg = data->hdg * (float)M_PI / 180.0f;
+	bool contradicts;
+
+	if (data->lat == 0 && data->lon == 0) return;       /* No GPS fix yet */
+
+	/* Frames come in fragments, and the first ones of a frame still carry the
+	 * position and velocity of the previous one: wait until both were
+	 * received, then account for the frame once */
+	if ((data->fields & (DATA_POS | DATA_SPEED)) != (DATA_POS | DATA_SPEED)) return;
+	if (data->time == m_lastTime) return;
+	m_lastTime = data->time;
+
+	/* Phase changes need a few consecutive frames to agree, so that a single
+	 * glitch in the climb rate doesn't trigger them */
+	switch (m_phase) {
+		case PHASE_UNKNOWN:
+		case PHASE_ASCENT:
+			contradicts = data->climb < -DESCENT_MIN_SINK;
+			break;
+		case PHASE_DESCENT:
+			contradicts = fabsf(data->climb) < LANDED_MAX_SPEED && data->spd < LANDED_MAX_SPEED;
+			break;
+		default:
+			contradicts = false;
+			break;
+	}
+	m_trend = contradicts ? m_trend + 1 : 0;
+
+	if (m_phase == PHASE_UNKNOWN && data->climb > ASCENT_MIN_CLIMB) {
+		m_phase = PHASE_ASCENT;
+		m_groundAlt = data->alt < LAUNCH_MAX_ALT ? data->alt : 0;
+	} else if (m_trend >= PHASE_CHANGE_FRAMES) {
+		m_phase = m_phase == PHASE_DESCENT ? PHASE_LANDED : PHASE_DESCENT;
+		m_trend = 0;
+	}
+	m_maxAlt = std::max(m_maxAlt, data->alt);
+
+	if (m_phase == PHASE_DESCENT && data->climb < 0) {
+		const int layer = layerIndex(data->alt);
+		const float rate = -data->climb / density_factors()[layer];
+
+		m_seaLevelRate = m_rateCalibrated ? m_seaLevelRate + RATE_SMOOTHING * (rate - m_seaLevelRate) : rate;
+		m_rateCalibrated = true;
+	}
+
+	if (m_phase != PHASE_LANDED) {
+		accumulateWind(data->alt, data->spd * sinf(hdg), data->spd * cosf(hdg));
+	}
+	predict(data);
+}
+
+/* Private methods {{{ */
+/**
+ * Average the wind over each layer. The descent overwrites what was measured
+ * during the ascent, since it is more recent.
+ */
+void
+LandingPredictor::accumulateWind(float alt, float u, float v)
+{
+	Layer& layer = m_layers[layerIndex(alt)];
+	const bool descent = m_phase == PHASE_DESCENT;
+
+	if (descent && !layer.descent) {
+		layer.count = 0;
+		layer.descent = true;
+	}
+
+	layer.count++;
+	layer.u += (u - layer.u) / layer.count;
+	layer.v += (v - layer.v) / layer.count;
+}
+
+/**
+ * Integrate the rest of the flight, one layer at a time, starting with the wind
+ * of the current layer. Layers without a measurement keep the wind of the last
+ * layer integrated: on the way up, the closest measured layer below them, and
+ * on the way down, the closest one above.
+ */
+void
+LandingPredictor::predict(const SondeFullData *data)
+{
+	const std::vector<float>& factors = density_factors();
+	const float ground = isnan(m_groundAlt) ? 0 : m_groundAlt;
+	float alt = data->alt;
+	float burstAlt, ascentRate, u, v, dx, dy, dt, t, top, bottom;
+	int layer, i;
+
+	m_prediction.phase = m_phase;
+
+	if (m_phase == PHASE_LANDED) {
+		m_prediction.valid = true;
+		m_prediction.lat = data->lat;
+		m_prediction.lon = data->lon;
+		m_prediction.time = data->time;
+		return;
+	}
+	if (m_phase == PHASE_UNKNOWN) {
+		m_prediction.valid = false;
+		return;
+	}
+
+	dx = dy = t = 0;
+	layer = layerIndex(alt);
+	u = m_layers[layer].u;
+	v = m_layers[layer].v;
+
+	/* Rest of the ascent, at the current climb rate */
+	burstAlt = m_phase == PHASE_ASCENT ? std::max(m_assumedBurstAlt, alt) : m_maxAlt;
+	if (m_phase == PHASE_ASCENT) {
+		ascentRate = std::max(data->climb, ASCENT_MIN_CLIMB);
+		for (i=layer; i<LAYER_COUNT && i * LAYER_HEIGHT < burstAlt; i++) {
+			top = std::min((i + 1) * LAYER_HEIGHT, burstAlt);
+			bottom = std::max(i * LAYER_HEIGHT, alt);
+			if (m_layers[i].count) {
+				u = m_layers[i].u;
+				v = m_layers[i].v;
+			}
+			dt = (top - bottom) / ascentRate;
+			dx += u * dt;
+			dy += v * dt;
+			t += dt;
+		}
+		alt = burstAlt;
+	}
+
+	/* Descent under the parachute, down to the launch site altitude */
+	for (i=std::min(layerIndex(alt), LAYER_COUNT - 1); i >= 0 && (i + 1) * LAYER_HEIGHT > ground; i--) {
+		top = std::min((i + 1) * LAYER_HEIGHT, alt);
+		bottom = std::max(i * LAYER_HEIGHT, ground);
+		if (top <= bottom) continue;
+		if (m_layers[i].count) {
+			u = m_layers[i].u;
+			v = m_layers[i].v;
+		}
+		dt = (top - bottom) / (m_seaLevelRate * factors[i]);
+		dx += u * dt;
+		dy += v * dt;
+		t += dt;
+	}
+
+	m_prediction.valid = true;
+	m_prediction.burstAlt = burstAlt;
+	m_prediction.lat = data->lat + dy / DEG_TO_M;
+	m_prediction.lon = data->lon + dx / (DEG_TO_M * cosf(data->lat * (float)M_PI / 180.0f));
+	m_prediction.time = data->time + (time_t)t;
+}
+
+int
+LandingPredictor::layerIndex(float alt) const
+{
+	return std::max(0, std::min(LAYER_COUNT - 1, (int)(alt / LAYER_HEIGHT)));
+}
+/* }}} */
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <time.h>
+#include <vector>
+#include "decode/common.hpp"
+#include "serialtracker.hpp"
+
+/**
+ * Landing point prediction for a single sonde, fed with the decoded frames.
+ *
+ * The wind measured by the sonde (its ground velocity) is accumulated in
+ * altitude layers as it flies through them. Every frame, the rest of the
+ * flight is integrated layer by layer from the current altitude: up to the
+ * burst altitude while ascending, then down to the ground under the parachute.
+ * The cost per frame is proportional to the number of layers, regardless of
+ * how long the sonde has been flying.
+ *
+ * Burst is detected from the climb rate. Until then, the burst altitude and
+ * descent rate are assumptions; after it, the descent rate is calibrated on the
+ * observed one, scaled to sea level with the air density.
+ */
+class LandingPredictor {
+public:
+	enum Phase {
+		PHASE_UNKNOWN = 0,
+		PHASE_ASCENT,
+		PHASE_DESCENT,
+		PHASE_LANDED,
+	};
+
+	struct Prediction {
+		bool valid;
+		Phase phase;
+		float lat, lon;                 /* Predicted landing point, degrees */
+		time_t time;                    /* Predicted landing time, onboard clock */
+		float burstAlt;                 /* Observed if descending, assumed otherwise */
+	};
+
+	/**
+	 * @param burstAlt burst altitude assumed during the ascent, meters
+	 * @param descentRate sea level descent rate assumed until burst, m/s
+	 */
+	LandingPredictor(float burstAlt = 30000, float descentRate = 5);
+
+	/**
+	 * Forget the flight, e.g. because the frames now come from a different sonde
+	 */
+	void reset();
+
+	/**
+	 * Account for a new frame, and update the prediction. Fragments that
+	 * don't yet carry both the position and the velocity of their frame, and
+	 * those of a frame that was already accounted for, are ignored.
+	 *
+	 * @param data new frame
+	 */
+	void update(const SondeFullData *data);
+
+	void setBurstAltitude(float alt) { m_assumedBurstAlt = alt; }
+
+	const Prediction& prediction() const { return m_prediction; }
+
+private:
+	struct Layer {
+		float u, v;                     /* Mean wind, m/s eastwards/northwards */
+		int count;
+		bool descent;                   /* Measured during the descent */
+	};
+
+	void accumulateWind(float alt, float u, float v);
+	void predict(const SondeFullData *data);
+	int layerIndex(float alt) const;
+
+	std::vector<Layer> m_layers;
+	float m_assumedBurstAlt, m_defaultDescentRate;
+
+	Phase m_phase;
+	time_t m_lastTime;
+	int m_trend;                    /* Consecutive frames contradicting the phase */
+	float m_maxAlt, m_groundAlt;
+	float m_seaLevelRate;           /* Descent rate at sea level, m/s */
+	bool m_rateCalibrated;
+	Prediction m_prediction;
+};
+
+/* One LandingPredictor per sonde, for streams that interleave several of them */
+typedef SerialTracker<LandingPredictor> PredictorTracker;
@@ -1,4 +1,5 @@
 #include "ptu.hpp"
+#include "utils.hpp"
 
 bool
 PTUWriter::init(const char *fname)
@@ -8,7 +9,7 @@ PTUWriter::init(const char *fname)
 	m_fd = fopen(fname, "wb");
 	if(!m_fd) return false;
 
-	fprintf(m_fd, "Epoch,Temperature,Relative humidity,Dew point,Pressure,Latitude,Longitude,Altitude,Speed,Heading,Climb,XDATA\n");
+	fprintf(m_fd, "Epoch,Latency,Temperature,Relative humidity,Dew point,Pressure,Latitude,Longitude,Altitude,Speed,Heading,Climb,XDATA\n");
 
 	return true;
 }
@@ -22,14 +23,24 @@ PTUWriter::deinit()
 }
 
 void
-PTUWriter::addPoint(SondeFullData *data)
+PTUWriter::addPoint(const SondeFullData *data)
 {
 	if (!m_fd) return;
-	fprintf(m_fd, "%ld,%.1f,%.1f,%.1f,%.1f,%.6f,%.6f,%.1f,%.1f,%.1f,%.1f,%s\n",
-			data->time,
+
+	/* Latency in milliseconds, left empty if unknown (e.g. offline decoding) */
+	fprintf(m_fd, "%ld,", data->time);
+	if (data->captureMonotonic) fprintf(m_fd, "%.1f", (data->rxMonotonic - data->captureMonotonic) * 1e-3);
+	fprintf(m_fd, ",%.1f,%.1f,%.1f,%.1f,%.6f,%.6f,%.1f,%.1f,%.1f,%.1f,%s\n",
 			data->temp, data->rh, data->dewpt, data->pressure,
 			data->lat, data->lon, data->alt,
 			data->spd, data->hdg, data->climb,
-			data->auxData.c_str());
+			data->auxData);
+}
+
+void
+PTUWriter::flush(bool sync)
+{
+	if (!m_fd) return;
 	fflush(m_fd);
+	if (sync) syncFile(m_fd);
 }
@@ -14,13 +14,21 @@ public:
 
 	bool init(const char *fname);
 	void deinit();
+	bool isOpen() const { return m_fd != NULL; }
 
 	/**
 	 * Log a new point to file.
 	 *
 	 * @param data data to log
 	 */
-	void addPoint(SondeFullData *data);
+	void addPoint(const SondeFullData *data);
+
+	/**
+	 * Push buffered lines to the OS.
+	 *
+	 * @param sync whether to also wait for the data to hit the disk
+	 */
+	void flush(bool sync);
 private:
 	FILE *m_fd;
 };
@@ -0,0 +1,64 @@
+#include <algorithm>
+#include <math.h>
+#include "scanner.hpp"
+
+void
+CarrierScanner::configure(double binWidth, int bins, double bandwidth, double span)
+{
+	m_binWidth = binWidth;
+	m_bins = bins;
+	m_halfSpan = std::min(bins / 2 - 1, (int)(span / binWidth));
+	m_window = std::max(1, (int)lround(bandwidth / binWidth));
+
+	m_ordered.resize(2 * m_halfSpan + 1);
+	m_sorted.resize(m_ordered.size());
+	m_prefix.resize(m_ordered.size() + 1);
+}
+
+int
+CarrierScanner::detect(const std::vector<float>& power, std::vector<double> *carriers)
+{
+	const int count = m_ordered.size();
+	const int half = m_window / 2;
+	double threshold, level;
+	int i, start;
+	bool inRun;
+
+	carriers->clear();
+	if ((int)power.size() != m_bins || !count) return 0;
+
+	/* Frequency order, lowest first, restricted to the span */
+	for (i=0; i<count; i++) {
+		m_ordered[i] = power[(i - m_halfSpan + m_bins) % m_bins];
+	}
+
+	std::copy(m_ordered.begin(), m_ordered.end(), m_sorted.begin());
+	std::nth_element(m_sorted.begin(), m_sorted.begin() + count / 2, m_sorted.end());
+	m_floor = m_sorted[count / 2];
+	threshold = m_floor * pow(10, m_threshold / 10);
+
+	/* Moving average over the channel bandwidth, with prefix sums so that the
+	 * cost doesn't depend on the bandwidth */
+	m_prefix[0] = 0;
+	for (i=0; i<count; i++) m_prefix[i+1] = m_prefix[i] + m_ordered[i];
+
+	/* The smoothed spectrum of a carrier is a plateau as wide as the channel
+	 * minus the signal: its middle is a steadier estimate than its peak */
+	inRun = false;
+	start = 0;
+	for (i=0; i<=count; i++) {
+		const int lo = std::max(0, i - half);
+		const int hi = std::min(count, i - half + m_window);
+
+		level = i < count && hi > lo ? (m_prefix[hi] - m_prefix[lo]) / (hi - lo) : 0;
+		if (level > threshold) {
+			if (!inRun) start = i;
+			inRun = true;
+		} else if (inRun) {
+			carriers->push_back(((start + i - 1) / 2.0 - m_halfSpan) * m_binWidth);
+			inRun = false;
+		}
+	}
+
+	return carriers->size();
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+
+/**
+ * Energy detector for carriers in a wideband power spectrum, such as the one
+ * accumulated by FilterBank.
+ *
+ * The spectrum is smoothed over the bandwidth of a channel, and compared to
+ * the noise floor, estimated as the median bin power: carriers only take a
+ * small fraction of the band, so they don't bias it. Every run of smoothed bins
+ * above the threshold is reported as one carrier, centered on the run.
+ */
+class CarrierScanner {
+public:
+	CarrierScanner() {};
+
+	/**
+	 * @param binWidth frequency resolution of the spectrum, in Hz
+	 * @param bins number of bins in the spectrum
+	 * @param bandwidth bandwidth of a channel, in Hz
+	 * @param span carriers further than this from the center of the spectrum
+	 *        are ignored, in Hz
+	 */
+	void configure(double binWidth, int bins, double bandwidth, double span);
+
+	/**
+	 * @param snr level above the noise floor a carrier must reach, over the
+	 *        channel bandwidth, dB
+	 */
+	void setThreshold(float snr) { m_threshold = snr; }
+
+	/**
+	 * Find the carriers in a power spectrum
+	 *
+	 * @param power power per bin, in FFT order (DC first, negative frequencies
+	 *        last), in any unit
+	 * @param carriers filled with the offset of each carrier from the center
+	 *        of the spectrum, in Hz
+	 * @return number of carriers found
+	 */
+	int detect(const std::vector<float>& power, std::vector<double> *carriers);
+
+	float noiseFloor() const { return m_floor; }     /* Mean power per bin, as of the last detect() */
+
+private:
+	double m_binWidth;
+	int m_bins, m_halfSpan, m_window;
+	float m_threshold = 6;
+	float m_floor = 0;
+
+	std::vector<float> m_ordered, m_sorted;
+	std::vector<double> m_prefix;
+};
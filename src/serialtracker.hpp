@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "decode/common.hpp"
+
+/**
+ * Per-sonde state for a stream that interleaves frames from several sondes,
+ * such as the one fed by the channelizer lanes. Keeps one T per serial number,
+ * recycling the least recently updated one when full.
+ *
+ * T must provide reset(), called when it is recycled for a new serial number,
+ * and update(const SondeFullData*).
+ */
+template<typename T>
+class SerialTracker {
+public:
+	SerialTracker(size_t capacity = 8) {
+		m_entries.resize(capacity);
+		for (auto& entry : m_entries) {
+			entry.serial[0] = '\0';
+			entry.lastUsed = 0;
+		}
+		m_clock = 0;
+	}
+
+	/**
+	 * Feed a new frame to the state of its sonde
+	 *
+	 * @param data new frame
+	 * @return state of the sonde
+	 */
+	T& update(const SondeFullData *data) {
+		Entry *entry = &m_entries[0];
+
+		for (auto& candidate : m_entries) {
+			if (!strncmp(candidate.serial, data->serial, sizeof(candidate.serial))) {
+				entry = &candidate;
+				break;
+			}
+			if (candidate.lastUsed < entry->lastUsed) entry = &candidate;
+		}
+
+		if (strncmp(entry->serial, data->serial, sizeof(entry->serial))) {
+			strncpy(entry->serial, data->serial, sizeof(entry->serial)-1);
+			entry->serial[sizeof(entry->serial)-1] = '\0';
+			entry->state.reset();
+		}
+
+		entry->lastUsed = ++m_clock;
+		entry->state.update(data);
+		return entry->state;
+	}
+
+private:
+	struct Entry {
+		char serial[SONDE_SERIAL_LEN];
+		uint64_t lastUsed;
+		T state;
+	};
+
+	std::vector<Entry> m_entries;
+	uint64_t m_clock;
+};
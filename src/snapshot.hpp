@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+/**
+ * Lock-free single-producer, single-consumer triple buffer. Neither side ever
+ * waits for the other: the producer always has a free slot to write to, and
+ * the consumer always gets the most recently published value in its entirety.
+ * Every published value is tagged with a generation counter, so that the
+ * consumer can tell whether anything changed since its last read.
+ */
+template<typename T>
+class TripleBuffer {
+public:
+	TripleBuffer() : m_back(0), m_middle(1), m_front(2), m_generation(0) {
+		for (int i=0; i<3; i++) m_slots[i].generation = 0;
+	};
+
+	/**
+	 * Get the slot the producer should write to. Its contents are whatever
+	 * was published two generations ago, so it must be fully overwritten.
+	 *
+	 * @return reference to the write slot, valid until the next publish()
+	 */
+	T& writeBuffer() { return m_slots[m_back].data; }
+
+	/**
+	 * Make the contents of the write slot visible to the consumer
+	 */
+	void publish() {
+		m_slots[m_back].generation = ++m_generation;
+		m_back = m_middle.exchange(m_back | DIRTY_BIT, std::memory_order_acq_rel) & INDEX_MASK;
+	}
+
+	/**
+	 * Get the most recently published value.
+	 *
+	 * @return reference to the value, valid until the next call to read()
+	 */
+	const T& read() {
+		if (m_middle.load(std::memory_order_relaxed) & DIRTY_BIT) {
+			m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & INDEX_MASK;
+		}
+		return m_slots[m_front].data;
+	}
+
+	/**
+	 * @return generation of the value returned by the last read(), 0 if
+	 *         nothing has been published yet
+	 */
+	uint64_t generation() const { return m_slots[m_front].generation; }
+
+private:
+	static constexpr int DIRTY_BIT = 0x4;
+	static constexpr int INDEX_MASK = 0x3;
+
+	struct Slot {
+		T data;
+		uint64_t generation;
+	};
+
+	Slot m_slots[3];
+	int m_back;
+	std::atomic<int> m_middle;
+	int m_front;
+	uint64_t m_generation;
+};
@@ -0,0 +1,74 @@
+#include <algorithm>
+#include <math.h>
+#include "squelch.hpp"
+
+#define SMOOTHING_TIME 0.05         /* Seconds, time constant of the estimate */
+#define HANG_TIME 1.0               /* Seconds below the threshold before closing */
+#define HYSTERESIS 3.0f             /* dB between the opening and closing thresholds */
+#define SNR_FLOOR -40.0f            /* dB, reported when there is no carrier at all */
+
+CarrierSquelch::CarrierSquelch()
+{
+	m_threshold = 0;
+	setSamplerate(48000);
+	reset();
+}
+
+void
+CarrierSquelch::setSamplerate(double samplerate)
+{
+	m_alpha = 1.0 / (SMOOTHING_TIME * samplerate);
+	m_hangSamples = (long)(HANG_TIME * samplerate);
+}
+
+void
+CarrierSquelch::reset()
+{
+	m_power = m_power2 = 0;
+	m_belowSamples = 0;
+	m_primed = false;
+	m_open = true;
+	m_snr = SNR_FLOOR;
+}
+
+bool
+CarrierSquelch::update(const dsp::complex_t *in, int count)
+{
+	double sum = 0, sum2 = 0, weight;
+	float variance, snr;
+
+	if (count <= 0) return m_open;
+
+	for (int i=0; i<count; i++) {
+		const float p = in[i].re * in[i].re + in[i].im * in[i].im;
+		sum += p;
+		sum2 += p * p;
+	}
+
+	/* Exponential smoothing, applied once per buffer with the weight of all of
+	 * its samples, so that the time constant doesn't depend on the buffer size */
+	weight = m_primed ? 1.0 - pow(1.0 - m_alpha, count) : 1.0;
+	m_power += weight * (sum / count - m_power);
+	m_power2 += weight * (sum2 / count - m_power2);
+	m_primed = true;
+
+	/* Invert the normalized variance to get the SNR */
+	if (m_power > 0) {
+		variance = (m_power2 - m_power * m_power) / (m_power * m_power);
+		snr = variance < 1 ? 10 * log10f(((1 - variance) + sqrtf(1 - variance)) / std::max(variance, 1e-6f)) : SNR_FLOOR;
+		snr = std::max(snr, SNR_FLOOR);
+	} else {
+		snr = SNR_FLOOR;
+	}
+	m_snr = snr;
+
+	if (snr >= m_threshold) {
+		m_open = true;
+		m_belowSamples = 0;
+	} else if (snr < m_threshold - HYSTERESIS) {
+		m_belowSamples += count;
+		if (m_belowSamples >= m_hangSamples) m_open = false;
+	}
+
+	return m_open;
+}
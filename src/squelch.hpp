@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <dsp/types.h>
+
+/**
+ * Carrier detector for a narrowband IQ channel, used to skip demodulation and
+ * decoding while nothing is transmitting.
+ *
+ * The SNR is estimated from the envelope alone: the power of a constant
+ * envelope (FM) carrier in white noise has a normalized variance of
+ * (1 + 2 snr) / (1 + snr)^2, which only depends on the SNR, not on the gain or
+ * the noise floor. Noise alone gives 1, a clean carrier 0. No calibration is
+ * needed, and it only costs a few multiply-adds per sample.
+ *
+ * The squelch opens as soon as the SNR reaches the threshold, and closes once
+ * it has stayed below the threshold minus the hysteresis for the hang time.
+ */
+class CarrierSquelch {
+public:
+	CarrierSquelch();
+
+	/**
+	 * @param samplerate sample rate of the IQ stream, in Hz
+	 */
+	void setSamplerate(double samplerate);
+
+	/**
+	 * @param snr SNR the squelch opens at, dB
+	 */
+	void setThreshold(float snr) { m_threshold = snr; }
+
+	/**
+	 * Forget the current estimate. The squelch starts open, so that nothing
+	 * is lost while the estimate settles.
+	 */
+	void reset();
+
+	/**
+	 * Update the estimate with a new buffer of samples
+	 *
+	 * @param in IQ samples
+	 * @param count number of samples in in
+	 * @return true if the squelch is open, i.e. in should be processed
+	 */
+	bool update(const dsp::complex_t *in, int count);
+
+	bool open() const { return m_open; }
+	float snr() const { return m_snr; }      /* dB, as of the last update */
+
+private:
+	float m_threshold;
+	float m_alpha;                  /* Smoothing weight of a single sample */
+	long m_hangSamples;
+
+	double m_power, m_power2;       /* Smoothed mean of |x|^2 and |x|^4 */
+	long m_belowSamples;            /* Samples spent below the closing threshold */
+	bool m_primed;
+	std::atomic<bool> m_open;
+	std::atomic<float> m_snr;
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <mutex>
+#include <stdint.h>
+
+#define STREAM_CLOCK_DEPTH 16
+
+/**
+ * Timestamps of the buffers in flight on a dsp::stream, pushed by the writer
+ * right before each swap() and popped by the reader right after each read().
+ *
+ * The stream holds a single buffer, so the writer can only be one buffer ahead
+ * of the reader: more than two stamps queued means some buffers were dropped
+ * without being read (e.g. a reader stopped mid-buffer), and the oldest stamps
+ * are discarded to catch up. The sample count of each buffer is checked too.
+ */
+class StreamClock {
+public:
+	struct Stamp {
+		int count;                  /* Samples in the buffer */
+		int64_t capture;            /* Input samples read by the writer (microseconds, monotonic clock) */
+		int64_t ready;              /* Output samples handed to the stream (same clock) */
+	};
+
+	StreamClock() { clear(); }
+
+	void push(int count, int64_t capture, int64_t ready) {
+		std::lock_guard<std::mutex> lck(m_mtx);
+
+		if (m_size == STREAM_CLOCK_DEPTH) pop();
+		m_stamps[(m_head + m_size++) % STREAM_CLOCK_DEPTH] = {count, capture, ready};
+	}
+
+	/**
+	 * Take the stamp of the buffer just read
+	 *
+	 * @param count number of samples read
+	 * @param stamp filled with the stamp of the buffer
+	 * @return false if there is no stamp for it
+	 */
+	bool take(int count, Stamp *stamp) {
+		std::lock_guard<std::mutex> lck(m_mtx);
+
+		while (m_size > 2) pop();
+		while (m_size > 0) {
+			*stamp = m_stamps[m_head];
+			pop();
+			if (stamp->count == count) return true;
+		}
+		return false;
+	}
+
+	/**
+	 * Forget all the stamps. Only safe while neither side is running, e.g.
+	 * after flushing the stream.
+	 */
+	void clear() {
+		std::lock_guard<std::mutex> lck(m_mtx);
+		m_head = m_size = 0;
+	}
+
+private:
+	void pop() {
+		m_head = (m_head + 1) % STREAM_CLOCK_DEPTH;
+		m_size--;
+	}
+
+	std::mutex m_mtx;
+	Stamp m_stamps[STREAM_CLOCK_DEPTH];
+	int m_head, m_size;
+};
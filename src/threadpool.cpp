@@ -0,0 +1,105 @@
+#include "threadpool.hpp"
+
+void
+ThreadPool::start(int threads)
+{
+	if (m_running) stop();
+
+	m_running = true;
+	for (int i=0; i<threads; i++) {
+		m_threads.emplace_back(&ThreadPool::workerLoop, this);
+	}
+}
+
+void
+ThreadPool::stop()
+{
+	if (!m_running) return;
+
+	{
+		std::lock_guard<std::mutex> lck(m_mtx);
+		m_running = false;
+	}
+	m_jobCv.notify_all();
+
+	for (auto& thread : m_threads) thread.join();
+	m_threads.clear();
+}
+
+void
+ThreadPool::parallelFor(int count, void (*fn)(int idx, void *ctx), void *ctx)
+{
+	if (count <= 0) return;
+
+	/* Nobody to share the work with: run everything inline */
+	if (m_threads.empty() || count == 1) {
+		for (int i=0; i<count; i++) fn(i, ctx);
+		return;
+	}
+
+	{
+		/* Wait for workers still draining the previous job to leave it, so
+		 * that nobody can claim an index of the new job with stale bounds */
+		std::unique_lock<std::mutex> lck(m_mtx);
+		m_doneCv.wait(lck, [this]{ return m_active == 0; });
+
+		m_fn = fn;
+		m_ctx = ctx;
+		m_count = count;
+		m_next = 0;
+		m_pending = count;
+		m_generation++;
+	}
+	m_jobCv.notify_all();
+
+	/* Help out, then wait for the stragglers */
+	work();
+
+	std::unique_lock<std::mutex> lck(m_mtx);
+	m_doneCv.wait(lck, [this]{ return m_pending == 0; });
+}
+
+void
+ThreadPool::workerLoop()
+{
+	unsigned long lastGeneration;
+
+	/* Whatever job was posted before this worker started is not its own */
+	{
+		std::lock_guard<std::mutex> lck(m_mtx);
+		lastGeneration = m_generation;
+	}
+
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lck(m_mtx);
+			m_jobCv.wait(lck, [&]{ return !m_running || m_generation != lastGeneration; });
+			if (!m_running) return;
+			lastGeneration = m_generation;
+			m_active++;
+		}
+
+		work();
+
+		{
+			std::lock_guard<std::mutex> lck(m_mtx);
+			m_active--;
+		}
+		m_doneCv.notify_all();
+	}
+}
+
+void
+ThreadPool::work()
+{
+	int idx;
+
+	while ((idx = m_next++) < m_count) {
+		m_fn(idx, m_ctx);
+
+		if (--m_pending == 0) {
+			std::lock_guard<std::mutex> lck(m_mtx);
+			m_doneCv.notify_all();
+		}
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Minimal fork-join thread pool. A job is a function that gets called once for
+ * each index in a range; the calling thread takes part in the work, and
+ * parallelFor() only returns once every index has been processed.
+ */
+class ThreadPool {
+public:
+	ThreadPool() {};
+	~ThreadPool() { stop(); };
+
+	/**
+	 * Spawn the worker threads. If the pool is already running, it will be
+	 * restarted with the new thread count.
+	 *
+	 * @param threads number of worker threads, not counting the caller
+	 */
+	void start(int threads);
+
+	/**
+	 * Join all the worker threads. If no threads are running, this method has
+	 * no effect.
+	 */
+	void stop();
+
+	/**
+	 * Run fn(idx, ctx) for every idx in [0, count), and wait for completion.
+	 * Not reentrant: only one thread at a time may submit jobs.
+	 *
+	 * @param count number of indices to process
+	 * @param fn function to call for every index
+	 * @param ctx opaque pointer passed to fn
+	 */
+	void parallelFor(int count, void (*fn)(int idx, void *ctx), void *ctx);
+
+	/**
+	 * @return number of worker threads currently running
+	 */
+	int size() const { return m_threads.size(); }
+
+private:
+	void workerLoop();
+	void work();
+
+	std::vector<std::thread> m_threads;
+	std::mutex m_mtx;
+	std::condition_variable m_jobCv, m_doneCv;
+	bool m_running = false;
+	unsigned long m_generation = 0;
+	int m_active = 0;
+
+	void (*m_fn)(int idx, void *ctx);
+	void *m_ctx;
+	int m_count;
+	std::atomic<int> m_next, m_pending;
+};
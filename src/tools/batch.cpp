@@ -0,0 +1,407 @@
+/**
+ * Offline batch decoder for recording archives. Recordings (files, or every
+ * recording found in a directory) are split into chunks that overlap by a few
+ * seconds, the chunks are decoded in parallel on all the cores, and the
+ * results are merged into one GPX track and one PTU CSV per sonde serial,
+ * using the same writers as the plugin.
+ *
+ * Each chunk starts decoding a little before its nominal start, so that the
+ * decoder can acquire sync and collect the serial number, but only keeps the
+ * frames completed after it. Chunk boundaries line up with read boundaries,
+ * so every frame is reported by exactly one chunk.
+ */
+#include <algorithm>
+#include <chrono>
+#include <ctype.h>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "decode/autodetect.hpp"
+#include "derived.hpp"
+#include "fmresampler.hpp"
+#include "gpx.hpp"
+#include "ptu.hpp"
+#include "threadpool.hpp"
+#include "tools/sondetypes.hpp"
+#include "tools/wavreader.hpp"
+
+#define CHUNK_SIZE 8192
+#define DEFAULT_CHUNK_SEC 600
+#define DEFAULT_OVERLAP_SEC 10
+
+typedef struct {
+	std::string fname;
+	double samplerate;
+	int channels;
+	uint64_t length;            /* Samples, 0 if unknown */
+} recording_t;
+
+typedef struct {
+	int recording;
+	uint64_t start, end;        /* Frames completed in [start, end) are kept */
+	uint64_t warmup;            /* Samples decoded before start */
+	std::vector<SondeFullData> frames;
+	unsigned long skipped;      /* Frames without a serial number */
+	bool keep;                  /* Whether the current block is past the warm-up */
+} batchjob_t;
+
+typedef struct {
+	std::vector<recording_t> recordings;
+	std::vector<batchjob_t> jobs;
+	std::vector<int> order;     /* Longest jobs first */
+	const char *typeFilter;
+	bool rawIQ, rawFM;
+	double rawSamplerate, outSamplerate;
+	int done;                   /* Progress, protected by printMtx */
+	std::mutex printMtx;
+} batchctx_t;
+
+typedef struct {
+	std::string serial;
+	std::vector<const SondeFullData*> frames;
+	const char *outDir;
+	bool ok;
+} batchserial_t;
+
+static void add_path(batchctx_t *ctx, const char *path);
+static bool open_recording(const batchctx_t *ctx, WavReader *reader, const char *fname);
+static void plan_jobs(batchctx_t *ctx, double chunkSec, double overlapSec);
+static void decode_job(int idx, void *ctx);
+static void write_serial(int idx, void *ctx);
+static void on_data(const SondeFullData *data, void *ctx);
+static std::string sanitize(const char *serial);
+static void usage(const char *pname);
+
+int
+main(int argc, char *argv[])
+{
+	const char *outDir = ".";
+	double chunkSec = DEFAULT_CHUNK_SEC, overlapSec = DEFAULT_OVERLAP_SEC;
+	int threads = std::thread::hardware_concurrency();
+	std::vector<const char*> paths;
+	std::map<std::string, batchserial_t> serials;
+	std::vector<batchserial_t*> serialList;
+	unsigned long frameCount = 0, skipped = 0;
+	double audioSec = 0;
+	ThreadPool pool;
+	batchctx_t ctx;
+	std::chrono::steady_clock::time_point start;
+	double wallSec;
+
+	ctx.typeFilter = NULL;
+	ctx.rawIQ = ctx.rawFM = false;
+	ctx.rawSamplerate = 0;
+	ctx.outSamplerate = 0;
+	ctx.done = 0;
+
+	for (int i=1; i<argc; i++) {
+		if (!strcmp(argv[i], "-r") && i+1 < argc) {
+			ctx.rawSamplerate = atof(argv[++i]);
+		} else if (!strcmp(argv[i], "-f") && i+1 < argc) {
+			i++;
+			ctx.rawIQ = !strcmp(argv[i], "iq");
+			ctx.rawFM = !strcmp(argv[i], "fm");
+			if (!ctx.rawIQ && !ctx.rawFM) {
+				usage(argv[0]);
+				return 1;
+			}
+		} else if (!strcmp(argv[i], "-d") && i+1 < argc) {
+			ctx.outSamplerate = atof(argv[++i]);
+		} else if (!strcmp(argv[i], "-t") && i+1 < argc) {
+			ctx.typeFilter = argv[++i];
+		} else if (!strcmp(argv[i], "-o") && i+1 < argc) {
+			outDir = argv[++i];
+		} else if (!strcmp(argv[i], "-j") && i+1 < argc) {
+			threads = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-c") && i+1 < argc) {
+			chunkSec = atof(argv[++i]);
+		} else if (!strcmp(argv[i], "-v") && i+1 < argc) {
+			overlapSec = atof(argv[++i]);
+		} else if (argv[i][0] != '-') {
+			paths.push_back(argv[i]);
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (paths.empty() || ((ctx.rawIQ || ctx.rawFM) && ctx.rawSamplerate <= 0) || chunkSec <= 0 || overlapSec < 0) {
+		usage(argv[0]);
+		return 1;
+	}
+	if (ctx.typeFilter && !strcmp(ctx.typeFilter, "auto")) ctx.typeFilter = NULL;
+
+	for (auto path : paths) add_path(&ctx, path);
+	if (ctx.recordings.empty()) {
+		fprintf(stderr, "No recordings found\n");
+		return 1;
+	}
+	plan_jobs(&ctx, chunkSec, overlapSec);
+
+	for (auto& rec : ctx.recordings) audioSec += rec.length / rec.samplerate;
+	fprintf(stderr, "%zu recordings (%.1f hours), %zu chunks, %d threads\n",
+	        ctx.recordings.size(), audioSec / 3600, ctx.jobs.size(), std::max(threads, 1));
+
+	/* The calling thread also takes jobs */
+	start = std::chrono::steady_clock::now();
+	pool.start(std::max(threads, 1) - 1);
+	pool.parallelFor(ctx.order.size(), decode_job, &ctx);
+	fprintf(stderr, "\n");
+
+	/* Jobs are in recording/chunk order, so frames come out in time order */
+	for (auto& job : ctx.jobs) {
+		for (auto& frame : job.frames) {
+			batchserial_t& serial = serials[frame.serial];
+			if (serial.frames.empty()) {
+				serial.serial = frame.serial;
+				serial.outDir = outDir;
+			}
+			serial.frames.push_back(&frame);
+			frameCount++;
+		}
+		skipped += job.skipped;
+	}
+	for (auto& entry : serials) serialList.push_back(&entry.second);
+	pool.parallelFor(serialList.size(), write_serial, serialList.data());
+	pool.stop();
+
+	wallSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	for (auto serial : serialList) {
+		printf("%-16s %8zu frames%s\n", serial->serial.c_str(), serial->frames.size(),
+		       serial->ok ? "" : " (could not write output)");
+	}
+	fprintf(stderr, "%lu frames from %zu sondes, %lu frames without serial skipped, "
+	        "decoded in %.1fs (%.0fx real time)\n",
+	        frameCount, serialList.size(), skipped, wallSec, audioSec / std::max(wallSec, 1e-3));
+	return 0;
+}
+
+/* Static functions {{{ */
+/**
+ * Add a recording, or all the recordings in a directory and its
+ * subdirectories. Without -f, only .wav files are picked up from directories.
+ */
+static void
+add_path(batchctx_t *ctx, const char *path)
+{
+	std::vector<std::string> fnames;
+	std::error_code err;
+	WavReader reader;
+
+	if (std::filesystem::is_directory(path, err)) {
+		for (auto& entry : std::filesystem::recursive_directory_iterator(path, err)) {
+			std::string ext = entry.path().extension().string();
+			std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+			if (!entry.is_regular_file()) continue;
+			if (!ctx->rawIQ && !ctx->rawFM && ext != ".wav") continue;
+			fnames.push_back(entry.path().string());
+		}
+		std::sort(fnames.begin(), fnames.end());
+	} else {
+		fnames.push_back(path);
+	}
+
+	for (auto& fname : fnames) {
+		if (!open_recording(ctx, &reader, fname.c_str())) {
+			fprintf(stderr, "%s: unsupported file, skipping (use -f and -r for raw float32 files)\n", fname.c_str());
+			continue;
+		}
+		ctx->recordings.push_back({fname, reader.samplerate(), reader.channels(), reader.length()});
+	}
+}
+
+static bool
+open_recording(const batchctx_t *ctx, WavReader *reader, const char *fname)
+{
+	if (ctx->rawIQ || ctx->rawFM) return reader->initRaw(fname, ctx->rawIQ ? 2 : 1, ctx->rawSamplerate);
+	return reader->init(fname);
+}
+
+/**
+ * Split every recording into chunks, and sort them longest first so that the
+ * last few jobs to be picked up are short ones
+ */
+static void
+plan_jobs(batchctx_t *ctx, double chunkSec, double overlapSec)
+{
+	for (size_t r=0; r<ctx->recordings.size(); r++) {
+		const recording_t& rec = ctx->recordings[r];
+		const uint64_t chunkLen = std::max<uint64_t>(CHUNK_SIZE, chunkSec * rec.samplerate);
+		const uint64_t overlap = overlapSec * rec.samplerate;
+		uint64_t start = 0;
+
+		do {
+			batchjob_t job;
+			job.recording = r;
+			job.start = start;
+			job.end = rec.length ? std::min(start + chunkLen, rec.length) : UINT64_MAX;
+			job.warmup = std::min(start, overlap);
+			job.skipped = 0;
+			ctx->jobs.push_back(job);
+			start += chunkLen;
+		} while (start < rec.length);
+	}
+
+	for (size_t i=0; i<ctx->jobs.size(); i++) ctx->order.push_back(i);
+	std::stable_sort(ctx->order.begin(), ctx->order.end(), [ctx](int a, int b) {
+		const batchjob_t& ja = ctx->jobs[a];
+		const batchjob_t& jb = ctx->jobs[b];
+		return ja.end - ja.start + ja.warmup > jb.end - jb.start + jb.warmup;
+	});
+}
+
+/**
+ * Decode a chunk of a recording, collecting the frames completed within it
+ */
+static void
+decode_job(int idx, void *_ctx)
+{
+	batchctx_t *ctx = (batchctx_t*)_ctx;
+	batchjob_t *job = &ctx->jobs[ctx->order[idx]];
+	const recording_t& rec = ctx->recordings[job->recording];
+	std::vector<dsp::complex_t> iq(CHUNK_SIZE);
+	std::vector<float> fm;
+	std::vector<radiosonde::DecoderBase*> decoders;
+	radiosonde::AutoDecoder autoDecoder;
+	radiosonde::DecoderBase *decoder;
+	FMResampler demod;
+	WavReader reader;
+	double outSamplerate;
+	uint64_t pos, boundary;
+	int count, total;
+
+	total = ctx->jobs.size();
+	if (!open_recording(ctx, &reader, rec.fname.c_str()) || !reader.seek(job->start - job->warmup)) {
+		std::lock_guard<std::mutex> lck(ctx->printMtx);
+		fprintf(stderr, "\n%s: read error\n", rec.fname.c_str());
+		return;
+	}
+
+	/* FM recordings are decoded at their own rate */
+	outSamplerate = rec.channels == 2 && ctx->outSamplerate > 0 ? ctx->outSamplerate : rec.samplerate;
+	if (rec.channels == 2) {
+		demod.init(NULL, rec.samplerate, rec.samplerate / 2.0f, outSamplerate);
+		fm.resize(demod.maxOutput(CHUNK_SIZE));
+	} else {
+		fm.resize(CHUNK_SIZE);
+	}
+
+	for (int t=0; t<sondeTypeCount; t++) {
+		if (ctx->typeFilter && !type_selected(ctx->typeFilter, sondeTypes[t].name)) continue;
+		decoders.push_back(sondeTypes[t].create(outSamplerate, on_data, job));
+	}
+	if (decoders.size() == 1) {
+		decoder = decoders[0];
+	} else {
+		/* Chunks already run in parallel, no need for more threads */
+		autoDecoder.init(NULL, outSamplerate, decoders.data(), decoders.size(), 0);
+		decoder = &autoDecoder;
+	}
+
+	job->keep = false;
+
+	/* Read in blocks that never straddle the nominal start, so that each
+	 * block is either entirely warm-up or entirely kept */
+	pos = job->start - job->warmup;
+	while (pos < job->end) {
+		boundary = pos < job->start ? job->start : job->end;
+		count = std::min<uint64_t>(CHUNK_SIZE, boundary - pos);
+
+		if (rec.channels == 2) {
+			if ((count = reader.read((float*)iq.data(), count)) <= 0) break;
+			job->keep = pos >= job->start;
+			pos += count;
+			decoder->process(fm.data(), demod.process(count, iq.data(), fm.data()));
+		} else {
+			if ((count = reader.read(fm.data(), count)) <= 0) break;
+			job->keep = pos >= job->start;
+			pos += count;
+			decoder->process(fm.data(), count);
+		}
+	}
+
+	for (auto d : decoders) delete d;
+
+	{
+		std::lock_guard<std::mutex> lck(ctx->printMtx);
+		fprintf(stderr, "\r%d/%d chunks", ++ctx->done, total);
+	}
+}
+
+/**
+ * Write the GPX track and PTU CSV of a single sonde
+ */
+static void
+write_serial(int idx, void *ctx)
+{
+	batchserial_t *serial = ((batchserial_t**)ctx)[idx];
+	const std::string base = std::string(serial->outDir) + "/" + sanitize(serial->serial.c_str());
+	GPXWriter gpxWriter;
+	PTUWriter ptuWriter;
+	DerivedMeteo derived;
+	SondeFullData point;
+
+	serial->ok = gpxWriter.init((base + ".gpx").c_str()) && ptuWriter.init((base + ".csv").c_str());
+	if (!serial->ok) return;
+
+	gpxWriter.startTrack(serial->serial.c_str());
+	for (auto data : serial->frames) {
+		gpxWriter.addTrackPoint(data->time, data->lat, data->lon, data->alt, data->spd, data->hdg);
+		point = *data;
+		derived.update(&point);
+		derived.fill(&point);
+		ptuWriter.addPoint(&point);
+	}
+	gpxWriter.stopTrack();
+}
+
+static void
+on_data(const SondeFullData *data, void *ctx)
+{
+	batchjob_t *job = (batchjob_t*)ctx;
+
+	if (!job->keep) return;
+	if (!data->serial[0]) {
+		job->skipped++;
+		return;
+	}
+	job->frames.push_back(*data);
+}
+
+/**
+ * Make a serial number safe to use as a file name
+ */
+static std::string
+sanitize(const char *serial)
+{
+	std::string name(serial);
+
+	for (auto& c : name) {
+		if (!isalnum((unsigned char)c) && c != '-' && c != '_') c = '_';
+	}
+	return name;
+}
+
+static void
+usage(const char *pname)
+{
+	fprintf(stderr, "Usage: %s [-f iq|fm -r samplerate] [-d samplerate] [-t type[,type...]] [-o outdir]\n", pname);
+	fprintf(stderr, "       %*s [-j threads] [-c chunk_sec] [-v overlap_sec] <recording|directory>...\n", (int)strlen(pname), "");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "Decodes every recording in parallel, and writes <serial>.gpx and <serial>.csv for each sonde\n");
+	fprintf(stderr, "found to outdir (default: current directory). Directories are searched recursively for .wav\n");
+	fprintf(stderr, "files, or for any file if -f is specified.\n");
+	fprintf(stderr, "Types are selected by case-insensitive prefix, e.g. -t rs41,m10; with more than one type,\n");
+	fprintf(stderr, "or with -t auto (the default), the type is detected automatically.\n");
+	fprintf(stderr, "-d sets the decoder sample rate for IQ recordings (default: the recording's rate)\n");
+	fprintf(stderr, "-c and -v set the chunk length (default: %ds) and how much earlier each chunk starts\n",
+	        DEFAULT_CHUNK_SEC);
+	fprintf(stderr, "   decoding to acquire sync (default: %ds)\n", DEFAULT_OVERLAP_SEC);
+}
+/* }}} */
@@ -0,0 +1,373 @@
+/**
+ * Headless throughput benchmark. Feeds a recording through the same DSP chain
+ * used by the plugin (FM discriminator, rational resampler, decoder) for each
+ * sonde type, and reports how fast each stage runs. Decoders run at the same
+ * rate as in the plugin by default. The resampler is skipped when the decoder
+ * runs at the recording's own rate. IQ recordings can be run
+ * through separate FM and resampler blocks, the fused FMResampler, or both.
+ * Also measures how long the plugin takes to format its data table for a
+ * decoded frame, which it used to do on every redraw.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#include <dsp/demod/fm.h>
+#include <dsp/multirate/rational_resampler.h>
+#include "decode/decoder.hpp"
+#include "datatable.hpp"
+#include "fmresampler.hpp"
+#include "tools/sondetypes.hpp"
+#include "tools/wavreader.hpp"
+
+#define CHUNK_SIZE 8192
+#define COMPARE_SAMPLES (1 << 18)       /* Output samples compared between the split and fused chains */
+#define COMPARE_MAX_LAG 256             /* Output samples, largest group delay difference searched */
+#define COMPARE_MAX_ERROR_DB -90.0      /* Error/signal power the fused chain must stay below, about -100 in practice */
+#define TABLE_FRAMES 256                /* Decoded frames kept to time the data table formatting on */
+#define TABLE_MIN_TIME 0.2              /* Seconds of CPU time the formatting is timed over */
+
+enum Pipeline { PIPELINE_SPLIT = 1, PIPELINE_FUSED = 2 };
+enum Stage { STAGE_FM = 0, STAGE_RESAMPLER, STAGE_DECODER, STAGE_COUNT };
+static const char *stageNames[STAGE_COUNT] = {"FM demod", "Resampler", "Decoder"};
+
+typedef struct {
+	unsigned long fragments, frames;
+	int lastSeq;
+	std::vector<SondeFullData> *samples;   /* Frames kept for bench_table() */
+} benchstats_t;
+
+static void bench_type(WavReader *reader, const sondetype_t *type, double samplerate, double outSamplerate, bool fused,
+                       std::vector<SondeFullData> *samples);
+static void bench_table(const std::vector<SondeFullData>& samples);
+static bool compare_pipelines(WavReader *reader, double samplerate, double outSamplerate);
+static void usage(const char *pname);
+static void on_data(const SondeFullData *data, void *ctx);
+static double thread_cpu_time();
+
+int
+main(int argc, char *argv[])
+{
+	const char *fname = NULL, *typeFilter = NULL;
+	WavReader reader;
+	bool rawIQ = false, rawFM = false;
+	double samplerate = 0, outSamplerate = DECODER_SAMPLE_RATE;
+	int pipelines = PIPELINE_SPLIT | PIPELINE_FUSED;
+	std::vector<SondeFullData> samples;
+	bool ok = true;
+
+	for (int i=1; i<argc; i++) {
+		if (!strcmp(argv[i], "-r") && i+1 < argc) {
+			samplerate = atof(argv[++i]);
+		} else if (!strcmp(argv[i], "-f") && i+1 < argc) {
+			i++;
+			rawIQ = !strcmp(argv[i], "iq");
+			rawFM = !strcmp(argv[i], "fm");
+			if (!rawIQ && !rawFM) {
+				usage(argv[0]);
+				return 1;
+			}
+		} else if (!strcmp(argv[i], "-p") && i+1 < argc) {
+			i++;
+			if (!strcmp(argv[i], "split")) {
+				pipelines = PIPELINE_SPLIT;
+			} else if (!strcmp(argv[i], "fused")) {
+				pipelines = PIPELINE_FUSED;
+			} else if (!strcmp(argv[i], "both")) {
+				pipelines = PIPELINE_SPLIT | PIPELINE_FUSED;
+			} else {
+				usage(argv[0]);
+				return 1;
+			}
+		} else if (!strcmp(argv[i], "-d") && i+1 < argc) {
+			outSamplerate = atof(argv[++i]);
+		} else if (!strcmp(argv[i], "-t") && i+1 < argc) {
+			typeFilter = argv[++i];
+		} else if (argv[i][0] != '-' && !fname) {
+			fname = argv[i];
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (!fname || ((rawIQ || rawFM) && samplerate <= 0)) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (rawIQ || rawFM) {
+		if (!reader.initRaw(fname, rawIQ ? 2 : 1, samplerate)) {
+			fprintf(stderr, "Could not open %s\n", fname);
+			return 1;
+		}
+	} else if (!reader.init(fname)) {
+		fprintf(stderr, "%s: unsupported file (use -f and -r for raw float32 files)\n", fname);
+		return 1;
+	}
+	samplerate = reader.samplerate();
+	if (outSamplerate == 0) outSamplerate = samplerate;
+
+	printf("%s: %s at %.0f Hz, decoding at %.0f Hz\n", fname, reader.channels() == 2 ? "IQ" : "FM discriminator",
+	       samplerate, outSamplerate);
+	if (pipelines & PIPELINE_FUSED && reader.channels() != 2) {
+		fprintf(stderr, "The fused pipeline needs IQ input, only running the split one\n");
+		pipelines = PIPELINE_SPLIT;
+	}
+	if (pipelines == (PIPELINE_SPLIT | PIPELINE_FUSED)) {
+		ok = compare_pipelines(&reader, samplerate, outSamplerate);
+	}
+
+	printf("%-14s %-5s %12s %8s %9s %7s %10s %10s %10s\n",
+	       "Type", "DSP", "Samples/s", "RTF", "Fragments", "Frames", stageNames[0], stageNames[1], stageNames[2]);
+
+	for (int t=0; t<sondeTypeCount; t++) {
+		if (typeFilter && !type_selected(typeFilter, sondeTypes[t].name)) continue;
+
+		if (pipelines & PIPELINE_SPLIT) bench_type(&reader, &sondeTypes[t], samplerate, outSamplerate, false, &samples);
+		if (pipelines & PIPELINE_FUSED) bench_type(&reader, &sondeTypes[t], samplerate, outSamplerate, true, &samples);
+	}
+	bench_table(samples);
+
+	return ok ? 0 : 1;
+}
+
+/**
+ * Run a recording through the DSP chain and decoder for a sonde type, and
+ * print a line of statistics
+ *
+ * @param fused true to use FMResampler, false to use separate FM and
+ *        RationalResampler blocks like the plugin used to
+ * @param samples decoded frames are appended here, up to TABLE_FRAMES
+ */
+static void
+bench_type(WavReader *reader, const sondetype_t *type, double samplerate, double outSamplerate, bool fused,
+           std::vector<SondeFullData> *samples)
+{
+	std::vector<dsp::complex_t> iq(CHUNK_SIZE);
+	std::vector<float> fm(CHUNK_SIZE);
+	std::vector<float> resampled((size_t)(CHUNK_SIZE * outSamplerate / samplerate) + 64);
+	double stageTime[STAGE_COUNT] = {0};
+	benchstats_t stats = {0, 0, -1, samples};
+	dsp::demod::FM<float> fmDemod;
+	dsp::multirate::RationalResampler<float> resampler;
+	FMResampler fmResampler;
+	radiosonde::DecoderBase *decoder;
+	unsigned long totalSamples = 0;
+	double start, totalTime;
+	int count;
+
+	fmDemod.init(NULL, samplerate, samplerate / 2.0f, false);
+	resampler.init(NULL, samplerate, outSamplerate);
+	fmResampler.init(NULL, samplerate, samplerate / 2.0f, outSamplerate);
+	decoder = type->create(outSamplerate, on_data, &stats);
+	reader->rewind();
+
+	for (;;) {
+		if (fused) {
+			if ((count = reader->read((float*)iq.data(), CHUNK_SIZE)) <= 0) break;
+			totalSamples += count;
+
+			start = thread_cpu_time();
+			count = fmResampler.process(count, iq.data(), resampled.data());
+			stageTime[STAGE_FM] += thread_cpu_time() - start;
+
+			start = thread_cpu_time();
+			decoder->process(resampled.data(), count);
+			stageTime[STAGE_DECODER] += thread_cpu_time() - start;
+			continue;
+		}
+
+		if (reader->channels() == 2) {
+			if ((count = reader->read((float*)iq.data(), CHUNK_SIZE)) <= 0) break;
+
+			start = thread_cpu_time();
+			fmDemod.process(count, iq.data(), fm.data());
+			stageTime[STAGE_FM] += thread_cpu_time() - start;
+		} else {
+			if ((count = reader->read(fm.data(), CHUNK_SIZE)) <= 0) break;
+		}
+		totalSamples += count;
+
+		if (outSamplerate == samplerate) {
+			start = thread_cpu_time();
+			decoder->process(fm.data(), count);
+			stageTime[STAGE_DECODER] += thread_cpu_time() - start;
+			continue;
+		}
+
+		start = thread_cpu_time();
+		count = resampler.process(count, fm.data(), resampled.data());
+		stageTime[STAGE_RESAMPLER] += thread_cpu_time() - start;
+
+		start = thread_cpu_time();
+		decoder->process(resampled.data(), count);
+		stageTime[STAGE_DECODER] += thread_cpu_time() - start;
+	}
+	delete decoder;
+
+	totalTime = stageTime[STAGE_FM] + stageTime[STAGE_RESAMPLER] + stageTime[STAGE_DECODER];
+	printf("%-14s %-5s %12.0f %7.1fx %9lu %7lu %8.1fms %8.1fms %8.1fms\n",
+	       type->name, fused ? "fused" : "split",
+	       totalSamples / totalTime,
+	       totalSamples / samplerate / totalTime,
+	       stats.fragments, stats.frames,
+	       stageTime[STAGE_FM] * 1e3, stageTime[STAGE_RESAMPLER] * 1e3, stageTime[STAGE_DECODER] * 1e3);
+}
+
+/**
+ * Run an IQ recording through both the split and the fused FM + resampler
+ * chains, and check that their outputs match. The two chains may delay the
+ * signal differently, so the fused output is first aligned to the split one
+ * at the lag that maximizes their cross-correlation.
+ *
+ * @return true if the error is below COMPARE_MAX_ERROR_DB
+ */
+static bool
+compare_pipelines(WavReader *reader, double samplerate, double outSamplerate)
+{
+	std::vector<dsp::complex_t> iq(CHUNK_SIZE);
+	std::vector<float> fm(CHUNK_SIZE);
+	std::vector<float> split, fused;
+	dsp::demod::FM<float> fmDemod;
+	dsp::multirate::RationalResampler<float> resampler;
+	FMResampler fmResampler;
+	double maxError = 0, errorPower = 0, signalPower = 0, corr, bestCorr, errorDb;
+	size_t splitLen, fusedLen, len, compared;
+	int count, lag;
+
+	fmDemod.init(NULL, samplerate, samplerate / 2.0f, false);
+	resampler.init(NULL, samplerate, outSamplerate);
+	fmResampler.init(NULL, samplerate, samplerate / 2.0f, outSamplerate);
+	reader->rewind();
+
+	while (std::min(split.size(), fused.size()) < COMPARE_SAMPLES
+	       && (count = reader->read((float*)iq.data(), CHUNK_SIZE)) > 0) {
+		splitLen = split.size();
+		fusedLen = fused.size();
+
+		fmDemod.process(count, iq.data(), fm.data());
+		if (outSamplerate == samplerate) {
+			split.insert(split.end(), fm.begin(), fm.begin() + count);
+		} else {
+			split.resize(splitLen + fmResampler.maxOutput(count));
+			split.resize(splitLen + resampler.process(count, fm.data(), split.data() + splitLen));
+		}
+
+		fused.resize(fusedLen + fmResampler.maxOutput(count));
+		fused.resize(fusedLen + fmResampler.process(count, iq.data(), fused.data() + fusedLen));
+	}
+
+	/* Leave out the filters' startup, and room to slide one output against
+	 * the other */
+	len = std::min(split.size(), fused.size());
+	if (len < 4 * COMPARE_MAX_LAG) {
+		fprintf(stderr, "Fused vs split output: recording too short to compare\n");
+		return false;
+	}
+	len -= COMPARE_MAX_LAG;
+
+	/* Positive lag: the fused output is late */
+	lag = 0;
+	bestCorr = -INFINITY;
+	for (int k=-COMPARE_MAX_LAG; k<=COMPARE_MAX_LAG; k++) {
+		corr = 0;
+		for (size_t i=COMPARE_MAX_LAG; i<len; i++) corr += (double)split[i] * fused[i + k];
+		if (corr > bestCorr) {
+			bestCorr = corr;
+			lag = k;
+		}
+	}
+
+	for (size_t i=COMPARE_MAX_LAG; i<len; i++) {
+		const double error = fabs(split[i] - fused[i + lag]);
+		maxError = std::max(maxError, error);
+		errorPower += error * error;
+		signalPower += split[i] * split[i];
+	}
+	compared = len - COMPARE_MAX_LAG;
+	errorDb = 10 * log10(std::max(errorPower, 1e-30) / std::max(signalPower, 1e-30));
+
+	printf("Fused vs split output at %.0f Hz: lag %d, max error %.2e, error/signal power %.1f dB (%zu samples): %s\n",
+	       outSamplerate, lag, maxError, errorDb, compared, errorDb <= COMPARE_MAX_ERROR_DB ? "OK" : "FAIL");
+	return errorDb <= COMPARE_MAX_ERROR_DB;
+}
+
+/**
+ * Time the formatting of the plugin's data table, with a landing prediction,
+ * for the frames decoded during the benchmark. Before the table was cached,
+ * this was done on every redraw of every instance.
+ */
+static void
+bench_table(const std::vector<SondeFullData>& samples)
+{
+	LandingPredictor::Prediction landing = {};
+	DataTable table;
+	unsigned long passes = 0;
+	double start, elapsed;
+
+	if (samples.empty()) return;
+
+	landing.valid = true;
+	landing.phase = LandingPredictor::PHASE_DESCENT;
+	start = thread_cpu_time();
+	do {
+		for (const auto& data : samples) table.format(data, landing, data.serial);
+		passes += samples.size();
+		elapsed = thread_cpu_time() - start;
+	} while (elapsed < TABLE_MIN_TIME);
+
+	printf("Data table: %.2f us per format pass (%zu frames, %d rows)\n", elapsed / passes * 1e6, samples.size(),
+	       table.count());
+}
+
+static void
+usage(const char *pname)
+{
+	fprintf(stderr, "Usage: %s [-f iq|fm -r samplerate] [-d samplerate] [-p split|fused|both] [-t type[,type...]] <recording>\n", pname);
+	fprintf(stderr, "\n");
+	fprintf(stderr, "Recordings are 16-bit or float WAV files (2 channels for IQ, 1 for FM discriminator output),\n");
+	fprintf(stderr, "or headerless float32 files if -f is specified. IQ recordings should be centered on the\n");
+	fprintf(stderr, "sonde, with a sample rate close to the VFO bandwidth used by the plugin for that type.\n");
+	fprintf(stderr, "Types are selected by case-insensitive prefix, e.g. -t rs41,m10\n");
+	fprintf(stderr, "-d sets the decoder sample rate (default: %d, as in the plugin), 0 to decode at the recording's rate\n",
+	        DECODER_SAMPLE_RATE);
+	fprintf(stderr, "-p picks separate FM and resampler blocks, the fused block, or both (default) for IQ input\n");
+}
+
+static void
+on_data(const SondeFullData *data, void *ctx)
+{
+	benchstats_t *stats = (benchstats_t*)ctx;
+
+	stats->fragments++;
+	if (stats->samples->size() < TABLE_FRAMES) stats->samples->push_back(*data);
+	if (data->seq != stats->lastSeq) {
+		stats->frames++;
+		stats->lastSeq = data->seq;
+	}
+}
+
+/**
+ * CPU time consumed by the calling thread, in seconds
+ */
+static double
+thread_cpu_time()
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+	return ((((uint64_t)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime)
+	      + (((uint64_t)user.dwHighDateTime << 32) | user.dwLowDateTime)) * 1e-7;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
@@ -0,0 +1,78 @@
+/**
+ * Offline converter from the binary flight log to the GPX and CSV formats
+ * produced by the plugin.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "flightlog.hpp"
+#include "gpx.hpp"
+#include "ptu.hpp"
+
+static void usage(const char *pname);
+
+int
+main(int argc, char *argv[])
+{
+	const char *gpxFname = NULL, *ptuFname = NULL, *logFname = NULL;
+	FlightLogReader reader;
+	FlightLogRecord rec;
+	GPXWriter gpxWriter;
+	PTUWriter ptuWriter;
+	SondeFullData data;
+	unsigned long count = 0;
+
+	for (int i=1; i<argc; i++) {
+		if (!strcmp(argv[i], "-g") && i+1 < argc) {
+			gpxFname = argv[++i];
+		} else if (!strcmp(argv[i], "-c") && i+1 < argc) {
+			ptuFname = argv[++i];
+		} else if (argv[i][0] != '-' && !logFname) {
+			logFname = argv[i];
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (!logFname || (!gpxFname && !ptuFname)) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (!reader.init(logFname)) {
+		fprintf(stderr, "%s: not a valid flight log\n", logFname);
+		return 1;
+	}
+	if (gpxFname && !gpxWriter.init(gpxFname)) {
+		fprintf(stderr, "Could not open %s for writing\n", gpxFname);
+		return 1;
+	}
+	if (ptuFname && !ptuWriter.init(ptuFname)) {
+		fprintf(stderr, "Could not open %s for writing\n", ptuFname);
+		return 1;
+	}
+
+	while (reader.next(&rec)) {
+		rec.toData(&data);
+
+		if (data.serial[0]) {
+			gpxWriter.startTrack(data.serial);
+		}
+		gpxWriter.addTrackPoint(data.time, data.lat, data.lon, data.alt, data.spd, data.hdg);
+		ptuWriter.addPoint(&data);
+		count++;
+	}
+
+	gpxWriter.stopTrack();
+	gpxWriter.deinit();
+	ptuWriter.deinit();
+
+	fprintf(stderr, "%lu records exported, %lu corrupted records skipped\n", count, reader.corrupted());
+	return 0;
+}
+
+static void
+usage(const char *pname)
+{
+	fprintf(stderr, "Usage: %s [-g track.gpx] [-c ptu.csv] <flight log>\n", pname);
+}
@@ -0,0 +1,156 @@
+/**
+ * Replays a capture dump (the demodulated signal saved by the plugin's capture
+ * ring, or any FM discriminator recording) through one or more decoders, as
+ * fast as possible or at a multiple of real time. Prints every frame decoded,
+ * with its position in the recording, to help investigating decoding issues.
+ */
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <time.h>
+#include <vector>
+#include "decode/autodetect.hpp"
+#include "tools/sondetypes.hpp"
+#include "tools/wavreader.hpp"
+
+#define CHUNK_SIZE 4096
+
+typedef struct {
+	double pos;                 /* Seconds into the recording, updated before each chunk */
+	SondeFullData last;         /* Latest state of the frame being received */
+	double lastPos;
+	bool pending;               /* Whether last hasn't been printed yet */
+	unsigned long frames;
+} replayctx_t;
+
+static void on_data(const SondeFullData *data, void *ctx);
+static void print_frame(const SondeFullData *data, double pos);
+static void usage(const char *pname);
+
+int
+main(int argc, char *argv[])
+{
+	const char *fname = NULL, *typeFilter = NULL;
+	double rawSamplerate = 0, speed = 0, samplerate, elapsed;
+	std::vector<float> buf(CHUNK_SIZE);
+	std::vector<radiosonde::DecoderBase*> decoders;
+	radiosonde::AutoDecoder autoDecoder;
+	radiosonde::DecoderBase *decoder;
+	replayctx_t ctx = {};
+	WavReader reader;
+	uint64_t pos;
+	int count;
+
+	for (int i=1; i<argc; i++) {
+		if (!strcmp(argv[i], "-t") && i+1 < argc) {
+			typeFilter = argv[++i];
+		} else if (!strcmp(argv[i], "-x") && i+1 < argc) {
+			speed = atof(argv[++i]);
+		} else if (!strcmp(argv[i], "-r") && i+1 < argc) {
+			rawSamplerate = atof(argv[++i]);
+		} else if (argv[i][0] != '-' && !fname) {
+			fname = argv[i];
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (!fname || speed < 0) {
+		usage(argv[0]);
+		return 1;
+	}
+	if (typeFilter && type_selected(typeFilter, "auto")) typeFilter = NULL;
+
+	if (!(rawSamplerate > 0 ? reader.initRaw(fname, 1, rawSamplerate) : reader.init(fname)) || reader.channels() != 1) {
+		fprintf(stderr, "%s: not a readable FM recording\n", fname);
+		return 1;
+	}
+	samplerate = reader.samplerate();
+
+	for (int t=0; t<sondeTypeCount; t++) {
+		if (typeFilter && !type_selected(typeFilter, sondeTypes[t].name)) continue;
+		decoders.push_back(sondeTypes[t].create(samplerate, on_data, &ctx));
+	}
+	if (decoders.empty()) {
+		fprintf(stderr, "No sonde type matches %s\n", typeFilter);
+		return 1;
+	}
+	if (decoders.size() == 1) {
+		decoder = decoders[0];
+	} else {
+		autoDecoder.init(NULL, samplerate, decoders.data(), decoders.size());
+		decoder = &autoDecoder;
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+	for (pos = 0; (count = reader.read(buf.data(), CHUNK_SIZE)) > 0; pos += count) {
+		ctx.pos = pos / samplerate;
+		decoder->process(buf.data(), count);
+
+		/* Paced replay: wait until the end of the chunk is due */
+		if (speed > 0) {
+			std::this_thread::sleep_until(start + std::chrono::microseconds((int64_t)((pos + count) / samplerate / speed * 1e6)));
+		}
+	}
+	elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if (ctx.pending) print_frame(&ctx.last, ctx.lastPos);
+
+	fprintf(stderr, "%.1fs of signal at %.0f Hz in %.2fs (%.0fx real time), %lu frames\n",
+	        pos / samplerate, samplerate, elapsed, elapsed > 0 ? pos / samplerate / elapsed : 0.0, ctx.frames);
+
+	for (auto d : decoders) delete d;
+	return 0;
+}
+
+/* Static functions {{{ */
+/**
+ * Frames are reported once per fragment: only print each one once it is
+ * complete, i.e. when the next one starts
+ */
+static void
+on_data(const SondeFullData *data, void *ctx)
+{
+	replayctx_t *replay = (replayctx_t*)ctx;
+
+	if (replay->pending && (data->seq != replay->last.seq || strcmp(data->serial, replay->last.serial))) {
+		print_frame(&replay->last, replay->lastPos);
+	}
+	if (!replay->pending || data->seq != replay->last.seq) replay->frames++;
+
+	replay->last = *data;
+	replay->lastPos = replay->pos;
+	replay->pending = true;
+}
+
+static void
+print_frame(const SondeFullData *data, double pos)
+{
+	char timestr[32];
+	struct tm tm;
+
+#ifdef _WIN32
+	gmtime_s(&tm, &data->time);
+#else
+	gmtime_r(&data->time, &tm);
+#endif
+	if (!strftime(timestr, sizeof(timestr), "%Y-%m-%dT%H:%M:%SZ", &tm)) timestr[0] = '\0';
+
+	printf("%9.3fs %-16s %6d %s %9.5f %10.5f %8.1fm %6.1fC %5.1f%%\n", pos, data->serial[0] ? data->serial : "-",
+	       data->seq, timestr, data->lat, data->lon, data->alt, data->temp, data->rh);
+}
+
+static void
+usage(const char *pname)
+{
+	fprintf(stderr, "Usage: %s [-t type[,type...]] [-x speed] [-r samplerate] <capture>\n", pname);
+	fprintf(stderr, "\n");
+	fprintf(stderr, "Decodes a capture dump written by the plugin, or any FM discriminator recording, and prints\n");
+	fprintf(stderr, "every frame with its position in the recording. The recording is a mono WAV file, or\n");
+	fprintf(stderr, "headerless float32 if -r is given.\n");
+	fprintf(stderr, "Types are selected by case-insensitive prefix, e.g. -t rs41,m10; with more than one type,\n");
+	fprintf(stderr, "or with -t auto (the default), the type is detected automatically.\n");
+	fprintf(stderr, "-x replays at the given multiple of real time (default: as fast as possible)\n");
+}
+/* }}} */
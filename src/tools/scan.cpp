@@ -0,0 +1,197 @@
+/**
+ * Replays a wideband IQ recording through the channelizer in scan mode, the
+ * same way the plugin does with its wide VFO: carriers are detected in the
+ * spectrum, and each one gets a decoder lane from the pool, which tries every
+ * sonde type. Prints the lanes as they are tuned and retired, and a line per
+ * sonde with the frames it decoded.
+ */
+#include <algorithm>
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "channelizer.hpp"
+#include "decode/autodetect.hpp"
+#include "tools/sondetypes.hpp"
+#include "tools/wavreader.hpp"
+
+#define CHUNK_SIZE 65536
+#define DEFAULT_LANES 8
+#define DEFAULT_THRESHOLD 6.0f
+#define DEFAULT_TIMEOUT 60.0
+#define BANDWIDTH 5e4               /* Same as the plugin's Auto type */
+#define LANE_OVERSAMPLING 1.25
+
+typedef struct {
+	int index;
+	double frequency;           /* Hz, 0 if the recording's center frequency is unknown */
+	double pos;                 /* Seconds into the recording, updated before each chunk */
+	std::vector<radiosonde::DecoderBase*> owned;
+	radiosonde::AutoDecoder autoDecoder;
+} scanlane_t;
+
+typedef struct {
+	std::string serial;
+	double frequency;
+	double first, last;         /* Seconds into the recording */
+	unsigned long frames;
+	int lastSeq;
+} scanserial_t;
+
+static std::map<std::string, scanserial_t> serials;
+
+static void on_data(const SondeFullData *data, void *ctx);
+static void usage(const char *pname);
+
+int
+main(int argc, char *argv[])
+{
+	const char *fname = NULL;
+	double rawSamplerate = 0, center = 0, span = 0, timeout = DEFAULT_TIMEOUT;
+	double samplerate, laneRate, pos;
+	float threshold = DEFAULT_THRESHOLD;
+	int laneCount = DEFAULT_LANES, decimation, decoderRate, count, tuned;
+	std::vector<dsp::complex_t> iq(CHUNK_SIZE);
+	std::vector<scanlane_t*> lanes;
+	std::vector<unsigned> assignments;
+	std::vector<bool> wasActive;
+	Channelizer channelizer;
+	WavReader reader;
+
+	for (int i=1; i<argc; i++) {
+		if (!strcmp(argv[i], "-r") && i+1 < argc) {
+			rawSamplerate = atof(argv[++i]);
+		} else if (!strcmp(argv[i], "-c") && i+1 < argc) {
+			center = atof(argv[++i]) * 1e6;
+		} else if (!strcmp(argv[i], "-s") && i+1 < argc) {
+			span = atof(argv[++i]) * 1e3;
+		} else if (!strcmp(argv[i], "-t") && i+1 < argc) {
+			threshold = atof(argv[++i]);
+		} else if (!strcmp(argv[i], "-n") && i+1 < argc) {
+			laneCount = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-T") && i+1 < argc) {
+			timeout = atof(argv[++i]);
+		} else if (argv[i][0] != '-' && !fname) {
+			fname = argv[i];
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (!fname || laneCount < 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (!(rawSamplerate > 0 ? reader.initRaw(fname, 2, rawSamplerate) : reader.init(fname)) || reader.channels() != 2) {
+		fprintf(stderr, "%s: not a readable IQ recording\n", fname);
+		return 1;
+	}
+	samplerate = reader.samplerate();
+
+	/* Same rate plan as the plugin: decimate by a power of two down to a lane
+	 * rate slightly above the bandwidth and the decoder rate, then resample
+	 * to the decoder rate after FM demodulation */
+	laneRate = std::max(LANE_OVERSAMPLING * BANDWIDTH, (double)DECODER_SAMPLE_RATE);
+	for (decimation = 1; samplerate / (2 * decimation) >= laneRate; decimation *= 2);
+	decoderRate = DECODER_SAMPLE_RATE;
+	if (span <= 0) span = (samplerate - BANDWIDTH) / 2;
+
+	fprintf(stderr, "%.0f Hz, scanning +/-%.0f kHz, %d lanes at %d Hz\n", samplerate, span / 1e3, laneCount, decoderRate);
+
+	channelizer.configure(samplerate, decimation, BANDWIDTH, decoderRate);
+	channelizer.setScan(true, span, threshold, timeout);
+	for (int i=0; i<laneCount; i++) {
+		scanlane_t *lane = new scanlane_t();
+
+		lane->index = i;
+		for (int t=0; t<sondeTypeCount; t++) {
+			lane->owned.push_back(sondeTypes[t].create(decoderRate, on_data, lane));
+		}
+		lane->autoDecoder.init(NULL, decoderRate, lane->owned.data(), lane->owned.size(), 0);
+		channelizer.addLane(0, &lane->autoDecoder);
+		lanes.push_back(lane);
+	}
+	assignments.assign(laneCount, 0);
+	wasActive.assign(laneCount, false);
+
+	pos = 0;
+	while ((count = reader.read((float*)iq.data(), CHUNK_SIZE)) > 0) {
+		for (auto lane : lanes) lane->pos = pos;
+		channelizer.process(iq.data(), count);
+		pos += count / samplerate;
+
+		/* Report lanes being tuned and retired */
+		for (int i=0; i<laneCount; i++) {
+			const bool active = channelizer.laneActive(i);
+
+			if (active && channelizer.laneAssignment(i) != assignments[i]) {
+				assignments[i] = channelizer.laneAssignment(i);
+				lanes[i]->frequency = center + channelizer.laneOffset(i);
+				fprintf(stderr, "%8.1fs lane %d tuned to %+.1f kHz", pos, i, channelizer.laneOffset(i) / 1e3);
+				if (center > 0) fprintf(stderr, " (%.3f MHz)", lanes[i]->frequency / 1e6);
+				fprintf(stderr, "\n");
+			} else if (!active && wasActive[i]) {
+				fprintf(stderr, "%8.1fs lane %d retired\n", pos, i);
+			}
+			wasActive[i] = active;
+		}
+	}
+
+	tuned = 0;
+	for (int i=0; i<laneCount; i++) tuned += channelizer.laneActive(i);
+	fprintf(stderr, "%.1fs of IQ, %zu sondes, %d lanes still tuned\n", pos, serials.size(), tuned);
+	for (auto& entry : serials) {
+		const scanserial_t& serial = entry.second;
+		printf("%-16s %10.3f %s %8lu frames  %8.1fs - %.1fs\n", serial.serial.c_str(),
+		       serial.frequency / (center > 0 ? 1e6 : 1e3), center > 0 ? "MHz" : "kHz",
+		       serial.frames, serial.first, serial.last);
+	}
+
+	for (auto lane : lanes) {
+		for (auto decoder : lane->owned) delete decoder;
+		delete lane;
+	}
+	return 0;
+}
+
+/* Static functions {{{ */
+static void
+on_data(const SondeFullData *data, void *ctx)
+{
+	const scanlane_t *lane = (const scanlane_t*)ctx;
+
+	if (!data->serial[0]) return;
+
+	auto it = serials.find(data->serial);
+	if (it == serials.end()) {
+		scanserial_t serial = {data->serial, lane->frequency, lane->pos, lane->pos, 0, -1};
+		it = serials.emplace(data->serial, serial).first;
+	}
+
+	/* Each frame is reported once per fragment: count sequence numbers */
+	if (data->seq != it->second.lastSeq) {
+		it->second.frames++;
+		it->second.lastSeq = data->seq;
+	}
+	it->second.last = lane->pos;
+}
+
+static void
+usage(const char *pname)
+{
+	fprintf(stderr, "Usage: %s [-r samplerate] [-c center_mhz] [-s span_khz] [-t threshold_db] [-n lanes]\n", pname);
+	fprintf(stderr, "       %*s [-T timeout_sec] <recording>\n", (int)strlen(pname), "");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "Scans a wideband IQ recording for carriers, and decodes each of them with a lane from a pool,\n");
+	fprintf(stderr, "like the plugin's scan mode. The recording is a 2-channel WAV file, or headerless float32 IQ\n");
+	fprintf(stderr, "if -r is given.\n");
+	fprintf(stderr, "-c sets the center frequency of the recording, to print absolute frequencies\n");
+	fprintf(stderr, "-s limits the scan to +/-span around the center (default: the whole recording bandwidth)\n");
+	fprintf(stderr, "-t sets the detection threshold above the noise floor (default: %.0f dB)\n", DEFAULT_THRESHOLD);
+	fprintf(stderr, "-n sets the number of lanes (default: %d), -T how long a lane outlives its carrier (default: %.0fs)\n",
+	        DEFAULT_LANES, DEFAULT_TIMEOUT);
+}
+/* }}} */
@@ -0,0 +1,35 @@
+#include <array>
+#include <ctype.h>
+#include <string.h>
+#include <utility>
+#include "tools/sondetypes.hpp"
+
+template<size_t... I>
+static constexpr std::array<sondetype_t, sizeof...(I)>
+type_table(std::index_sequence<I...>)
+{
+	return {{{radiosonde::Registry::names[I], radiosonde::Registry::factories[I]}...}};
+}
+
+static constexpr auto typeTable = type_table(std::make_index_sequence<radiosonde::Registry::count>());
+const sondetype_t *const sondeTypes = typeTable.data();
+const int sondeTypeCount = radiosonde::Registry::count;
+
+bool
+type_selected(const char *filter, const char *name)
+{
+	const char *token = filter;
+	size_t len;
+
+	while (*token) {
+		len = strcspn(token, ",");
+		if (len > 0 && len <= strlen(name)) {
+			size_t i;
+			for (i=0; i<len && tolower(token[i]) == tolower(name[i]); i++);
+			if (i == len) return true;
+		}
+		token += len;
+		if (*token == ',') token++;
+	}
+	return false;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "decode/registry.hpp"
+
+/**
+ * Sonde types compiled into the command-line tools, in the same order as the
+ * plugin's type list
+ */
+typedef struct {
+	const char *name;
+	radiosonde::DecoderBase* (*create)(int samplerate, void (*callback)(const SondeFullData *data, void *ctx), void *ctx);
+} sondetype_t;
+
+extern const sondetype_t *const sondeTypes;
+extern const int sondeTypeCount;
+
+/**
+ * Check whether any of the comma-separated prefixes in filter matches name,
+ * ignoring case
+ */
+bool type_selected(const char *filter, const char *name);
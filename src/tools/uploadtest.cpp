@@ -0,0 +1,416 @@
+/**
+ * Runs the HTTP uploader against a stand-in server on the loopback interface,
+ * and checks that batches are spooled while the server is down and delivered
+ * once it's back, retried after a 5xx, and dropped after a 4xx.
+ */
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+#include "uploader.hpp"
+
+#define FRAMES_PER_TEST 5
+#define WINDOW_MS 200
+#define TIMEOUT_MS 10000            /* Per step: the uploader waits 1s after a failure */
+#define POLL_INTERVAL_MS 50
+
+/**
+ * Minimal HTTP server, answering each request with the next status of a
+ * script (the last one repeats), and counting the frames it accepted
+ */
+class StandInServer {
+public:
+	~StandInServer() { stop(); }
+
+	bool start(int port, const std::vector<int>& statuses);
+	void stop();
+
+	int requests() const { return m_requests; }
+	int frames() const { return m_frames; }
+
+private:
+	void serverLoop();
+	void serve(intptr_t fd);
+
+	std::vector<int> m_statuses;
+	intptr_t m_listenFd = -1;
+	std::atomic<bool> m_running = false;
+	std::atomic<int> m_requests = 0, m_frames = 0;
+	std::thread m_thread;
+};
+
+static int free_port();
+static void close_socket(intptr_t fd);
+static bool wait_readable(intptr_t fd, int timeoutMs);
+static bool wait_for(HttpUploader *uploader, const std::function<bool(const HttpUploader::Stats&)>& cond);
+static void push_frames(HttpUploader *uploader, const char *serial);
+static size_t count_files(const std::filesystem::path& dir);
+static bool test_spool(const std::filesystem::path& spoolDir);
+static bool test_retry(const std::filesystem::path& spoolDir);
+static bool test_drop(const std::filesystem::path& spoolDir);
+static void usage(const char *pname);
+
+int
+main(int argc, char *argv[])
+{
+	const std::filesystem::path tmpDir = std::filesystem::temp_directory_path()
+	                                   / ("radiosonde_uploadtest-" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()));
+	std::error_code err;
+	bool keep = false;
+	int failed = 0;
+
+	for (int i=1; i<argc; i++) {
+		if (!strcmp(argv[i], "-k")) {
+			keep = true;
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+#ifdef _WIN32
+	WSADATA wsaData;
+	if (WSAStartup(MAKEWORD(2, 2), &wsaData)) {
+		fprintf(stderr, "Could not initialize Winsock\n");
+		return 1;
+	}
+#endif
+
+	const struct {
+		const char *name;
+		bool (*run)(const std::filesystem::path& spoolDir);
+	} tests[] = {
+		{"spool", test_spool},
+		{"retry", test_retry},
+		{"drop", test_drop},
+	};
+
+	for (const auto& test : tests) {
+		const bool ok = test.run(tmpDir / test.name);
+		printf("%-8s %s\n", test.name, ok ? "ok" : "FAILED");
+		if (!ok) failed++;
+	}
+
+	if (keep) {
+		printf("Spool directories kept in %s\n", tmpDir.string().c_str());
+	} else {
+		std::filesystem::remove_all(tmpDir, err);
+	}
+	return failed ? 1 : 0;
+}
+
+/* StandInServer {{{ */
+bool
+StandInServer::start(int port, const std::vector<int>& statuses)
+{
+	struct sockaddr_in addr;
+	const int one = 1;
+
+	stop();
+	m_statuses = statuses;
+	m_requests = m_frames = 0;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if ((m_listenFd = (intptr_t)socket(AF_INET, SOCK_STREAM, 0)) < 0) return false;
+	setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, (const char*)&one, sizeof(one));
+	if (bind(m_listenFd, (struct sockaddr*)&addr, sizeof(addr)) || listen(m_listenFd, 4)) {
+		close_socket(m_listenFd);
+		m_listenFd = -1;
+		return false;
+	}
+
+	m_running = true;
+	m_thread = std::thread(&StandInServer::serverLoop, this);
+	return true;
+}
+
+void
+StandInServer::stop()
+{
+	if (!m_running) return;
+	m_running = false;
+	m_thread.join();
+	close_socket(m_listenFd);
+	m_listenFd = -1;
+}
+
+void
+StandInServer::serverLoop()
+{
+	intptr_t fd;
+
+	while (m_running) {
+		if (!wait_readable(m_listenFd, POLL_INTERVAL_MS)) continue;
+		if ((fd = (intptr_t)accept(m_listenFd, NULL, NULL)) < 0) continue;
+		serve(fd);
+		close_socket(fd);
+	}
+}
+
+/**
+ * Read one request (headers, then Content-Length bytes of body) and answer it
+ */
+void
+StandInServer::serve(intptr_t fd)
+{
+	const char *needle = "\"serial\"";
+	std::string request, reply;
+	size_t headerEnd = std::string::npos, contentLength = 0;
+	char buf[4096];
+	long len;
+	int status, frames = 0;
+
+	while (m_running && wait_readable(fd, TIMEOUT_MS)) {
+		if ((len = recv(fd, buf, sizeof(buf), 0)) <= 0) return;
+		request.append(buf, len);
+
+		if (headerEnd == std::string::npos && (headerEnd = request.find("\r\n\r\n")) != std::string::npos) {
+			headerEnd += 4;
+			const size_t pos = request.find("Content-Length: ");
+			if (pos != std::string::npos && pos < headerEnd) contentLength = strtoul(request.c_str() + pos + 16, NULL, 10);
+		}
+		if (headerEnd != std::string::npos && request.size() >= headerEnd + contentLength) break;
+	}
+	if (headerEnd == std::string::npos || request.size() < headerEnd + contentLength) return;
+
+	/* Payloads are sent uncompressed by the tests, so frames can be counted as is */
+	for (size_t pos = request.find(needle, headerEnd); pos != std::string::npos; pos = request.find(needle, pos + 1)) {
+		frames++;
+	}
+
+	const int n = m_requests++;
+	status = m_statuses[std::min<size_t>(n, m_statuses.size() - 1)];
+	if (status >= 200 && status < 300) m_frames += frames;
+
+	reply = "HTTP/1.1 " + std::to_string(status) + " Stand-in\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+	send(fd, reply.data(), reply.size(), 0);
+}
+/* }}} */
+
+/* Tests {{{ */
+/**
+ * Server down: batches go to the spool, and survive a restart of the uploader.
+ * Server back: the spool drains, and every frame gets there
+ */
+static bool
+test_spool(const std::filesystem::path& spoolDir)
+{
+	const int port = free_port();
+	const std::string url = "http://127.0.0.1:" + std::to_string(port) + "/telemetry";
+	StandInServer server;
+
+	{
+		HttpUploader uploader;
+		if (port < 0 || !uploader.start(url, "uploadtest", spoolDir.string(), WINDOW_MS, false)) return false;
+		push_frames(&uploader, "SPOOL");
+		if (!wait_for(&uploader, [](const HttpUploader::Stats& st) { return st.spooled > 0 && st.queued == 0; })) {
+			fprintf(stderr, "spool: nothing spooled with the server down\n");
+			return false;
+		}
+	}
+	if (count_files(spoolDir) == 0) {
+		fprintf(stderr, "spool: spool directory empty after the uploader went away\n");
+		return false;
+	}
+
+	if (!server.start(port, {200})) {
+		fprintf(stderr, "spool: could not listen on port %d\n", port);
+		return false;
+	}
+
+	HttpUploader uploader;
+	if (!uploader.start(url, "uploadtest", spoolDir.string(), WINDOW_MS, false)) return false;
+	if (!wait_for(&uploader, [](const HttpUploader::Stats& st) { return st.spooled == 0 && st.uploaded == FRAMES_PER_TEST; })) {
+		fprintf(stderr, "spool: spool not drained after the server came back\n");
+		return false;
+	}
+	if (server.frames() != FRAMES_PER_TEST || count_files(spoolDir) != 0) {
+		fprintf(stderr, "spool: server got %d frames, %zu files left\n", server.frames(), count_files(spoolDir));
+		return false;
+	}
+	return true;
+}
+
+/**
+ * 503 on the first attempt: the batch is sent again after the backoff
+ */
+static bool
+test_retry(const std::filesystem::path& spoolDir)
+{
+	const int port = free_port();
+	HttpUploader uploader;
+	StandInServer server;
+	HttpUploader::Stats st;
+
+	if (port < 0 || !server.start(port, {503, 200})) return false;
+	if (!uploader.start("http://127.0.0.1:" + std::to_string(port) + "/telemetry", "uploadtest", spoolDir.string(), WINDOW_MS, false)) return false;
+
+	push_frames(&uploader, "RETRY");
+	if (!wait_for(&uploader, [](const HttpUploader::Stats& st) { return st.uploaded == FRAMES_PER_TEST && st.spooled == 0; })) {
+		fprintf(stderr, "retry: frames not delivered after a 503\n");
+		return false;
+	}
+
+	uploader.stats(&st);
+	if (server.requests() < 2 || server.frames() != FRAMES_PER_TEST || st.failures < 1 || st.dropped != 0 || st.status != 200) {
+		fprintf(stderr, "retry: %d requests, %d frames accepted, %lu failures, %lu dropped, last status %d\n",
+		        server.requests(), server.frames(), st.failures, st.dropped, st.status);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * 400: the batch is dropped, and never sent again
+ */
+static bool
+test_drop(const std::filesystem::path& spoolDir)
+{
+	const int port = free_port();
+	HttpUploader uploader;
+	StandInServer server;
+	HttpUploader::Stats st;
+
+	if (port < 0 || !server.start(port, {400})) return false;
+	if (!uploader.start("http://127.0.0.1:" + std::to_string(port) + "/telemetry", "uploadtest", spoolDir.string(), WINDOW_MS, false)) return false;
+
+	push_frames(&uploader, "DROP");
+	if (!wait_for(&uploader, [](const HttpUploader::Stats& st) { return st.dropped == FRAMES_PER_TEST; })) {
+		fprintf(stderr, "drop: frames not dropped after a 400\n");
+		return false;
+	}
+
+	/* Longer than the backoff after a failure, in case it does retry */
+	std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+
+	uploader.stats(&st);
+	if (server.requests() != 1 || st.uploaded != 0 || st.spooled != 0 || count_files(spoolDir) != 0 || st.status != 400) {
+		fprintf(stderr, "drop: %d requests, %lu uploaded, %zu spooled, last status %d\n",
+		        server.requests(), st.uploaded, st.spooled, st.status);
+		return false;
+	}
+	return true;
+}
+/* }}} */
+
+/* Static functions {{{ */
+/**
+ * @return a loopback port nothing listens on, -1 on error
+ */
+static int
+free_port()
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	intptr_t fd;
+	int port = -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if ((fd = (intptr_t)socket(AF_INET, SOCK_STREAM, 0)) < 0) return -1;
+	if (!bind(fd, (struct sockaddr*)&addr, sizeof(addr)) && !getsockname(fd, (struct sockaddr*)&addr, &len)) {
+		port = ntohs(addr.sin_port);
+	}
+	close_socket(fd);
+	return port;
+}
+
+static void
+close_socket(intptr_t fd)
+{
+#ifdef _WIN32
+	closesocket((SOCKET)fd);
+#else
+	close(fd);
+#endif
+}
+
+static bool
+wait_readable(intptr_t fd, int timeoutMs)
+{
+	struct timeval tv;
+	fd_set fds;
+
+	FD_ZERO(&fds);
+	FD_SET(fd, &fds);
+	tv.tv_sec = timeoutMs / 1000;
+	tv.tv_usec = (timeoutMs % 1000) * 1000;
+	return select((int)fd + 1, &fds, NULL, NULL, &tv) > 0;
+}
+
+/**
+ * Poll the uploader's stats until the condition holds, or the step times out
+ */
+static bool
+wait_for(HttpUploader *uploader, const std::function<bool(const HttpUploader::Stats&)>& cond)
+{
+	const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(TIMEOUT_MS);
+	HttpUploader::Stats st;
+
+	do {
+		uploader->stats(&st);
+		if (cond(st)) return true;
+		std::this_thread::sleep_for(std::chrono::milliseconds(POLL_INTERVAL_MS));
+	} while (std::chrono::steady_clock::now() < deadline);
+	return false;
+}
+
+static void
+push_frames(HttpUploader *uploader, const char *serial)
+{
+	SondeFullData data;
+
+	for (int i=0; i<FRAMES_PER_TEST; i++) {
+		data.init();
+		snprintf(data.serial, sizeof(data.serial), "%s", serial);
+		data.seq = i;
+		data.time = time(NULL);
+		data.lat = 45.0f;
+		data.lon = 9.0f;
+		data.alt = 1000.0f + 5.0f * i;
+		data.rxTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		uploader->push(&data);
+	}
+}
+
+static size_t
+count_files(const std::filesystem::path& dir)
+{
+	std::error_code err;
+	size_t count = 0;
+
+	for (auto& entry : std::filesystem::directory_iterator(dir, err)) {
+		if (entry.is_regular_file(err)) count++;
+	}
+	return count;
+}
+
+static void
+usage(const char *pname)
+{
+	fprintf(stderr, "Usage: %s [-k]\n", pname);
+	fprintf(stderr, "\t-k: keep the spool directories\n");
+}
+/* }}} */
@@ -0,0 +1,161 @@
+#include <stdlib.h>
+#include <string.h>
+#include "wavreader.hpp"
+
+#define WAV_FORMAT_PCM 1
+#define WAV_FORMAT_FLOAT 3
+#define WAV_FORMAT_EXTENSIBLE 0xFFFE
+
+static uint32_t read_u32(const uint8_t *ptr) { return ptr[0] | ptr[1] << 8 | ptr[2] << 16 | (uint32_t)ptr[3] << 24; }
+static uint16_t read_u16(const uint8_t *ptr) { return ptr[0] | ptr[1] << 8; }
+static int seek64(FILE *fd, uint64_t offset, int whence);
+static uint64_t tell64(FILE *fd);
+
+bool
+WavReader::init(const char *fname)
+{
+	uint8_t hdr[12], chunk[8], fmt[40];
+	uint32_t chunkLen;
+	uint16_t format = 0, bits = 0;
+	bool gotFmt = false;
+
+	if (m_fd) deinit();
+	if (!(m_fd = fopen(fname, "rb"))) return false;
+
+	if (fread(hdr, sizeof(hdr), 1, m_fd) != 1 || memcmp(hdr, "RIFF", 4) || memcmp(hdr + 8, "WAVE", 4)) {
+		deinit();
+		return false;
+	}
+
+	/* Walk the chunks until the data chunk is found */
+	while (fread(chunk, sizeof(chunk), 1, m_fd) == 1) {
+		chunkLen = read_u32(chunk + 4);
+
+		if (!memcmp(chunk, "fmt ", 4) && chunkLen >= 16 && chunkLen <= sizeof(fmt)) {
+			if (fread(fmt, chunkLen, 1, m_fd) != 1) break;
+			format = read_u16(fmt);
+			m_channels = read_u16(fmt + 2);
+			m_samplerate = read_u32(fmt + 4);
+			bits = read_u16(fmt + 14);
+			if (format == WAV_FORMAT_EXTENSIBLE && chunkLen >= 26) format = read_u16(fmt + 24);
+			gotFmt = true;
+		} else if (!memcmp(chunk, "data", 4)) {
+			if (!gotFmt) break;
+			if (!(format == WAV_FORMAT_PCM && bits == 16) && !(format == WAV_FORMAT_FLOAT && bits == 32)) break;
+			if (m_channels != 1 && m_channels != 2) break;
+
+			m_float = format == WAV_FORMAT_FLOAT;
+			m_bytesPerSample = bits / 8;
+			m_dataOffset = ftell(m_fd);
+			m_dataLen = m_dataLeft = chunkLen;
+			m_pcmBuf = NULL;
+			m_pcmBufLen = 0;
+			return true;
+		} else {
+			/* Chunks are padded to an even length */
+			fseek(m_fd, chunkLen + (chunkLen & 1), SEEK_CUR);
+		}
+	}
+
+	deinit();
+	return false;
+}
+
+bool
+WavReader::initRaw(const char *fname, int channels, double samplerate)
+{
+	if (m_fd) deinit();
+	if (!(m_fd = fopen(fname, "rb"))) return false;
+
+	seek64(m_fd, 0, SEEK_END);
+	m_dataLen = m_dataLeft = tell64(m_fd);
+	seek64(m_fd, 0, SEEK_SET);
+
+	m_dataOffset = 0;
+	m_channels = channels;
+	m_samplerate = samplerate;
+	m_float = true;
+	m_bytesPerSample = sizeof(float);
+	m_pcmBuf = NULL;
+	m_pcmBufLen = 0;
+	return true;
+}
+
+void
+WavReader::deinit()
+{
+	if (!m_fd) return;
+	fclose(m_fd);
+	free(m_pcmBuf);
+	m_fd = NULL;
+	m_pcmBuf = NULL;
+}
+
+int
+WavReader::read(float *dst, int count)
+{
+	const int frameSize = m_channels * m_bytesPerSample;
+	int i, values;
+
+	if (!m_fd) return 0;
+	if ((uint64_t)count * frameSize > m_dataLeft) count = m_dataLeft / frameSize;
+	if (count <= 0) return 0;
+
+	if (m_float) {
+		count = fread(dst, frameSize, count, m_fd);
+	} else {
+		values = count * m_channels;
+		if (m_pcmBufLen < values) {
+			m_pcmBuf = (int16_t*)realloc(m_pcmBuf, values * sizeof(*m_pcmBuf));
+			m_pcmBufLen = values;
+		}
+		count = fread(m_pcmBuf, frameSize, count, m_fd);
+		for (i=0; i<count * m_channels; i++) {
+			dst[i] = m_pcmBuf[i] / 32768.0f;
+		}
+	}
+
+	m_dataLeft -= (uint64_t)count * frameSize;
+	return count;
+}
+
+void
+WavReader::rewind()
+{
+	if (!m_fd) return;
+	fseek(m_fd, m_dataOffset, SEEK_SET);
+	m_dataLeft = m_dataLen;
+}
+
+bool
+WavReader::seek(uint64_t sample)
+{
+	const uint64_t offset = sample * m_channels * m_bytesPerSample;
+
+	if (!m_fd || offset > m_dataLen) return false;
+	if (seek64(m_fd, m_dataOffset + offset, SEEK_SET)) return false;
+	m_dataLeft = m_dataLen - offset;
+	return true;
+}
+
+/* Static functions {{{ */
+static int
+seek64(FILE *fd, uint64_t offset, int whence)
+{
+#ifdef _WIN32
+	return _fseeki64(fd, offset, whence);
+#else
+	return fseeko(fd, offset, whence);
+#endif
+}
+
+static uint64_t
+tell64(FILE *fd)
+{
+#ifdef _WIN32
+	return _ftelli64(fd);
+#else
+	return ftello(fd);
+#endif
+}
+/* }}} */
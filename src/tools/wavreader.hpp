@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * Reader for recordings, either WAV files (16-bit PCM or 32-bit float) or
+ * headerless interleaved float32 files. Samples are always returned as
+ * interleaved floats.
+ */
+class WavReader {
+public:
+	WavReader() { m_fd = NULL; };
+	~WavReader() { deinit(); };
+
+	/**
+	 * Open a WAV file, reading its format from the header
+	 */
+	bool init(const char *fname);
+
+	/**
+	 * Open a headerless float32 file
+	 *
+	 * @param fname path to the file
+	 * @param channels number of interleaved channels (2 for IQ)
+	 * @param samplerate sample rate, in Hz
+	 */
+	bool initRaw(const char *fname, int channels, double samplerate);
+	void deinit();
+
+	/**
+	 * Read samples from the file.
+	 *
+	 * @param dst buffer to write to, with room for count * channels() floats
+	 * @param count maximum number of samples to read, per channel
+	 * @return number of samples read per channel, 0 on EOF
+	 */
+	int read(float *dst, int count);
+
+	/**
+	 * Seek back to the first sample
+	 */
+	void rewind();
+
+	/**
+	 * Seek to a given sample. Works past 2GB, unlike fseek() on some
+	 * platforms.
+	 *
+	 * @param sample index of the sample to read next, per channel
+	 * @return false if the sample is past the end of the file
+	 */
+	bool seek(uint64_t sample);
+
+	/**
+	 * @return total number of samples per channel, 0 if unknown
+	 */
+	uint64_t length() const { return m_dataLen / (m_channels * m_bytesPerSample); }
+
+	int channels() const { return m_channels; }
+	double samplerate() const { return m_samplerate; }
+
+private:
+	FILE *m_fd;
+	long m_dataOffset;
+	uint64_t m_dataLen, m_dataLeft;
+	int m_channels, m_bytesPerSample;
+	bool m_float;
+	double m_samplerate;
+	int16_t *m_pcmBuf;
+	int m_pcmBufLen;
+};
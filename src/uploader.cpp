@@ -0,0 +1,752 @@
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <unordered_map>
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+#ifdef RADIOSONDE_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#include "netsink.hpp"
+#include "uploader.hpp"
+
+#define MIN_WINDOW_MS 100
+#define CONNECT_TIMEOUT_MS 5000
+#define REQUEST_TIMEOUT_MS 15000    /* Whole request, from connect() to the status line */
+#define POLL_INTERVAL_MS 100        /* How often a request in progress checks for stop() */
+#define MIN_BACKOFF_MS 1000
+#define MAX_BACKOFF_MS 60000
+#define MAX_DRAIN_BATCHES 16        /* Spooled batches sent per window, so that new ones get spooled too */
+#define MAX_SPOOL_BYTES (64 << 20)
+#define MAX_SPOOL_BATCHES 10000
+#define RESOLVE_TTL_MS 300000       /* How long resolved addresses are reused, while they work */
+#define SPOOL_PATTERN "%010u-%lld-%u.json%s"
+
+#ifdef _WIN32
+#define IN_PROGRESS() (WSAGetLastError() == WSAEWOULDBLOCK)
+#define WOULD_BLOCK() (WSAGetLastError() == WSAEWOULDBLOCK)
+#else
+#define IN_PROGRESS() (errno == EINPROGRESS)
+#define WOULD_BLOCK() (errno == EAGAIN || errno == EWOULDBLOCK)
+#endif
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL     /* Report closed connections as errors, not SIGPIPE */
+#else
+#define SEND_FLAGS 0
+#endif
+
+static bool net_init();
+static void close_socket(intptr_t fd);
+static bool set_nonblocking(intptr_t fd);
+static bool wait_socket(intptr_t fd, bool write, int timeoutMs);
+static bool parse_url(const std::string& url, std::string *host, std::string *port, std::string *path);
+static void json_escape(std::string *dst, const std::string& str);
+static bool gzip_compress(const std::string& src, std::string *dst);
+static bool read_file(const std::string& path, std::string *dst);
+static int64_t now_ms();
+static int64_t epoch_us();
+
+HttpUploader::HttpUploader(size_t capacity)
+{
+	m_ring.resize(capacity);
+	m_batch.resize(capacity);
+	m_head = m_count = 0;
+	m_running = false;
+	m_windowMs = 0;
+	m_gzip = false;
+	m_spoolBytes = 0;
+	m_spoolCounter = 0;
+	m_retryAt = 0;
+	m_backoffMs = MIN_BACKOFF_MS;
+	m_uploaded = m_dropped = m_failures = 0;
+	m_spooled = 0;
+	m_lagUs = -1;
+	m_status = 0;
+	m_resolvedAt = 0;
+	m_resolver = std::make_shared<Resolver>();
+	m_resolver->requested = m_resolver->done = 0;
+	m_resolver->running = true;
+	std::thread(&HttpUploader::resolverLoop, m_resolver).detach();
+}
+
+HttpUploader::~HttpUploader()
+{
+	stop();
+
+	/* Never joined: it may be stuck in getaddrinfo() for a while */
+	{
+		std::lock_guard<std::mutex> lck(m_resolver->mtx);
+		m_resolver->running = false;
+	}
+	m_resolver->cv.notify_all();
+}
+
+bool
+HttpUploader::start(const std::string& url, const std::string& name, const std::string& spoolDir, int windowMs,
+                    bool compress)
+{
+	std::error_code err;
+
+	stop();
+
+	if (!net_init() || !parse_url(url, &m_host, &m_port, &m_path)) return false;
+	if (spoolDir.empty()) return false;
+	std::filesystem::create_directories(spoolDir, err);
+	if (!std::filesystem::is_directory(spoolDir, err)) return false;
+
+	m_name = name;
+	m_spoolDir = spoolDir;
+	m_windowMs = std::max(windowMs, MIN_WINDOW_MS);
+	m_gzip = compress && compressionAvailable();
+	m_retryAt = 0;
+	m_backoffMs = MIN_BACKOFF_MS;
+	m_head = m_count = 0;
+	m_status = 0;
+	m_addresses.clear();
+	m_resolvedAt = 0;
+	loadSpool();
+
+	m_running = true;
+	m_thread = std::thread(&HttpUploader::workerLoop, this);
+	return true;
+}
+
+void
+HttpUploader::stop()
+{
+	{
+		std::lock_guard<std::mutex> lck(m_queueMtx);
+		if (!m_running) return;
+		m_running = false;
+	}
+	m_queueCv.notify_one();
+	m_thread.join();
+}
+
+bool
+HttpUploader::push(const SondeFullData *data)
+{
+	std::lock_guard<std::mutex> lck(m_queueMtx);
+
+	/* No notification: the worker only wakes up once per window */
+	if (!m_running) return false;
+	if (m_count == m_ring.size()) {
+		m_dropped++;
+		return false;
+	}
+	m_ring[(m_head + m_count) % m_ring.size()] = *data;
+	m_count++;
+	return true;
+}
+
+void
+HttpUploader::stats(Stats *dst)
+{
+	{
+		std::lock_guard<std::mutex> lck(m_queueMtx);
+		dst->queued = m_count;
+	}
+	const int64_t lag = m_lagUs;
+
+	dst->uploaded = m_uploaded;
+	dst->dropped = m_dropped;
+	dst->failures = m_failures;
+	dst->spooled = m_spooled;
+	dst->lag = lag >= 0 ? lag * 1e-6 : NAN;
+	dst->status = m_status;
+}
+
+bool
+HttpUploader::compressionAvailable()
+{
+#ifdef RADIOSONDE_HAVE_ZLIB
+	return true;
+#else
+	return false;
+#endif
+}
+
+/* Private methods {{{ */
+void
+HttpUploader::workerLoop()
+{
+	std::unique_lock<std::mutex> lck(m_queueMtx);
+	std::string payload;
+	size_t count;
+	unsigned frames = 0;
+	int64_t rxTime = 0;
+	bool last = false;
+
+	while (!last) {
+		m_queueCv.wait_for(lck, std::chrono::milliseconds(m_windowMs), [this]{ return !m_running; });
+		last = !m_running;
+
+		count = m_count;
+		for (size_t i=0; i<count; i++) {
+			m_batch[i] = m_ring[(m_head + i) % m_ring.size()];
+		}
+		m_head = (m_head + count) % m_ring.size();
+		m_count = 0;
+		lck.unlock();
+
+		if (count) frames = encodeBatch(count, &payload, &rxTime);
+
+		if (last) {
+			/* Whatever is left is sent on the next start */
+			if (count) spool(payload, rxTime, frames);
+		} else {
+			if (count) deliver(payload, rxTime, frames);
+			drainSpool();
+		}
+
+		lck.lock();
+	}
+}
+
+/**
+ * Encode the first count frames of m_batch into a payload, keeping only the
+ * latest copy of each frame
+ *
+ * @param rxTime set to the oldest receive time in the batch, for the lag
+ * @return number of frames in the payload
+ */
+unsigned
+HttpUploader::encodeBatch(size_t count, std::string *payload, int64_t *rxTime)
+{
+	std::unordered_map<std::string, size_t> latest;
+	std::string json;
+	unsigned kept = 0;
+
+	/* Partial updates of a frame come with the same serial and sequence number */
+	std::vector<bool> superseded(count, false);
+	*rxTime = m_batch[0].rxTime;
+	for (size_t i=0; i<count; i++) {
+		auto it = latest.find(m_batch[i].serial);
+
+		*rxTime = std::min(*rxTime, m_batch[i].rxTime);
+		if (it == latest.end()) {
+			latest.emplace(m_batch[i].serial, i);
+		} else {
+			if (m_batch[it->second].seq == m_batch[i].seq) superseded[it->second] = true;
+			it->second = i;
+		}
+	}
+
+	json = "{\"uploader\":\"";
+	json_escape(&json, m_name);
+	json += "\",\"frames\":[";
+	for (size_t i=0; i<count; i++) {
+		DerivedMeteo& derived = m_derived.update(&m_batch[i]);
+
+		if (superseded[i]) continue;
+		derived.fill(&m_batch[i]);
+		NetSink::encode(&json, &m_batch[i], &derived, NetSink::FORMAT_JSON);
+		json[json.size() - 1] = ',';    /* Replace the newline */
+		kept++;
+	}
+	json[json.size() - 1] = ']';
+	json += '}';
+
+	payload->clear();
+	if (!m_gzip || !gzip_compress(json, payload)) {
+		m_gzip = false;
+		payload->swap(json);
+	}
+	return kept;
+}
+
+/**
+ * Send a new batch right away, unless older ones are waiting in the spool: it
+ * then joins the spool, to keep the order
+ */
+void
+HttpUploader::deliver(const std::string& payload, int64_t rxTime, unsigned frames)
+{
+	if (m_spool.empty() && now_ms() >= m_retryAt && settle(post(payload, m_gzip), rxTime, frames)) return;
+	spool(payload, rxTime, frames);
+}
+
+/**
+ * Send spooled batches in order, until one has to be retried or stop() is
+ * called
+ */
+void
+HttpUploader::drainSpool()
+{
+	std::string payload;
+
+	for (int n=0; n<MAX_DRAIN_BATCHES && m_running && !m_spool.empty() && now_ms() >= m_retryAt; n++) {
+		const SpoolEntry& entry = m_spool.front();
+
+		if (!read_file(entry.path, &payload)) {
+			m_dropped += entry.frames;
+		} else if (!settle(post(payload, entry.gzip), entry.rxTime, entry.frames)) {
+			break;
+		}
+
+		remove(entry.path.c_str());
+		m_spoolBytes -= entry.bytes;
+		m_spool.pop_front();
+	}
+	m_spooled = m_spool.size();
+}
+
+/**
+ * Account for the outcome of an upload, and schedule the next attempt
+ *
+ * @return false if the batch must be sent again later
+ */
+bool
+HttpUploader::settle(PostResult result, int64_t rxTime, unsigned frames)
+{
+	switch (result) {
+	case POST_OK:
+		m_uploaded += frames;
+		m_lagUs = std::max<int64_t>(0, epoch_us() - rxTime);
+		break;
+	case POST_REJECTED:
+		/* The server is up, there's just no point in sending it again */
+		m_dropped += frames;
+		m_failures++;
+		break;
+	case POST_RETRY:
+		m_failures++;
+		m_retryAt = now_ms() + m_backoffMs;
+		m_backoffMs = std::min<int64_t>(2 * m_backoffMs, MAX_BACKOFF_MS);
+		return false;
+	}
+
+	m_backoffMs = MIN_BACKOFF_MS;
+	return true;
+}
+
+/**
+ * Write a batch to the spool directory, dropping the oldest batches if the
+ * spool gets too large
+ */
+bool
+HttpUploader::spool(const std::string& payload, int64_t rxTime, unsigned frames)
+{
+	char fname[64];
+	std::string path;
+	FILE *fd;
+	bool ok;
+
+	snprintf(fname, sizeof(fname), SPOOL_PATTERN, m_spoolCounter++, (long long)rxTime, frames, m_gzip ? ".gz" : "");
+	path = (std::filesystem::path(m_spoolDir) / fname).string();
+
+	if (!(fd = fopen(path.c_str(), "wb"))) {
+		m_dropped += frames;
+		return false;
+	}
+	ok = fwrite(payload.data(), payload.size(), 1, fd) == 1;
+	ok = fclose(fd) == 0 && ok;
+	if (!ok) {
+		remove(path.c_str());
+		m_dropped += frames;
+		return false;
+	}
+
+	m_spool.push_back({path, rxTime, frames, payload.size(), m_gzip});
+	m_spoolBytes += payload.size();
+	while (m_spool.size() > 1 && (m_spoolBytes > MAX_SPOOL_BYTES || m_spool.size() > MAX_SPOOL_BATCHES)) {
+		remove(m_spool.front().path.c_str());
+		m_spoolBytes -= m_spool.front().bytes;
+		m_dropped += m_spool.front().frames;
+		m_spool.pop_front();
+	}
+	m_spooled = m_spool.size();
+	return true;
+}
+
+/**
+ * Pick up the batches left in the spool directory by a previous run
+ */
+void
+HttpUploader::loadSpool()
+{
+	std::vector<std::pair<unsigned, SpoolEntry>> found;
+	std::error_code err;
+	unsigned counter, frames;
+	long long rxTime;
+	char suffix[8];
+
+	m_spool.clear();
+	m_spoolBytes = 0;
+	m_spoolCounter = 0;
+
+	for (auto& entry : std::filesystem::directory_iterator(m_spoolDir, err)) {
+		const std::string fname = entry.path().filename().string();
+
+		suffix[0] = '\0';
+		if (!entry.is_regular_file(err)) continue;
+		if (sscanf(fname.c_str(), "%u-%lld-%u.json%7s", &counter, &rxTime, &frames, suffix) < 3) continue;
+		if (suffix[0] && strcmp(suffix, ".gz")) continue;
+
+		found.push_back({counter, {entry.path().string(), rxTime, frames, (size_t)entry.file_size(err), suffix[0] != '\0'}});
+		m_spoolCounter = std::max(m_spoolCounter, counter + 1);
+	}
+
+	std::sort(found.begin(), found.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+	for (auto& entry : found) {
+		m_spoolBytes += entry.second.bytes;
+		m_spool.push_back(entry.second);
+	}
+	m_spooled = m_spool.size();
+}
+
+/**
+ * Resolve the endpoint's host name on the resolver thread, giving up if
+ * stop() is called in the meantime. The lookup itself then carries on, and
+ * its result is dropped.
+ *
+ * @return false if the name didn't resolve, or stop() was called
+ */
+bool
+HttpUploader::resolve(std::vector<Address> *dst)
+{
+	Resolver& resolver = *m_resolver;
+	std::unique_lock<std::mutex> lck(resolver.mtx);
+	const uint64_t request = ++resolver.requested;
+
+	resolver.host = m_host;
+	resolver.port = m_port;
+	resolver.cv.notify_all();
+
+	while (m_running && resolver.done < request) {
+		resolver.cv.wait_for(lck, std::chrono::milliseconds(POLL_INTERVAL_MS));
+	}
+	if (resolver.done < request) return false;
+
+	*dst = resolver.resolved;
+	return !dst->empty();
+}
+
+/**
+ * Resolver thread. Only touches the shared state, so that the uploader can go
+ * away while a lookup is in progress
+ */
+void
+HttpUploader::resolverLoop(std::shared_ptr<Resolver> resolver)
+{
+	std::unique_lock<std::mutex> lck(resolver->mtx);
+	struct addrinfo hints, *addrs;
+	std::vector<Address> resolved;
+	std::string host, port;
+	uint64_t request;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	while (resolver->running) {
+		resolver->cv.wait(lck, [&resolver]{ return !resolver->running || resolver->done < resolver->requested; });
+		if (!resolver->running) break;
+
+		/* Only the latest request matters, older ones were given up on */
+		request = resolver->requested;
+		host = resolver->host;
+		port = resolver->port;
+		lck.unlock();
+
+		resolved.clear();
+		if (!getaddrinfo(host.c_str(), port.c_str(), &hints, &addrs)) {
+			for (struct addrinfo *ai = addrs; ai; ai = ai->ai_next) {
+				resolved.push_back({ai->ai_family, std::string((const char*)ai->ai_addr, ai->ai_addrlen)});
+			}
+			freeaddrinfo(addrs);
+		}
+
+		lck.lock();
+		resolver->resolved.swap(resolved);
+		resolver->done = request;
+		resolver->cv.notify_all();
+	}
+}
+
+/**
+ * POST a payload to the endpoint. Only waits for the status line of the
+ * response, and gives up early if stop() is called.
+ */
+HttpUploader::PostResult
+HttpUploader::post(const std::string& payload, bool gzip)
+{
+	const int64_t deadline = now_ms() + REQUEST_TIMEOUT_MS;
+	std::string request, response;
+	intptr_t fd = -1;
+	size_t sent = 0;
+	char buf[512];
+	long len;
+	int status = 0, sockErr;
+	socklen_t errLen;
+
+	m_status = 0;
+
+	/* Addresses are reused until they stop working */
+	if (m_addresses.empty() || now_ms() - m_resolvedAt > RESOLVE_TTL_MS) {
+		m_resolvedAt = 0;
+		if (!resolve(&m_addresses)) return POST_RETRY;
+		m_resolvedAt = now_ms();
+	}
+
+	/* First address that accepts a connection within the timeout */
+	for (size_t i=0; i<m_addresses.size() && fd < 0; i++) {
+		const Address& addr = m_addresses[i];
+#ifdef _WIN32
+		SOCKET s = socket(addr.family, SOCK_STREAM, 0);
+		fd = s == INVALID_SOCKET ? -1 : (intptr_t)s;
+#else
+		fd = socket(addr.family, SOCK_STREAM, 0);
+#endif
+		if (fd < 0) continue;
+		set_nonblocking(fd);
+#ifdef SO_NOSIGPIPE
+		const int one = 1;
+		setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, (const char*)&one, sizeof(one));
+#endif
+
+		if (connect(fd, (const struct sockaddr*)addr.sockaddr.data(), (socklen_t)addr.sockaddr.size()) && !IN_PROGRESS()) {
+			close_socket(fd);
+			fd = -1;
+			continue;
+		}
+
+		const int64_t connectDeadline = std::min(deadline, now_ms() + CONNECT_TIMEOUT_MS);
+		bool connected = false;
+		while (m_running && now_ms() < connectDeadline) {
+			if (!wait_socket(fd, true, POLL_INTERVAL_MS)) continue;
+
+			sockErr = 0;
+			errLen = sizeof(sockErr);
+			connected = !getsockopt(fd, SOL_SOCKET, SO_ERROR, (char*)&sockErr, &errLen) && !sockErr;
+			break;
+		}
+		if (!connected) {
+			close_socket(fd);
+			fd = -1;
+		}
+	}
+	if (fd < 0) {
+		m_addresses.clear();
+		return POST_RETRY;
+	}
+
+	request = "POST " + m_path + " HTTP/1.1\r\n";
+	request += "Host: " + (m_host.find(':') != std::string::npos ? "[" + m_host + "]" : m_host);
+	request += m_port == "80" ? "\r\n" : ":" + m_port + "\r\n";
+	request += "User-Agent: sdrpp-radiosonde\r\n";
+	request += "Content-Type: application/json\r\n";
+	if (gzip) request += "Content-Encoding: gzip\r\n";
+	request += "Content-Length: " + std::to_string(payload.size()) + "\r\n";
+	request += "Connection: close\r\n\r\n";
+	request += payload;
+
+	while (sent < request.size() && m_running && now_ms() < deadline) {
+		if (!wait_socket(fd, true, POLL_INTERVAL_MS)) continue;
+		len = send(fd, request.data() + sent, request.size() - sent, SEND_FLAGS);
+		if (len > 0) {
+			sent += len;
+		} else if (len < 0 && !WOULD_BLOCK()) {
+			break;
+		}
+	}
+
+	/* The status line is all that matters */
+	while (sent == request.size() && m_running && now_ms() < deadline && response.find("\r\n") == std::string::npos) {
+		if (!wait_socket(fd, false, POLL_INTERVAL_MS)) continue;
+		len = recv(fd, buf, sizeof(buf), 0);
+		if (len > 0) {
+			response.append(buf, len);
+		} else if (len == 0 || !WOULD_BLOCK()) {
+			break;
+		}
+	}
+	close_socket(fd);
+
+	if (sscanf(response.c_str(), "HTTP/%*d.%*d %d", &status) != 1) return POST_RETRY;
+	m_status = status;
+
+	if (status >= 200 && status < 300) return POST_OK;
+	if (status >= 500 || status == 408 || status == 429) return POST_RETRY;
+	return POST_REJECTED;
+}
+/* }}} */
+
+/* Static functions {{{ */
+static bool
+net_init()
+{
+#ifdef _WIN32
+	static bool wsaInit = false;
+	WSADATA wsaData;
+
+	if (!wsaInit) wsaInit = !WSAStartup(MAKEWORD(2, 2), &wsaData);
+	return wsaInit;
+#else
+	return true;
+#endif
+}
+
+static void
+close_socket(intptr_t fd)
+{
+#ifdef _WIN32
+	closesocket((SOCKET)fd);
+#else
+	close(fd);
+#endif
+}
+
+static bool
+set_nonblocking(intptr_t fd)
+{
+#ifdef _WIN32
+	u_long one = 1;
+	return !ioctlsocket((SOCKET)fd, FIONBIO, &one);
+#else
+	return fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == 0;
+#endif
+}
+
+/**
+ * @return true if the socket became writable (or readable) within the timeout,
+ *         or has an error pending (Windows reports failed connects that way)
+ */
+static bool
+wait_socket(intptr_t fd, bool write, int timeoutMs)
+{
+	struct timeval tv;
+	fd_set fds, errFds;
+
+	FD_ZERO(&fds);
+	FD_ZERO(&errFds);
+	FD_SET(fd, &fds);
+	FD_SET(fd, &errFds);
+	tv.tv_sec = timeoutMs / 1000;
+	tv.tv_usec = (timeoutMs % 1000) * 1000;
+	return select((int)fd + 1, write ? NULL : &fds, write ? &fds : NULL, &errFds, &tv) > 0;
+}
+
+/**
+ * Split http://host[:port][/path], where host may be a bracketed IPv6 address
+ */
+static bool
+parse_url(const std::string& url, std::string *host, std::string *port, std::string *path)
+{
+	const char *prefix = "http://";
+	size_t start, end, slash;
+
+	if (url.compare(0, strlen(prefix), prefix)) return false;
+	start = strlen(prefix);
+	slash = url.find('/', start);
+	if (slash == std::string::npos) slash = url.size();
+
+	if (url[start] == '[') {
+		if ((end = url.find(']', start)) == std::string::npos || end > slash) return false;
+		*host = url.substr(start + 1, end - start - 1);
+		end++;
+	} else {
+		end = std::min(url.find(':', start), slash);
+		*host = url.substr(start, end - start);
+	}
+	if (host->empty()) return false;
+
+	if (end < slash && url[end] == ':') {
+		*port = url.substr(end + 1, slash - end - 1);
+		if (port->empty() || port->find_first_not_of("0123456789") != std::string::npos) return false;
+	} else if (end == slash) {
+		*port = "80";
+	} else {
+		return false;
+	}
+
+	*path = slash < url.size() ? url.substr(slash) : "/";
+	return true;
+}
+
+static void
+json_escape(std::string *dst, const std::string& str)
+{
+	char tmp[8];
+
+	for (char c : str) {
+		if (c == '"' || c == '\\') {
+			dst->push_back('\\');
+			dst->push_back(c);
+		} else if ((unsigned char)c < 0x20) {
+			snprintf(tmp, sizeof(tmp), "\\u%04x", c);
+			dst->append(tmp);
+		} else {
+			dst->push_back(c);
+		}
+	}
+}
+
+static bool
+gzip_compress(const std::string& src, std::string *dst)
+{
+#ifdef RADIOSONDE_HAVE_ZLIB
+	z_stream zs;
+	int ret;
+
+	memset(&zs, 0, sizeof(zs));
+	if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) return false;
+
+	dst->resize(deflateBound(&zs, src.size()));
+	zs.next_in = (Bytef*)src.data();
+	zs.avail_in = src.size();
+	zs.next_out = (Bytef*)&(*dst)[0];
+	zs.avail_out = dst->size();
+	ret = deflate(&zs, Z_FINISH);
+	dst->resize(zs.total_out);
+	deflateEnd(&zs);
+	return ret == Z_STREAM_END;
+#else
+	(void)src;
+	(void)dst;
+	return false;
+#endif
+}
+
+static bool
+read_file(const std::string& path, std::string *dst)
+{
+	FILE *fd;
+	char buf[8192];
+	size_t len;
+	bool ok;
+
+	if (!(fd = fopen(path.c_str(), "rb"))) return false;
+	dst->clear();
+	while ((len = fread(buf, 1, sizeof(buf), fd)) > 0) dst->append(buf, len);
+	ok = !ferror(fd);
+	fclose(fd);
+	return ok;
+}
+
+static int64_t
+now_ms()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int64_t
+epoch_us()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count();
+}
+/* }}} */
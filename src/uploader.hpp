@@ -0,0 +1,159 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "decode/common.hpp"
+#include "derived.hpp"
+
+/**
+ * Uploads every frame to a central HTTP endpoint (e.g. a SondeHub-style
+ * aggregation server), as a JSON document POSTed once per batch window:
+ *
+ *   {"uploader":"<name>","frames":[<frame>,...]}
+ *
+ * where each frame is encoded like NetSink's JSON lines. Within a window, only
+ * the latest copy of each frame (serial and sequence number) is sent. The
+ * payload is gzip-compressed if the plugin was built with zlib.
+ *
+ * Frames are handed over through a bounded queue, so the caller never waits.
+ * Batches that can't be delivered (no link, 5xx, 408 or 429) are written to a
+ * spool directory, and retried from there in order, with exponential backoff;
+ * new batches also go through the spool until it has drained, so the server
+ * always gets frames in order. Batches the server rejects for good (any other
+ * status, e.g. 400 or 413) are dropped. The spool survives restarts, and its oldest batches are
+ * dropped if it grows too large.
+ *
+ * Host names are resolved on a detached thread of their own, which shares
+ * its request state with the uploader: getaddrinfo() can't be interrupted,
+ * so neither stop() nor the destructor waits for it. A lookup still running
+ * when the uploader is destroyed finishes on its own, and the thread then
+ * exits.
+ */
+class HttpUploader {
+public:
+	struct Stats {
+		unsigned long uploaded;         /* Frames delivered */
+		unsigned long dropped;          /* Frames lost: queue full, spool over its limit, or rejected */
+		unsigned long failures;         /* Failed upload attempts */
+		size_t queued;                  /* Frames waiting in memory */
+		size_t spooled;                 /* Batches waiting on disk */
+		double lag;                     /* Seconds from receiving the oldest frame of the last delivered
+		                                   batch to its delivery, NAN if none yet */
+		int status;                     /* HTTP status of the last attempt, 0 if it got no response */
+	};
+
+	/**
+	 * @param capacity maximum number of frames waiting to be batched
+	 */
+	HttpUploader(size_t capacity = 1024);
+	~HttpUploader();
+
+	/**
+	 * Start uploading. The uploader is stopped first if running.
+	 *
+	 * @param url endpoint, http://host[:port][/path]. HTTPS is not supported.
+	 * @param name uploader name sent with every batch
+	 * @param spoolDir directory for undelivered batches, created if needed
+	 * @param windowMs time frames are collected for before each upload
+	 * @param compress whether to gzip the payload, if supported
+	 * @return false if the URL is invalid or the spool directory unusable
+	 */
+	bool start(const std::string& url, const std::string& name, const std::string& spoolDir, int windowMs, bool compress);
+
+	/**
+	 * Stop uploading. Frames still queued are spooled, to be sent on the
+	 * next start.
+	 */
+	void stop();
+
+	/**
+	 * Queue a frame for upload. Never waits for the network.
+	 *
+	 * @param data frame to upload
+	 * @return true if queued, false if dropped because the queue is full or
+	 *         the uploader is not running
+	 */
+	bool push(const SondeFullData *data);
+
+	void stats(Stats *dst);
+	bool running() const { return m_running; }
+
+	/**
+	 * @return whether payloads can be compressed in this build
+	 */
+	static bool compressionAvailable();
+
+private:
+	enum PostResult {
+		POST_OK = 0,                    /* 2xx */
+		POST_RETRY,                     /* No connection, timeout, 5xx, 408 or 429 */
+		POST_REJECTED,                  /* Any other status (400, 413...): sending it again won't help */
+	};
+	struct Address {
+		int family;
+		std::string sockaddr;           /* struct sockaddr of the given family */
+	};
+	struct Resolver {
+		std::mutex mtx;
+		std::condition_variable cv;
+		std::string host, port;
+		std::vector<Address> resolved;
+		uint64_t requested, done;
+		bool running;
+	};
+	struct SpoolEntry {
+		std::string path;
+		int64_t rxTime;                 /* Oldest frame, microseconds since the Unix epoch */
+		unsigned frames;
+		size_t bytes;
+		bool gzip;
+	};
+
+	void workerLoop();
+	static void resolverLoop(std::shared_ptr<Resolver> resolver);
+	bool resolve(std::vector<Address> *dst);
+	unsigned encodeBatch(size_t count, std::string *payload, int64_t *rxTime);
+	void deliver(const std::string& payload, int64_t rxTime, unsigned frames);
+	void drainSpool();
+	bool spool(const std::string& payload, int64_t rxTime, unsigned frames);
+	void loadSpool();
+	bool settle(PostResult result, int64_t rxTime, unsigned frames);
+	PostResult post(const std::string& payload, bool gzip);
+
+	/* Queue, shared with the producer */
+	std::mutex m_queueMtx;
+	std::condition_variable m_queueCv;
+	std::vector<SondeFullData> m_ring;
+	size_t m_head, m_count;
+	std::atomic<bool> m_running;
+
+	/* Owned by the worker thread while running */
+	std::string m_host, m_port, m_path, m_name, m_spoolDir;
+	int m_windowMs;
+	bool m_gzip;
+	std::vector<SondeFullData> m_batch;
+	DerivedTracker m_derived;
+	std::deque<SpoolEntry> m_spool;
+	size_t m_spoolBytes;
+	unsigned m_spoolCounter;
+	int64_t m_retryAt, m_backoffMs;     /* Monotonic milliseconds */
+	std::vector<Address> m_addresses;
+	int64_t m_resolvedAt;               /* Monotonic milliseconds, 0 to resolve again */
+
+	/* Name resolution requests, shared with the resolver thread, which may
+	 * outlive the uploader */
+	std::shared_ptr<Resolver> m_resolver;
+
+	std::atomic<unsigned long> m_uploaded, m_dropped, m_failures;
+	std::atomic<size_t> m_spooled;
+	std::atomic<int64_t> m_lagUs;
+	std::atomic<int> m_status;
+	std::thread m_thread;
+};
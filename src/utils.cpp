@@ -1,3 +1,8 @@
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 #include "utils.hpp"
 
 std::string 
@@ -15,3 +20,14 @@ getTempFile(std::string file)
 	return (std::string(env) + "\\" + file);
 #endif
 }
+
+void
+syncFile(FILE *fd)
+{
+	fflush(fd);
+#ifdef _WIN32
+	_commit(_fileno(fd));
+#else
+	fsync(fileno(fd));
+#endif
+}
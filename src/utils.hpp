@@ -1,4 +1,10 @@
 #pragma once
+#include <stdio.h>
 #include <string>
 
 std::string getTempFile(std::string file);
+
+/**
+ * Flush a file and wait until its contents have been written to disk
+ */
+void syncFile(FILE *fd);